@@ -0,0 +1,1052 @@
+// Benchmarks for the clox front end and VM
+// Build: see the "Build Benchmarks" task (-O2 -DCLOX_NO_DEBUG, so the
+//        debug printing in common.hpp does not distort the numbers)
+// Usage: ./bench            - run every benchmark
+//        ./bench <name>...  - run the named benchmarks
+
+#include "common.hpp"
+#include "bytecode_file.hpp"
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include "incremental_scan.hpp"
+#include "line_index.hpp"
+#include "object.hpp"
+#include "parallel_scan.hpp"
+#include "phase_timing.hpp"
+#include "profiler.hpp"
+#include "sampler.hpp"
+#include "program.hpp"
+#include "scan_kernels.hpp"
+#include "scanner.hpp"
+#include "source_file.hpp"
+#include "static_compiler.hpp"
+#include "trace.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ---- Helpers ----
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Simple deterministic generator so runs are comparable.
+static uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static int countInstructions(const Chunk& chunk) {
+    int count = 0;
+    for (size_t offset = 0; offset < chunk.count(); offset++) {
+        if (chunk.code(offset) == static_cast<uint8_t>(OpCode::OP_CONSTANT)) offset++;
+        count++;
+    }
+    return count;
+}
+
+// The VM prints every result; send it to /dev/null while timing.
+static FILE* devnull = nullptr;
+static FILE* savedStdout = nullptr;
+static FILE* savedStderr = nullptr;
+
+static void suppressOutput() {
+    if (!devnull) devnull = fopen("/dev/null", "w");
+    savedStdout = stdout;
+    savedStderr = stderr;
+    stdout = devnull;
+    stderr = devnull;
+}
+
+static void restoreOutput() {
+    stdout = savedStdout;
+    stderr = savedStderr;
+}
+
+// Random arithmetic over number literals; always evaluates without error.
+static std::string generateArithmetic(uint32_t& state, int literals) {
+    if (literals <= 1) return std::to_string(nextRandom(state) % 1000);
+
+    static const char* ops[] = {" + ", " - ", " * ", " / "};
+    int left = 1 + static_cast<int>(nextRandom(state) % (literals - 1));
+    return "(" + generateArithmetic(state, left) + ops[nextRandom(state) % 4] +
+           generateArithmetic(state, literals - left) + ")";
+}
+
+// ---- Optimizer: instruction count per --opt-level ----
+
+// Build a random expression tree with `literals` leaves, sprinkled with
+// the patterns the middle-end targets (x * 1, --x, x / 2^k, repeats).
+static std::string generateOptExpression(uint32_t& state, int literals) {
+    if (literals <= 1) {
+        switch (nextRandom(state) % 4) {
+            case 0:  return "--" + std::to_string(nextRandom(state) % 100);
+            case 1:  return "\"s" + std::to_string(nextRandom(state) % 4) + "\"";
+            default: return std::to_string(nextRandom(state) % 100);
+        }
+    }
+
+    int left = 1 + static_cast<int>(nextRandom(state) % (literals - 1));
+    std::string a = generateOptExpression(state, left);
+    std::string b = generateOptExpression(state, literals - left);
+    switch (nextRandom(state) % 8) {
+        case 0:  return "(" + a + " + " + b + ")";
+        case 1:  return "(" + a + " - -" + b + ")";
+        case 2:  return "(" + a + " * 1 + " + b + ")";
+        case 3:  return "(" + a + " / 4 - " + b + ")";
+        case 4:  // Repeat small subtrees only, to keep the source size linear
+                 return "(" + a + " == " + (left <= 4 ? a : b) + ")";
+        case 5:  return "!!(" + a + " < " + b + ")";
+        case 6:  return "(" + a + " * " + b + ")";
+        default: return "(" + a + " + -0 + " + b + ")";
+    }
+}
+
+static void benchOptimizer() {
+    const int kExpressions = 200;
+    const int kLiterals = 100;   // Stays under the 256-constant limit at -O0
+
+    uint32_t state = 2463534242u;
+    std::vector<std::string> sources;
+    size_t sourceBytes = 0;
+    for (int i = 0; i < kExpressions; i++) {
+        sources.push_back(generateOptExpression(state, kLiterals));
+        sourceBytes += sources.back().size();
+    }
+
+    printf("opt: %d generated expressions, %zu bytes of source\n",
+           kExpressions, sourceBytes);
+    printf("  %-10s %12s %12s %10s %14s\n",
+           "level", "instructions", "code bytes", "constants", "compile us/expr");
+
+    long baseline = 0;
+    for (int level = 0; level <= 2; level++) {
+        Obj* objects = nullptr;
+        setObjectList(&objects);
+
+        long instructions = 0;
+        long bytes = 0;
+        long constants = 0;
+        int failures = 0;
+        Clock::time_point start = Clock::now();
+        for (const std::string& source : sources) {
+            Chunk chunk;
+            if (!compile(source, chunk, level)) failures++;
+            instructions += countInstructions(chunk);
+            bytes += static_cast<long>(chunk.count());
+            constants += static_cast<long>(chunk.constants().size());
+        }
+        double elapsed = secondsSince(start);
+
+        freeObjects(objects);
+        setObjectList(nullptr);
+
+        if (level == 0) baseline = instructions;
+        printf("  -O%-8d %12ld %12ld %10ld %14.1f   (%.1f%% of -O0)%s\n",
+               level, instructions, bytes, constants,
+               elapsed * 1e6 / kExpressions,
+               100.0 * static_cast<double>(instructions) / static_cast<double>(baseline),
+               failures ? "  COMPILE ERRORS" : "");
+    }
+}
+
+// ---- Scanner: whitespace / comment skipping kernels ----
+
+// Indented, commented Lox-looking text (the scanner does not care that it
+// is not a single expression).
+static std::string generateFormattedSource(uint32_t& state, size_t bytes) {
+    static const char* statements[] = {
+        "var total = total + item.price * 2;",
+        "if (count >= limit) return nil;",
+        "print \"done\";",
+        "fun area(w, h) { return w * h; }",
+    };
+    std::string source;
+    while (source.size() < bytes) {
+        int indent = 4 * static_cast<int>(nextRandom(state) % 5);
+        source.append(indent, ' ');
+        if (nextRandom(state) % 3 == 0) {
+            source += "// ";
+            source.append(20 + nextRandom(state) % 50, 'c');
+        } else {
+            source += statements[nextRandom(state) % 4];
+        }
+        source += nextRandom(state) % 4 == 0 ? "\n\n" : "\n";
+    }
+    return source;
+}
+
+static long scanAll(const std::string& source, ScanMode mode) {
+    Scanner scanner(source, mode);
+    long tokens = 0;
+    while (scanner.scanToken().type != TokenType::END_OF_FILE) tokens++;
+    return tokens;
+}
+
+// Best of several runs, in MB/s.
+static double scanThroughput(const std::string& source, ScanMode mode, long& tokens) {
+    const int kRepeats = 5;
+    double best = 1e30;
+    for (int i = 0; i < kRepeats; i++) {
+        Clock::time_point start = Clock::now();
+        tokens = scanAll(source, mode);
+        double elapsed = secondsSince(start);
+        if (elapsed < best) best = elapsed;
+    }
+    return static_cast<double>(source.size()) / best / 1e6;
+}
+
+static void benchScan() {
+    const size_t kBytes = 16 * 1024 * 1024;
+
+    uint32_t state = 362436069u;
+    std::string source = generateFormattedSource(state, kBytes);
+
+    printf("scan: %zu bytes of formatted source (MB/s)\n", source.size());
+    printf("  %-8s %10s %10s %10s\n", "kernel", "bounded", "sentinel", "tokens");
+    ScanKernel saved = activeScanKernel();
+    double baseline = 0;
+    for (ScanKernel kernel : {ScanKernel::SCALAR, ScanKernel::SSE2, ScanKernel::AVX2}) {
+        if (!selectScanKernel(kernel)) {
+            printf("  %-8s unsupported on this CPU\n", scanKernelName(kernel));
+            continue;
+        }
+        long tokens = 0;
+        double bounded = scanThroughput(source, ScanMode::BOUNDED, tokens);
+        double sentinel = scanThroughput(source, ScanMode::SENTINEL, tokens);
+        if (kernel == ScanKernel::SCALAR) baseline = bounded;
+        printf("  %-8s %10.1f %10.1f %10ld   (%.2fx / %.2fx)\n", scanKernelName(kernel),
+               bounded, sentinel, tokens, bounded / baseline, sentinel / baseline);
+    }
+    selectScanKernel(saved);
+}
+
+// ---- Token storage: std::vector<Token> vs TokenBuffer ----
+
+static void benchTokens() {
+    const size_t kBytes = 16 * 1024 * 1024;
+    const int kRepeats = 5;
+
+    uint32_t state = 362436069u;
+    std::string source = generateFormattedSource(state, kBytes);
+
+    double aosScan = 1e30, soaScan = 1e30, aosWalk = 1e30, soaWalk = 1e30;
+    size_t count = 0;
+    long checksum = 0;
+    for (int r = 0; r < kRepeats; r++) {
+        Clock::time_point start = Clock::now();
+        std::vector<Token> tokens;
+        tokens.reserve(source.size() / 5 + 1);   // Same guess tokenize() makes
+        Scanner scanner(source);
+        for (;;) {
+            tokens.push_back(scanner.scanToken());
+            if (tokens.back().type == TokenType::END_OF_FILE) break;
+        }
+        aosScan = std::min(aosScan, secondsSince(start));
+
+        start = Clock::now();
+        TokenBuffer buffer = tokenize(source);
+        soaScan = std::min(soaScan, secondsSince(start));
+        count = buffer.size();
+
+        // A later pass that only looks at token types (e.g. bracket matching)
+        start = Clock::now();
+        for (const Token& token : tokens) checksum += static_cast<int>(token.type);
+        aosWalk = std::min(aosWalk, secondsSince(start));
+
+        start = Clock::now();
+        for (size_t i = 0; i < buffer.size(); i++) checksum -= static_cast<int>(buffer.type(i));
+        soaWalk = std::min(soaWalk, secondsSince(start));
+    }
+
+    double megabytes = static_cast<double>(source.size()) / 1e6;
+    printf("tokens: %zu tokens from %zu bytes of formatted source\n", count, source.size());
+    printf("  %-22s %10s %14s %10s\n", "", "scan MB/s", "type pass ns/tok", "bytes/tok");
+    printf("  %-22s %10.1f %14.2f %10zu\n", "std::vector<Token>", megabytes / aosScan,
+           aosWalk * 1e9 / static_cast<double>(count), sizeof(Token));
+    printf("  %-22s %10.1f %14.2f %10zu%s\n", "TokenBuffer", megabytes / soaScan,
+           soaWalk * 1e9 / static_cast<double>(count),
+           sizeof(uint8_t) + 2 * sizeof(uint32_t) + sizeof(int),
+           checksum == 0 ? "" : "  MISMATCH");
+}
+
+// ---- Parallel tokenization ----
+
+static void benchParallelScan() {
+    const size_t kBytes = 64 * 1024 * 1024;
+    const int kRepeats = 3;
+
+    uint32_t state = 123456789u;
+    std::string source = generateFormattedSource(state, kBytes);
+    double megabytes = static_cast<double>(source.size()) / 1e6;
+
+    double sequential = 1e30;
+    size_t count = 0;
+    for (int r = 0; r < kRepeats; r++) {
+        Clock::time_point start = Clock::now();
+        count = tokenize(source).size();
+        sequential = std::min(sequential, secondsSince(start));
+    }
+
+    printf("parallel scan: %zu bytes, %zu tokens (%u hardware threads)\n",
+           source.size(), count, std::thread::hardware_concurrency());
+    printf("  %-12s %8.1f MB/s\n", "sequential", megabytes / sequential);
+    for (unsigned threads : {1u, 2u, 4u, 8u, 16u}) {
+        double best = 1e30;
+        for (int r = 0; r < kRepeats; r++) {
+            Clock::time_point start = Clock::now();
+            TokenBuffer tokens = tokenizeParallel(source, threads);
+            best = std::min(best, secondsSince(start));
+            if (tokens.size() != count) printf("  MISMATCH\n");
+        }
+        printf("  %2u threads   %8.1f MB/s  (%.2fx)\n", threads, megabytes / best,
+               sequential / best);
+    }
+}
+
+// ---- Line numbers: eager counting vs lazy LineIndex ----
+
+static void benchLines() {
+    const size_t kBytes = 16 * 1024 * 1024;
+    const int kRepeats = 5;
+
+    uint32_t state = 362436069u;
+    std::string source = generateFormattedSource(state, kBytes);
+    double megabytes = static_cast<double>(source.size()) / 1e6;
+
+    double eager = 1e30, lazy = 1e30, index = 1e30;
+    int lastLine = 0;
+    for (int r = 0; r < kRepeats; r++) {
+        for (LineMode mode : {LineMode::EAGER, LineMode::LAZY}) {
+            Clock::time_point start = Clock::now();
+            Scanner scanner(source, ScanMode::SENTINEL, mode);
+            while (scanner.scanToken().type != TokenType::END_OF_FILE) {}
+            double elapsed = secondsSince(start);
+            double& best = mode == LineMode::EAGER ? eager : lazy;
+            best = std::min(best, elapsed);
+        }
+
+        // What an error costs in LAZY mode: building the index once
+        Clock::time_point start = Clock::now();
+        LineIndex lines(source);
+        lastLine = lines.line(source.size());
+        index = std::min(index, secondsSince(start));
+    }
+
+    printf("lines: %zu bytes, %d lines\n", source.size(), lastLine);
+    printf("  eager scan   %8.1f MB/s\n", megabytes / eager);
+    printf("  lazy scan    %8.1f MB/s  (%.2fx)\n", megabytes / lazy, eager / lazy);
+    printf("  LineIndex    %8.2f ms to build on first error\n", index * 1e3);
+}
+
+// ---- Chunk line tables: footprint and lookup ----
+
+static void benchLineTable() {
+    const int kChunks = 2000;
+    const int kRepeats = 5;
+
+    // Expressions spread over a few lines, like formatted input
+    uint32_t state = 88675123u;
+    std::vector<std::string> sources;
+    for (int i = 0; i < kChunks; i++) {
+        std::string source = generateArithmetic(state, 40);
+        for (char& c : source) {
+            if (c == ' ' && nextRandom(state) % 4 == 0) c = '\n';
+        }
+        sources.push_back(source);
+    }
+
+    printf("linetable: %d chunks of 40 literals\n", kChunks);
+    for (LineMode mode : {LineMode::EAGER, LineMode::LAZY}) {
+        std::vector<Chunk> chunks(kChunks);
+        size_t code = 0, perByte = 0, encoded = 0, runs = 0;
+        for (int i = 0; i < kChunks; i++) {
+            compile(sources[i], chunks[i], 0, ParseMode::RECURSIVE, mode);
+            code += chunks[i].count();
+            perByte += chunks[i].count() * sizeof(int);
+            encoded += chunks[i].lines().byteSize();
+            runs += chunks[i].lines().runs();
+        }
+
+        double best = 1e30;
+        long sum = 0;
+        for (int r = 0; r < kRepeats; r++) {
+            Clock::time_point start = Clock::now();
+            for (const Chunk& chunk : chunks) {
+                for (size_t offset = 0; offset < chunk.count(); offset++) {
+                    sum += chunk.line(offset);
+                }
+            }
+            best = std::min(best, secondsSince(start));
+        }
+
+        printf("  %-5s code %7zu B  per-byte ints %7zu B  RLE %7zu B (%zu runs)  "
+               "lookup %5.1f ns  [%ld]\n",
+               mode == LineMode::EAGER ? "eager" : "lazy", code, perByte, encoded, runs,
+               best * 1e9 / static_cast<double>(code), sum);
+    }
+}
+
+// ---- Source loading: ifstream copies vs mmap ----
+
+// The loader main.cpp used before SourceFile.
+static std::string readFileByStream(const char* path) {
+    std::ifstream file(path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+static void benchLoad() {
+    const size_t kBytes = 64 * 1024 * 1024;
+    const int kRepeats = 5;
+    const char* path = "bench_load.lox";
+
+    uint32_t state = 362436069u;
+    std::string contents = generateFormattedSource(state, kBytes);
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        printf("load: cannot write %s\n", path);
+        return;
+    }
+    fwrite(contents.data(), 1, contents.size(), out);
+    fclose(out);
+
+    double streamLoad = 1e30, streamTotal = 1e30, mapLoad = 1e30, mapTotal = 1e30;
+    for (int r = 0; r < kRepeats; r++) {
+        Clock::time_point start = Clock::now();
+        std::string source = readFileByStream(path);
+        streamLoad = std::min(streamLoad, secondsSince(start));
+        scanAll(source, ScanMode::SENTINEL);
+        streamTotal = std::min(streamTotal, secondsSince(start));
+
+        start = Clock::now();
+        SourceFile file;
+        file.open(path);
+        mapLoad = std::min(mapLoad, secondsSince(start));
+        Scanner scanner(file.text(), file.hasSentinel() ? ScanMode::SENTINEL : ScanMode::BOUNDED);
+        while (scanner.scanToken().type != TokenType::END_OF_FILE) {}
+        mapTotal = std::min(mapTotal, secondsSince(start));
+    }
+    remove(path);
+
+    printf("load: %zu byte file (warm page cache)\n", contents.size());
+    printf("  %-18s %10s %14s\n", "", "load ms", "load+scan ms");
+    printf("  %-18s %10.2f %14.2f\n", "ifstream+string", streamLoad * 1e3, streamTotal * 1e3);
+    printf("  %-18s %10.2f %14.2f\n", "SourceFile (mmap)", mapLoad * 1e3, mapTotal * 1e3);
+}
+
+// ---- Precompiled bytecode: .lox vs .loxc time to first result ----
+
+static void benchBytecode() {
+    const int kTerms = 1000000;
+    const int kRepeats = 5;
+    const char* sourcePath = "bench_bytecode.lox";
+    const char* bytecodePath = "bench_bytecode.loxc";
+
+    // Keyword literals need no constant slots, so the expression can grow
+    // past the 256-constant limit; a few strings and numbers ride along.
+    static const char* terms[] = {"!true", "false", "nil", "!!nil", "(1 < 2)", "\"s\" + \"t\""};
+    std::string contents = "true";
+    int constants = 0;
+    for (int i = 0; i < kTerms; i++) {
+        int term = i % 6;
+        if (term >= 4 && (constants += 2) > 250) term = i % 4;
+        contents += i % 8 == 0 ? " ==\n" : " == ";
+        contents += terms[term];
+    }
+    FILE* out = fopen(sourcePath, "wb");
+    if (!out) {
+        printf("bytecode: cannot write %s\n", sourcePath);
+        return;
+    }
+    fwrite(contents.data(), 1, contents.size(), out);
+    fclose(out);
+
+    Chunk chunk;
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    bool compiled = compile(contents, chunk);
+    setObjectList(nullptr);
+    if (!compiled || !writeBytecode(chunk, bytecodePath)) {
+        printf("bytecode: cannot compile the benchmark expression\n");
+        freeObjects(objects);
+        remove(sourcePath);
+        return;
+    }
+    freeObjects(objects);
+
+    double fromSource = 1e30, fromBytecode = 1e30, loadOnly = 1e30;
+    for (int r = 0; r < kRepeats; r++) {
+        suppressOutput();
+        Clock::time_point start = Clock::now();
+        {
+            SourceFile file;
+            file.open(sourcePath);
+            VM vm;
+            vm.interpret(file.text());
+        }
+        fromSource = std::min(fromSource, secondsSince(start));
+
+        start = Clock::now();
+        {
+            BytecodeFile bytecode;
+            bytecode.open(bytecodePath);
+            loadOnly = std::min(loadOnly, secondsSince(start));
+            VM vm;
+            vm.interpret(bytecode.chunk());
+        }
+        fromBytecode = std::min(fromBytecode, secondsSince(start));
+        restoreOutput();
+    }
+    remove(sourcePath);
+    remove(bytecodePath);
+
+    printf("bytecode: %zu byte source, %zu bytes of code (warm page cache)\n",
+           contents.size(), chunk.count());
+    printf("  .lox  scan+compile+run  %8.2f ms\n", fromSource * 1e3);
+    printf("  .loxc map+verify+run    %8.2f ms  (map+verify %.2f ms)\n",
+           fromBytecode * 1e3, loadOnly * 1e3);
+}
+
+// ---- VM startup: compiling a prelude vs booting from a snapshot ----
+
+static void benchSnapshot() {
+    const int kPrelude = 500;
+    const int kRepeats = 5;
+    const char* path = "bench_snapshot.loxs";
+
+    uint32_t state = 3141592653u;
+    std::vector<std::string> prelude;
+    for (int i = 0; i < kPrelude; i++) {
+        prelude.push_back(generateOptExpression(state, 60));
+    }
+
+    {
+        VM vm;
+        vm.setCacheCapacity(kPrelude);
+        suppressOutput();
+        for (const std::string& source : prelude) vm.interpret(source);
+        restoreOutput();
+        if (!vm.saveSnapshot(path)) {
+            printf("snapshot: cannot write %s\n", path);
+            return;
+        }
+    }
+
+    // Time to first evaluation: a worker without a snapshot compiles its
+    // prelude before serving; with one it maps the file and serves at
+    // once, loading each prelude chunk on first use.
+    double compiled = 1e30, booted = 1e30, firstCompiled = 1e30, firstBooted = 1e30;
+    for (int r = 0; r < kRepeats; r++) {
+        for (bool useSnapshot : {false, true}) {
+            suppressOutput();
+            Clock::time_point start = Clock::now();
+            VM vm;
+            vm.setCacheCapacity(kPrelude);
+            if (useSnapshot) {
+                vm.loadSnapshot(path);
+            } else {
+                for (const std::string& source : prelude) vm.interpret(source);
+            }
+            vm.interpret(prelude[kPrelude / 2]);
+            double first = secondsSince(start);
+            if (useSnapshot) {
+                for (const std::string& source : prelude) vm.interpret(source);
+            }
+            double all = secondsSince(start);
+            restoreOutput();
+
+            double& bestFirst = useSnapshot ? firstBooted : firstCompiled;
+            double& bestAll = useSnapshot ? booted : compiled;
+            bestFirst = std::min(bestFirst, first);
+            bestAll = std::min(bestAll, all);
+        }
+    }
+    remove(path);
+
+    printf("snapshot: %d prelude expressions of 60 literals\n", kPrelude);
+    printf("  %-10s %20s %24s\n", "", "first evaluation ms", "every prelude entry ms");
+    printf("  %-10s %20.3f %24.2f\n", "compile", firstCompiled * 1e3, compiled * 1e3);
+    printf("  %-10s %20.3f %24.2f\n", "snapshot", firstBooted * 1e3, booted * 1e3);
+}
+
+// ---- Incremental re-scanning after small edits ----
+
+static void benchIncremental() {
+    const size_t kBytes = 4 * 1024 * 1024;
+    const int kEdits = 100;
+
+    uint32_t state = 362436069u;
+    std::string source = generateFormattedSource(state, kBytes);
+    TokenBuffer tokens = tokenize(source);
+
+    printf("incremental: one-character edits to %zu bytes (%zu tokens)\n",
+           source.size(), tokens.size());
+
+    // Typing an identifier character only touches its token. A lone quote
+    // re-pairs every later string, so the streams never line up again.
+    for (const char* inserted : {"q", "\""}) {
+        double full = 0;
+        double incremental = 0;
+        size_t rescanned = 0;
+        bool same = true;
+        for (int i = 0; i < kEdits; i++) {
+            size_t offset = nextRandom(state) % source.size();
+            source.insert(offset, inserted);
+
+            Clock::time_point start = Clock::now();
+            rescanned += retokenize(tokens, source, {offset, 0, inserted});
+            incremental += secondsSince(start);
+
+            start = Clock::now();
+            TokenBuffer reference = tokenize(source);
+            full += secondsSince(start);
+            same = same && reference.size() == tokens.size();
+        }
+        printf("  insert '%s'  full %8.1f us/edit, retokenize %8.1f us/edit (%.0fx), "
+               "%.1f tokens rescanned/edit%s\n",
+               inserted, full * 1e6 / kEdits, incremental * 1e6 / kEdits,
+               full / incremental, static_cast<double>(rescanned) / kEdits,
+               same ? "" : "  MISMATCH");
+    }
+}
+
+// ---- Keywords: perfect hash vs the original trie ----
+
+// The hand-written trie keywordType() replaced, kept as the reference.
+static TokenType trieCheck(std::string_view lexeme, size_t start,
+                           std::string_view rest, TokenType type) {
+    if (lexeme.size() == start + rest.size() &&
+        memcmp(lexeme.data() + start, rest.data(), rest.size()) == 0) {
+        return type;
+    }
+    return TokenType::IDENTIFIER;
+}
+
+static TokenType trieKeywordType(std::string_view lexeme) {
+    switch (lexeme[0]) {
+        case 'a': return trieCheck(lexeme, 1, "nd", TokenType::AND);
+        case 'c': return trieCheck(lexeme, 1, "lass", TokenType::CLASS);
+        case 'e': return trieCheck(lexeme, 1, "lse", TokenType::ELSE);
+        case 'f':
+            if (lexeme.size() > 1) {
+                switch (lexeme[1]) {
+                    case 'a': return trieCheck(lexeme, 2, "lse", TokenType::FALSE);
+                    case 'o': return trieCheck(lexeme, 2, "r", TokenType::FOR);
+                    case 'u': return trieCheck(lexeme, 2, "n", TokenType::FUN);
+                }
+            }
+            break;
+        case 'i': return trieCheck(lexeme, 1, "f", TokenType::IF);
+        case 'n': return trieCheck(lexeme, 1, "il", TokenType::NIL);
+        case 'o': return trieCheck(lexeme, 1, "r", TokenType::OR);
+        case 'p': return trieCheck(lexeme, 1, "rint", TokenType::PRINT);
+        case 'r': return trieCheck(lexeme, 1, "eturn", TokenType::RETURN);
+        case 's': return trieCheck(lexeme, 1, "uper", TokenType::SUPER);
+        case 't':
+            if (lexeme.size() > 1) {
+                switch (lexeme[1]) {
+                    case 'h': return trieCheck(lexeme, 2, "is", TokenType::THIS);
+                    case 'r': return trieCheck(lexeme, 2, "ue", TokenType::TRUE);
+                }
+            }
+            break;
+        case 'v': return trieCheck(lexeme, 1, "ar", TokenType::VAR);
+        case 'w': return trieCheck(lexeme, 1, "hile", TokenType::WHILE);
+    }
+    return TokenType::IDENTIFIER;
+}
+
+static void benchKeywords() {
+    const int kLexemes = 1000000;
+    const int kRepeats = 5;
+    static const char* words[] = {
+        "and", "class", "else", "false", "for", "fun", "if", "nil", "or",
+        "print", "return", "super", "this", "true", "var", "while",
+        "total", "count", "item", "price", "fibonacci", "index", "value", "node",
+        "forEach", "classify", "thisOne", "truth", "variable", "whilst", "x", "y",
+    };
+
+    uint32_t state = 1442695041u;
+    std::vector<std::string_view> lexemes;
+    for (int i = 0; i < kLexemes; i++) {
+        lexemes.emplace_back(words[nextRandom(state) % (sizeof(words) / sizeof(words[0]))]);
+    }
+
+    long trieSum = 0;
+    long hashSum = 0;
+    double trieBest = 1e30;
+    double hashBest = 1e30;
+    for (int r = 0; r < kRepeats; r++) {
+        Clock::time_point start = Clock::now();
+        for (std::string_view lexeme : lexemes) trieSum += static_cast<int>(trieKeywordType(lexeme));
+        double elapsed = secondsSince(start);
+        if (elapsed < trieBest) trieBest = elapsed;
+
+        start = Clock::now();
+        for (std::string_view lexeme : lexemes) hashSum += static_cast<int>(keywordType(lexeme));
+        elapsed = secondsSince(start);
+        if (elapsed < hashBest) hashBest = elapsed;
+    }
+
+    printf("keywords: %d identifier lexemes (half keywords)\n", kLexemes);
+    printf("  trie          %6.2f ns/lexeme\n", trieBest * 1e9 / kLexemes);
+    printf("  perfect hash  %6.2f ns/lexeme  (%.2fx)%s\n", hashBest * 1e9 / kLexemes,
+           trieBest / hashBest, trieSum == hashSum ? "" : "  MISMATCH");
+}
+
+// ---- Numeric literals: strtod vs parseNumber ----
+
+static void benchNumbers() {
+    const int kLiterals = 1000000;
+
+    uint32_t state = 88172645u;
+    std::string source;
+    std::vector<std::string_view> lexemes;
+    std::vector<size_t> offsets;
+    for (int i = 0; i < kLiterals; i++) {
+        offsets.push_back(source.size());
+        source += std::to_string(nextRandom(state) % 100000);
+        if (i % 2 == 0) source += "." + std::to_string(nextRandom(state) % 1000);
+        source += " ";
+    }
+    for (int i = 0; i < kLiterals; i++) {
+        size_t end = source.find(' ', offsets[i]);
+        lexemes.emplace_back(source.data() + offsets[i], end - offsets[i]);
+    }
+
+    // Keep the optimizer from discarding the loops.
+    double checksum = 0;
+
+    Clock::time_point start = Clock::now();
+    for (std::string_view lexeme : lexemes) {
+        checksum += strtod(lexeme.data(), nullptr);
+    }
+    double strtodSeconds = secondsSince(start);
+
+    start = Clock::now();
+    for (std::string_view lexeme : lexemes) {
+        checksum -= parseNumber(lexeme);
+    }
+    double parseSeconds = secondsSince(start);
+
+    printf("numbers: %d literals\n", kLiterals);
+    printf("  strtod       %8.1f ns/literal\n", strtodSeconds * 1e9 / kLiterals);
+    printf("  parseNumber  %8.1f ns/literal  (%.1fx, checksum %g)\n",
+           parseSeconds * 1e9 / kLiterals, strtodSeconds / parseSeconds, checksum);
+}
+
+// ---- Compiled-chunk cache: repeated queries ----
+
+static void benchCache() {
+    const int kDistinct = 32;
+    const int kQueries = 200000;
+
+    uint32_t state = 521288629u;
+    std::vector<std::string> sources;
+    for (int i = 0; i < kDistinct; i++) {
+        sources.push_back(generateArithmetic(state, 40));
+    }
+
+    printf("cache: %d queries over %d distinct expressions\n", kQueries, kDistinct);
+    for (size_t capacity : {size_t{0}, size_t{kDistinct}}) {
+        VM vm;
+        vm.setCacheCapacity(capacity);
+
+        suppressOutput();
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < kQueries; i++) {
+            vm.interpret(sources[nextRandom(state) % kDistinct]);
+        }
+        double elapsed = secondsSince(start);
+        restoreOutput();
+
+        const ChunkCacheStats& stats = vm.cacheStats();
+        printf("  capacity %-4zu %8.2f us/query  (hits %llu, misses %llu, evictions %llu)\n",
+               capacity, elapsed * 1e6 / kQueries,
+               static_cast<unsigned long long>(stats.hits),
+               static_cast<unsigned long long>(stats.misses),
+               static_cast<unsigned long long>(stats.evictions));
+    }
+}
+
+// ---- Many small expressions: compile + freeze + run per query ----
+
+static void benchSmall() {
+    const int kDistinct = 256;
+    const int kQueries = 200000;
+
+    uint32_t state = 1013904223u;
+    std::vector<std::string> sources;
+    for (int i = 0; i < kDistinct; i++) {
+        sources.push_back(generateArithmetic(state, 1 + i % 6));
+    }
+
+    printf("small: %d queries over %d expressions of 1-6 literals\n", kQueries, kDistinct);
+    for (size_t capacity : {size_t{0}, size_t{kDistinct}}) {
+        VM vm;
+        vm.setCacheCapacity(capacity);
+
+        suppressOutput();
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < kQueries; i++) {
+            vm.interpret(sources[i % kDistinct]);
+        }
+        double elapsed = secondsSince(start);
+        restoreOutput();
+
+        printf("  %-8s %8.1f ns/query\n", capacity == 0 ? "uncached" : "cached",
+               elapsed * 1e9 / kQueries);
+    }
+}
+
+// ---- One shared program, one VM per thread ----
+
+static void benchProgram() {
+    const int kRunsPerThread = 200000;
+
+    uint32_t state = 2463534242u;
+    ProgramHandle program = Program::compile(generateArithmetic(state, 12) + " == \"x\" + \"y\"");
+
+    printf("program: %d runs per thread, %u hardware threads\n", kRunsPerThread,
+           std::thread::hardware_concurrency());
+    double single = 0;
+    for (int threads : {1, 2, 4, 8}) {
+        // Results are not printed: a shared stdout would serialize the
+        // threads on its lock.
+        Clock::time_point start = Clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&program]() {
+                VM vm;
+                vm.setPrintResult(false);
+                for (int i = 0; i < kRunsPerThread; i++) vm.interpret(*program);
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        double elapsed = secondsSince(start);
+
+        double rate = threads * kRunsPerThread / elapsed;
+        if (threads == 1) single = rate;
+        printf("  %d threads %8.2f M runs/s  (%.2fx)\n", threads, rate / 1e6, rate / single);
+    }
+}
+
+// ---- Compile-time expression vs compiling per query ----
+
+static constexpr char kStaticSource[] =
+    "(1 + 2) * 3 - 4 / (5 - 6) >= 7 == !(\"con\" + \"cat\" == \"concat\")";
+static constexpr auto kStaticImage = compileStatic(kStaticSource);
+
+static void benchStatic() {
+    const int kQueries = 200000;
+
+    printf("static: %d runs of a fixed %zu-byte expression\n", kQueries,
+           sizeof(kStaticSource) - 1);
+    for (bool precompiled : {false, true}) {
+        VM vm;
+        suppressOutput();
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < kQueries; i++) {
+            if (precompiled) {
+                vm.interpret(staticProgram<kStaticImage>());
+            } else {
+                vm.interpret(kStaticSource);
+            }
+        }
+        double elapsed = secondsSince(start);
+        restoreOutput();
+
+        printf("  %-10s %8.1f ns/query\n", precompiled ? "constexpr" : "source",
+               elapsed * 1e9 / kQueries);
+    }
+}
+
+// ---- Run loop with and without the profiling, tracing and sampling hooks ----
+
+static void benchProfile() {
+    const int kRuns = 20000;
+    const char* kModes[] = {"plain", "profiled", "traced", "sampled"};
+
+    uint32_t state = 3141592653u;
+    ProgramHandle program = Program::compile(generateArithmetic(state, 200));
+
+    printf("profile: %d runs of a 200-literal expression\n", kRuns);
+    for (int mode = 0; mode < 4; mode++) {
+        OpcodeProfile profile;
+        TraceBuffer trace;
+        SamplingProfiler sampler;
+        VM vm;
+        if (mode == 1) vm.setProfile(&profile);
+        if (mode == 2) vm.setTrace(&trace);
+        if (mode == 3) {
+            vm.setSampling(true);
+            sampler.start();
+        }
+
+        suppressOutput();
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < kRuns; i++) vm.interpret(*program);
+        double elapsed = secondsSince(start);
+        restoreOutput();
+        sampler.stop();
+
+        printf("  %-10s %8.2f ns/instruction\n", kModes[mode],
+               elapsed * 1e9 / kRuns / (2 * 200));
+    }
+}
+
+// ---- Phase timing: cost when enabled, and the breakdown it reports ----
+
+static void benchPhases() {
+    const int kDistinct = 256;
+    const int kQueries = 100000;
+
+    uint32_t state = 2718281828u;
+    std::vector<std::string> sources;
+    for (int i = 0; i < kDistinct; i++) {
+        sources.push_back(generateArithmetic(state, 1 + i % 24));
+    }
+
+    printf("phases: %d uncached queries over %d expressions of 1-24 literals\n", kQueries,
+           kDistinct);
+    for (bool timed : {false, true}) {
+        VM vm;
+        vm.setPhaseTiming(timed);
+
+        suppressOutput();
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < kQueries; i++) vm.interpret(sources[i % kDistinct]);
+        double elapsed = secondsSince(start);
+        restoreOutput();
+
+        printf("  %-8s %8.1f ns/query\n", timed ? "timed" : "untimed", elapsed * 1e9 / kQueries);
+        if (timed) {
+            for (Phase phase : {Phase::SCAN, Phase::COMPILE, Phase::EXECUTE}) {
+                const PhaseHistogram& histogram = vm.phaseTimings().phase(phase);
+                printf("    %-8s %8.1f ns mean  p99 <= %llu ns\n", phaseName(phase),
+                       static_cast<double>(histogram.total()) / histogram.count(),
+                       static_cast<unsigned long long>(histogram.quantile(0.99)));
+            }
+        }
+    }
+}
+
+// ---- Parser nesting depth: explicit stack vs recursion ----
+
+struct DepthRun {
+    const std::string* source;
+    ParseMode mode;
+    bool ok;
+    double seconds;
+};
+
+static void* runDepth(void* arg) {
+    DepthRun* run = static_cast<DepthRun*>(arg);
+    Chunk chunk;
+    Clock::time_point start = Clock::now();
+    run->ok = compile(*run->source, chunk, 0, run->mode);
+    run->seconds = secondsSince(start);
+    return nullptr;
+}
+
+// Compile on a thread with a fixed 256 KiB native stack, so a run that
+// completes demonstrates bounded native stack use.
+static bool timeDepth(const std::string& source, ParseMode mode, double& seconds) {
+    DepthRun run{&source, mode, false, 0};
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    pthread_t thread;
+    bool started = pthread_create(&thread, &attr, runDepth, &run) == 0;
+    if (started) pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+    seconds = run.seconds;
+    return started && run.ok;
+}
+
+static void benchDepth() {
+    printf("depth: -(-(-( ... 1 ... ))) compiled on a 256 KiB native stack\n");
+    printf("  %-10s %14s %14s\n", "depth", "explicit ns/lvl", "recursive ns/lvl");
+
+    for (int depth : {1000, 10000, 100000, 1000000}) {
+        std::string source;
+        for (int i = 0; i < depth; i++) source += "-(";
+        source += "1";
+        source.append(static_cast<size_t>(depth), ')');
+
+        double explicitSeconds = 0;
+        bool explicitOk = timeDepth(source, ParseMode::EXPLICIT_STACK, explicitSeconds);
+
+        // The recursive parser would overflow the small stack beyond this.
+        char recursive[32] = "    (overflow)";
+        if (depth <= 1000) {
+            double recursiveSeconds = 0;
+            if (timeDepth(source, ParseMode::RECURSIVE, recursiveSeconds)) {
+                snprintf(recursive, sizeof(recursive), "%14.1f",
+                         recursiveSeconds * 1e9 / depth);
+            }
+        }
+
+        printf("  %-10d %14.1f %s%s\n", depth, explicitSeconds * 1e9 / depth,
+               recursive, explicitOk ? "" : "  FAILED");
+    }
+}
+
+// ---- Driver ----
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    {"opt", benchOptimizer},
+    {"numbers", benchNumbers},
+    {"cache", benchCache},
+    {"small", benchSmall},
+    {"program", benchProgram},
+    {"static", benchStatic},
+    {"profile", benchProfile},
+    {"phases", benchPhases},
+    {"depth", benchDepth},
+    {"scan", benchScan},
+    {"keywords", benchKeywords},
+    {"tokens", benchTokens},
+    {"parallel", benchParallelScan},
+    {"lines", benchLines},
+    {"linetable", benchLineTable},
+    {"load", benchLoad},
+    {"bytecode", benchBytecode},
+    {"snapshot", benchSnapshot},
+    {"incremental", benchIncremental},
+};
+
+int main(int argc, char* argv[]) {
+    for (const Benchmark& benchmark : benchmarks) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], benchmark.name) == 0) selected = true;
+        }
+        if (!selected) continue;
+
+        benchmark.run();
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include "bytecode_file.hpp"
+#include "chunk_cache.hpp"
+#include "ir.hpp"
+#include "vm.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static_assert(sizeof(BytecodeHeader) == 40, "BytecodeHeader layout changed");
+static_assert(sizeof(StoredConstant) == 16, "StoredConstant layout changed");
+static_assert(sizeof(BytecodeHeader) % alignof(StoredConstant) == 0,
+              "constants must start aligned");
+static_assert(alignof(StoredConstant) % alignof(LineTable::Checkpoint) == 0,
+              "checkpoints must start aligned");
+
+template <typename T>
+static void append(std::string& out, const T* items, size_t count) {
+    out.append(reinterpret_cast<const char*>(items), count * sizeof(T));
+}
+
+std::string encodeBytecode(const CompiledChunk& chunk) {
+    std::vector<StoredConstant> constants;
+    std::string strings;
+    for (size_t i = 0; i < chunk.constantCount(); i++) {
+        Value value = chunk.constant(i);
+        StoredConstant stored = {static_cast<uint32_t>(value.type), 0, 0};
+        switch (value.type) {
+            case ValueType::VAL_BOOL:   stored.payload = AS_BOOL(value); break;
+            case ValueType::VAL_NIL:    break;
+            case ValueType::VAL_NUMBER: {
+                double number = AS_NUMBER(value);
+                memcpy(&stored.payload, &number, sizeof(number));
+                break;
+            }
+            case ValueType::VAL_OBJ: {
+                ObjString* string = AS_STRING(value);
+                stored.length = static_cast<uint32_t>(string->length);
+                stored.payload = strings.size();
+                strings.append(string->chars, string->length);
+                strings.push_back('\0');
+                break;
+            }
+        }
+        constants.push_back(stored);
+    }
+
+    std::string body;
+    append(body, constants.data(), constants.size());
+    append(body, chunk.checkpoints(), chunk.checkpointCount());
+    append(body, chunk.code(), chunk.count());
+    append(body, chunk.lineBytes(), chunk.lineByteCount());
+    body += strings;
+
+    BytecodeHeader header = {};
+    memcpy(header.magic, BYTECODE_MAGIC, sizeof(header.magic));
+    header.version = BYTECODE_VERSION;
+    header.checksum = hashSource(body);
+    header.constantCount = static_cast<uint32_t>(constants.size());
+    header.checkpointCount = static_cast<uint32_t>(chunk.checkpointCount());
+    header.codeSize = static_cast<uint32_t>(chunk.count());
+    header.lineByteCount = static_cast<uint32_t>(chunk.lineByteCount());
+    header.stringByteCount = static_cast<uint32_t>(strings.size());
+
+    std::string image;
+    append(image, &header, 1);
+    return image + body;
+}
+
+bool writeBytecode(const Chunk& chunk, const char* path) {
+    std::string image = encodeBytecode(chunk.freeze());
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) return false;
+    bool written = fwrite(image.data(), 1, image.size(), file) == image.size();
+    return fclose(file) == 0 && written;
+}
+
+bool isBytecode(std::string_view contents) {
+    return contents.size() >= sizeof(BYTECODE_MAGIC) &&
+           memcmp(contents.data(), BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) == 0;
+}
+
+bool BytecodeFile::fail(const char* message) {
+    error_ = message;
+    chunk_ = CompiledChunk();
+    constants_.clear();
+    strings_.clear();
+    return false;
+}
+
+bool BytecodeFile::open(const char* path) {
+    if (!file_.open(path)) return fail("cannot read file");
+    return load(file_.text());
+}
+
+bool BytecodeFile::load(std::string_view contents) {
+    error_ = nullptr;
+
+    BytecodeHeader header;
+    if (!isBytecode(contents)) return fail("not a bytecode file");
+    if (contents.size() < sizeof(header)) return fail("truncated or oversized bytecode file");
+    memcpy(&header, contents.data(), sizeof(header));
+    if (header.version != BYTECODE_VERSION) return fail("unsupported bytecode version");
+
+    // Section offsets, computed in 64 bits so no count can overflow them.
+    uint64_t constantsAt = sizeof(header);
+    uint64_t checkpointsAt = constantsAt + uint64_t{header.constantCount} * sizeof(StoredConstant);
+    uint64_t codeAt = checkpointsAt +
+                      uint64_t{header.checkpointCount} * sizeof(LineTable::Checkpoint);
+    uint64_t linesAt = codeAt + header.codeSize;
+    uint64_t stringsAt = linesAt + header.lineByteCount;
+    uint64_t end = stringsAt + header.stringByteCount;
+    if (end != contents.size()) return fail("truncated or oversized bytecode file");
+
+    std::string_view body = contents.substr(sizeof(header));
+    if (hashSource(body) != header.checksum) return fail("checksum mismatch");
+
+    const char* base = contents.data();
+    const char* strings = base + stringsAt;
+
+    constants_.resize(header.constantCount);
+    strings_.clear();
+    strings_.reserve(header.constantCount);
+    for (uint32_t i = 0; i < header.constantCount; i++) {
+        StoredConstant stored;
+        memcpy(&stored, base + constantsAt + i * sizeof(StoredConstant), sizeof(stored));
+        switch (static_cast<ValueType>(stored.type)) {
+            case ValueType::VAL_BOOL:
+                constants_[i] = BOOL_VAL(stored.payload != 0);
+                break;
+            case ValueType::VAL_NIL:
+                constants_[i] = NIL_VAL();
+                break;
+            case ValueType::VAL_NUMBER: {
+                double number;
+                memcpy(&number, &stored.payload, sizeof(number));
+                constants_[i] = NUMBER_VAL(number);
+                break;
+            }
+            case ValueType::VAL_OBJ: {
+                if (stored.payload >= header.stringByteCount ||
+                    stored.length >= header.stringByteCount - stored.payload ||
+                    strings[stored.payload + stored.length] != '\0') {
+                    return fail("string constant out of bounds");
+                }
+                // The VM never writes to a constant's characters, so they
+                // can stay in the read-only mapping.
+                ObjString string;
+                string.obj.type = ObjType::OBJ_STRING;
+                string.obj.next = nullptr;
+                string.length = static_cast<int>(stored.length);
+                string.chars = const_cast<char*>(strings + stored.payload);
+                strings_.push_back(string);
+                constants_[i] = OBJ_VAL(reinterpret_cast<Obj*>(&strings_.back()));
+                break;
+            }
+            default:
+                return fail("unknown constant type");
+        }
+    }
+
+    const auto* checkpoints = reinterpret_cast<const LineTable::Checkpoint*>(base + checkpointsAt);
+    const auto* lineBytes = reinterpret_cast<const uint8_t*>(base + linesAt);
+    if (!LineTable::validate(lineBytes, header.lineByteCount, checkpoints,
+                             header.checkpointCount, header.codeSize)) {
+        return fail("corrupt line table");
+    }
+
+    chunk_ = CompiledChunk::borrow(constants_.data(), constants_.size(),
+                                   reinterpret_cast<const uint8_t*>(base + codeAt),
+                                   header.codeSize, checkpoints, header.checkpointCount,
+                                   lineBytes, header.lineByteCount);
+    if (!verifyCode()) return fail("invalid bytecode");
+    return true;
+}
+
+// Reject code the VM could not run safely: unknown opcodes, constant
+// operands past the pool, stack underflow or overflow, unchecked number
+// opcodes whose operands are not proven numbers, or falling off the end
+// without an OP_RETURN. Slot types follow the compiler's own inference, so
+// everything compile() emits passes.
+bool BytecodeFile::verifyCode() const {
+    size_t count = chunk_.count();
+    std::vector<StaticType> stack;      // Static type of each slot
+    for (size_t offset = 0; offset < count; offset++) {
+        OpCode op = static_cast<OpCode>(chunk_.code(offset));
+        switch (op) {
+            case OpCode::OP_CONSTANT:
+                if (offset + 1 >= count || chunk_.code(offset + 1) >= chunk_.constantCount()) {
+                    return false;
+                }
+                stack.push_back(staticTypeOf(chunk_.constant(chunk_.code(offset + 1))));
+                offset++;
+                break;
+            case OpCode::OP_NIL:
+                stack.push_back(StaticType::NIL);
+                break;
+            case OpCode::OP_TRUE:
+            case OpCode::OP_FALSE:
+                stack.push_back(StaticType::BOOL);
+                break;
+            case OpCode::OP_NOT:
+                if (stack.empty()) return false;
+                stack.back() = StaticType::BOOL;
+                break;
+            case OpCode::OP_NEGATE:             // A runtime error unless a number
+                if (stack.empty()) return false;
+                stack.back() = StaticType::NUMBER;
+                break;
+            case OpCode::OP_NEGATE_NUMBER:
+                if (stack.empty() || stack.back() != StaticType::NUMBER) return false;
+                break;
+            case OpCode::OP_RETURN:
+                return !stack.empty();
+            case OpCode::OP_EQUAL:
+            case OpCode::OP_GREATER:
+            case OpCode::OP_LESS:
+            case OpCode::OP_ADD:
+            case OpCode::OP_SUBTRACT:
+            case OpCode::OP_MULTIPLY:
+            case OpCode::OP_DIVIDE:
+            case OpCode::OP_GREATER_NUMBER:
+            case OpCode::OP_LESS_NUMBER:
+            case OpCode::OP_ADD_NUMBER:
+            case OpCode::OP_SUBTRACT_NUMBER:
+            case OpCode::OP_MULTIPLY_NUMBER:
+            case OpCode::OP_DIVIDE_NUMBER: {
+                if (stack.size() < 2) return false;
+                StaticType right = stack.back();
+                stack.pop_back();
+                StaticType left = stack.back();
+                bool numbers = left == StaticType::NUMBER && right == StaticType::NUMBER;
+                // The unchecked variants close the OpCode enum.
+                if (op >= OpCode::OP_GREATER_NUMBER && !numbers) return false;
+
+                switch (op) {
+                    case OpCode::OP_EQUAL:
+                    case OpCode::OP_GREATER:
+                    case OpCode::OP_LESS:
+                    case OpCode::OP_GREATER_NUMBER:
+                    case OpCode::OP_LESS_NUMBER:
+                        stack.back() = StaticType::BOOL;
+                        break;
+                    case OpCode::OP_ADD:
+                        stack.back() = numbers ? StaticType::NUMBER
+                                     : left == StaticType::STRING && right == StaticType::STRING
+                                         ? StaticType::STRING
+                                         : StaticType::UNKNOWN;
+                        break;
+                    default:                    // Arithmetic, checked or not
+                        stack.back() = StaticType::NUMBER;
+                        break;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+        if (stack.size() > STACK_MAX) return false;
+    }
+    return false;
+}
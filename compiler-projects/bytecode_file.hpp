@@ -0,0 +1,93 @@
+#ifndef BYTECODE_FILE_HPP
+#define BYTECODE_FILE_HPP
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include "object.hpp"
+#include "source_file.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Precompiled bytecode (.loxc files).
+//
+// Layout, all integers in host (little-endian) byte order:
+//
+//   header     BytecodeHeader
+//   constants  constantCount x StoredConstant
+//   checkpoints  checkpointCount x LineTable::Checkpoint
+//   code       codeSize bytes
+//   lines      lineByteCount bytes of LineTable encoding
+//   strings    stringByteCount bytes, each string NUL-terminated
+//
+// The checksum covers everything after the header. Every section starts
+// at a multiple of its alignment, so a mapped file can be used in place.
+
+constexpr char BYTECODE_MAGIC[4] = {'L', 'O', 'X', 'C'};
+constexpr uint16_t BYTECODE_VERSION = 1;
+
+struct BytecodeHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;             // Reserved, 0
+    uint64_t checksum;          // hashSource() of the rest of the file
+    uint32_t constantCount;
+    uint32_t checkpointCount;
+    uint32_t codeSize;
+    uint32_t lineByteCount;
+    uint32_t stringByteCount;
+    uint32_t reserved;          // 0
+};
+
+struct StoredConstant {
+    uint32_t type;              // ValueType
+    uint32_t length;            // String length, without the NUL
+    uint64_t payload;           // Number bits, boolean, or string offset
+};
+
+// The .loxc image of `chunk`.
+std::string encodeBytecode(const CompiledChunk& chunk);
+
+// Write `chunk` to `path`. The chunk's line table must hold line numbers
+// (LineMode::EAGER). Returns false if the file cannot be written.
+bool writeBytecode(const Chunk& chunk, const char* path);
+
+// True if `contents` starts like a .loxc file.
+bool isBytecode(std::string_view contents);
+
+// A loaded .loxc file, ready to run with VM::interpret(chunk()).
+//
+// open() maps the file (see SourceFile) and the chunk's code, line table
+// and string characters point straight into the mapping; only the
+// constant Values and their string headers are built at load time. The
+// strings are on no object list and live as long as the BytecodeFile.
+class BytecodeFile {
+public:
+    BytecodeFile() = default;
+
+    BytecodeFile(const BytecodeFile&) = delete;
+    BytecodeFile& operator=(const BytecodeFile&) = delete;
+
+    // Map and validate `path`. Returns false, with error() saying why, if
+    // the file cannot be read or is not valid bytecode.
+    bool open(const char* path);
+
+    // Validate contents that stay alive and unchanged as long as this
+    // object, such as a SourceFile already opened by the caller.
+    bool load(std::string_view contents);
+
+    const CompiledChunk& chunk() const { return chunk_; }
+    const char* error() const { return error_; }
+
+private:
+    bool fail(const char* message);
+    bool verifyCode() const;
+
+    SourceFile file_;
+    CompiledChunk chunk_;
+    std::vector<Value> constants_;
+    std::vector<ObjString> strings_;    // Headers over the mapped characters
+    const char* error_ = nullptr;
+};
+
+#endif // BYTECODE_FILE_HPP
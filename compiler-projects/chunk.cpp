@@ -1,8 +1,145 @@
 #include "chunk.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+
+static void writeVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+static uint32_t readVarint(const uint8_t* bytes, size_t& position) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = bytes[position++];
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+}
+
+// readVarint() for untrusted input: false if the varint runs past `size`
+// or does not fit in 32 bits.
+static bool readVarintChecked(const uint8_t* bytes, size_t size, size_t& position,
+                              uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (position >= size) return false;
+        uint8_t byte = bytes[position++];
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Line changes are usually +1, but the optimizer may emit an operand from
+// an earlier line after a later one, so deltas are signed.
+static uint32_t zigzag(int value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int unzigzag(uint32_t value) {
+    return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+}
+
+void LineTable::add(int line) {
+    if (count_ == 0 || line != lastLine_) {
+        writeVarint(bytes_, static_cast<uint32_t>(count_ - runStart_));
+        writeVarint(bytes_, zigzag(static_cast<int>(static_cast<uint32_t>(line) -
+                                                    static_cast<uint32_t>(lastLine_))));
+        if (runs_ % LINE_TABLE_STRIDE == 0) {
+            checkpoints_.push_back({static_cast<uint32_t>(count_), line,
+                                    static_cast<uint32_t>(bytes_.size())});
+        }
+        runStart_ = count_;
+        lastLine_ = line;
+        runs_++;
+    }
+    count_++;
+}
+
+void LineTable::clear() {
+    bytes_.clear();
+    checkpoints_.clear();
+    count_ = 0;
+    runs_ = 0;
+    runStart_ = 0;
+    lastLine_ = 0;
+}
+
+int LineTable::line(size_t offset) const {
+    return lookup(bytes_.data(), bytes_.size(), checkpoints_.data(), checkpoints_.size(),
+                  offset);
+}
+
+int LineTable::lookup(const uint8_t* bytes, size_t size,
+                      const Checkpoint* checkpoints, size_t checkpointCount,
+                      size_t offset) {
+    if (checkpointCount == 0) return 0;
+
+    // The first checkpoint starts at offset 0, so there is always one at
+    // or before `offset`.
+    const Checkpoint* checkpoint = std::upper_bound(
+        checkpoints, checkpoints + checkpointCount, offset,
+        [](size_t target, const Checkpoint& c) { return target < c.offset; }) - 1;
+
+    size_t start = checkpoint->offset;
+    int line = checkpoint->line;
+    size_t position = checkpoint->position;
+    while (position < size) {
+        size_t next = position;
+        start += readVarint(bytes, next);
+        if (start > offset) break;
+        line = static_cast<int>(static_cast<uint32_t>(line) +
+                                static_cast<uint32_t>(unzigzag(readVarint(bytes, next))));
+        position = next;
+    }
+    return line;
+}
+
+bool LineTable::validate(const uint8_t* bytes, size_t size,
+                         const Checkpoint* checkpoints, size_t checkpointCount,
+                         size_t codeSize) {
+    // lookup() relies on a checkpoint at the first run.
+    if (codeSize > 0 && (checkpointCount == 0 || checkpoints[0].offset != 0)) return false;
+
+    uint64_t start = 0;
+    int line = 0;
+    size_t runs = 0;
+    size_t checkpoint = 0;
+    size_t position = 0;
+    while (position < size) {
+        uint32_t distance, delta;
+        if (!readVarintChecked(bytes, size, position, distance) ||
+            !readVarintChecked(bytes, size, position, delta)) {
+            return false;
+        }
+        // Only the first run starts at 0; every later one is non-empty.
+        if ((runs == 0) != (distance == 0)) return false;
+        start += distance;
+        if (start >= codeSize) return false;
+        line = static_cast<int>(static_cast<uint32_t>(line) +
+                                static_cast<uint32_t>(unzigzag(delta)));
+        runs++;
+
+        while (checkpoint < checkpointCount && checkpoints[checkpoint].position == position) {
+            if (checkpoints[checkpoint].offset != start || checkpoints[checkpoint].line != line) {
+                return false;
+            }
+            checkpoint++;
+        }
+    }
+    // Unmatched checkpoints are out of order or off an entry boundary.
+    return checkpoint == checkpointCount && (runs > 0) == (codeSize > 0);
+}
 
 void Chunk::write(uint8_t byte, int line) {
     code_.push_back(byte);
-    lines_.push_back(line);
+    lines_.add(line);
 }
 
 int Chunk::addConstant(Value value) {
@@ -10,6 +147,107 @@ int Chunk::addConstant(Value value) {
     return static_cast<int>(constants_.size() - 1);
 }
 
+void Chunk::clear() {
+    code_.clear();
+    lines_.clear();
+    constants_.clear();
+}
+
+static size_t alignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+CompiledChunk Chunk::freeze() const {
+    CompiledChunk compiled;
+    freeze(compiled);
+    return compiled;
+}
+
+void Chunk::freeze(CompiledChunk& into) const {
+    const std::vector<LineTable::Checkpoint>& checkpoints = lines_.checkpoints();
+    const std::vector<uint8_t>& lineBytes = lines_.encoded();
+
+    size_t constantsAt = 0;
+    size_t codeAt = constantsAt + constants_.size() * sizeof(Value);
+    size_t checkpointsAt = alignUp(codeAt + code_.size(), alignof(LineTable::Checkpoint));
+    size_t lineBytesAt = checkpointsAt + checkpoints.size() * sizeof(LineTable::Checkpoint);
+    size_t size = alignUp(lineBytesAt + lineBytes.size(), CompiledChunk::ALIGNMENT);
+
+    if (size > into.capacity_) {
+        into.release();
+        into.block_ = static_cast<uint8_t*>(
+            ::operator new(size, std::align_val_t(CompiledChunk::ALIGNMENT)));
+        into.capacity_ = size;
+    }
+
+    uint8_t* block = into.block_;
+    std::uninitialized_copy(constants_.begin(), constants_.end(),
+                            reinterpret_cast<Value*>(block + constantsAt));
+    if (!code_.empty()) memcpy(block + codeAt, code_.data(), code_.size());
+    std::uninitialized_copy(checkpoints.begin(), checkpoints.end(),
+                            reinterpret_cast<LineTable::Checkpoint*>(block + checkpointsAt));
+    if (!lineBytes.empty()) memcpy(block + lineBytesAt, lineBytes.data(), lineBytes.size());
+
+    into.constants_ = reinterpret_cast<const Value*>(block + constantsAt);
+    into.code_ = block + codeAt;
+    into.checkpoints_ = reinterpret_cast<const LineTable::Checkpoint*>(block + checkpointsAt);
+    into.lineBytes_ = block + lineBytesAt;
+    into.count_ = code_.size();
+    into.constantCount_ = constants_.size();
+    into.checkpointCount_ = checkpoints.size();
+    into.lineByteCount_ = lineBytes.size();
+}
+
+CompiledChunk CompiledChunk::borrow(const Value* constants, size_t constantCount,
+                                    const uint8_t* code, size_t count,
+                                    const LineTable::Checkpoint* checkpoints,
+                                    size_t checkpointCount,
+                                    const uint8_t* lineBytes, size_t lineByteCount) {
+    CompiledChunk chunk;
+    chunk.constants_ = constants;
+    chunk.code_ = code;
+    chunk.checkpoints_ = checkpoints;
+    chunk.lineBytes_ = lineBytes;
+    chunk.count_ = count;
+    chunk.constantCount_ = constantCount;
+    chunk.checkpointCount_ = checkpointCount;
+    chunk.lineByteCount_ = lineByteCount;
+    return chunk;
+}
+
+CompiledChunk::~CompiledChunk() {
+    release();
+}
+
+CompiledChunk::CompiledChunk(CompiledChunk&& other) noexcept {
+    *this = std::move(other);
+}
+
+CompiledChunk& CompiledChunk::operator=(CompiledChunk&& other) noexcept {
+    if (this != &other) {
+        release();
+        block_ = std::exchange(other.block_, nullptr);
+        capacity_ = std::exchange(other.capacity_, 0);
+        constants_ = std::exchange(other.constants_, nullptr);
+        code_ = std::exchange(other.code_, nullptr);
+        checkpoints_ = std::exchange(other.checkpoints_, nullptr);
+        lineBytes_ = std::exchange(other.lineBytes_, nullptr);
+        count_ = std::exchange(other.count_, 0);
+        constantCount_ = std::exchange(other.constantCount_, 0);
+        checkpointCount_ = std::exchange(other.checkpointCount_, 0);
+        lineByteCount_ = std::exchange(other.lineByteCount_, 0);
+    }
+    return *this;
+}
+
+void CompiledChunk::release() {
+    if (block_ != nullptr) {
+        ::operator delete(block_, std::align_val_t(ALIGNMENT));
+    }
+    block_ = nullptr;
+    capacity_ = 0;
+}
+
 const char* opCodeName(OpCode code) {
     switch (code) {
         case OpCode::OP_CONSTANT: return "OP_CONSTANT";
@@ -26,6 +264,26 @@ const char* opCodeName(OpCode code) {
         case OpCode::OP_NOT:      return "OP_NOT";
         case OpCode::OP_NEGATE:   return "OP_NEGATE";
         case OpCode::OP_RETURN:   return "OP_RETURN";
+        case OpCode::OP_GREATER_NUMBER:  return "OP_GREATER_NUMBER";
+        case OpCode::OP_LESS_NUMBER:     return "OP_LESS_NUMBER";
+        case OpCode::OP_ADD_NUMBER:      return "OP_ADD_NUMBER";
+        case OpCode::OP_SUBTRACT_NUMBER: return "OP_SUBTRACT_NUMBER";
+        case OpCode::OP_MULTIPLY_NUMBER: return "OP_MULTIPLY_NUMBER";
+        case OpCode::OP_DIVIDE_NUMBER:   return "OP_DIVIDE_NUMBER";
+        case OpCode::OP_NEGATE_NUMBER:   return "OP_NEGATE_NUMBER";
     }
     return "UNKNOWN";
 }
+
+OpCode uncheckedNumberOp(OpCode code) {
+    switch (code) {
+        case OpCode::OP_GREATER:  return OpCode::OP_GREATER_NUMBER;
+        case OpCode::OP_LESS:     return OpCode::OP_LESS_NUMBER;
+        case OpCode::OP_ADD:      return OpCode::OP_ADD_NUMBER;
+        case OpCode::OP_SUBTRACT: return OpCode::OP_SUBTRACT_NUMBER;
+        case OpCode::OP_MULTIPLY: return OpCode::OP_MULTIPLY_NUMBER;
+        case OpCode::OP_DIVIDE:   return OpCode::OP_DIVIDE_NUMBER;
+        case OpCode::OP_NEGATE:   return OpCode::OP_NEGATE_NUMBER;
+        default:                  return code;
+    }
+}
@@ -21,9 +21,100 @@ enum class OpCode : uint8_t {
     OP_NOT,
     OP_NEGATE,
     OP_RETURN,
+
+    // Unchecked variants, emitted only when the compiler has proven every
+    // operand is a number (see Compiler::binary()).
+    OP_GREATER_NUMBER,
+    OP_LESS_NUMBER,
+    OP_ADD_NUMBER,
+    OP_SUBTRACT_NUMBER,
+    OP_MULTIPLY_NUMBER,
+    OP_DIVIDE_NUMBER,
+    OP_NEGATE_NUMBER,
+};
+
+// Number of opcodes, for tables indexed by opcode.
+constexpr int OPCODE_COUNT = static_cast<int>(OpCode::OP_NEGATE_NUMBER) + 1;
+
+// Line numbers for the bytes of a chunk, run-length encoded.
+// Each run of bytes sharing a line is one entry of two varints: the
+// distance from the previous run's start and the zigzag-encoded line
+// change. Every LINE_TABLE_STRIDE runs a checkpoint records the decoded
+// state, so line(offset) is a binary search plus a short forward decode.
+class LineTable {
+public:
+    static constexpr size_t LINE_TABLE_STRIDE = 16;
+
+    struct Checkpoint {
+        uint32_t offset;    // Start of the run
+        int line;           // Line of the run
+        uint32_t position;  // Index in the encoding just past the run's entry
+    };
+
+    // Record the line of the next byte.
+    void add(int line);
+
+    // Forget every line, keeping the allocations.
+    void clear();
+
+    // Line of the byte at `offset` (the last line past the end).
+    int line(size_t offset) const;
+
+    size_t count() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    size_t runs() const { return runs_; }
+
+    // Heap bytes used by the encoded table.
+    size_t byteSize() const {
+        return bytes_.capacity() + checkpoints_.capacity() * sizeof(Checkpoint);
+    }
+
+    bool operator==(const LineTable& other) const {
+        return count_ == other.count_ && bytes_ == other.bytes_;
+    }
+    bool operator!=(const LineTable& other) const { return !(*this == other); }
+
+    // The raw encoding, for CompiledChunk.
+    const std::vector<uint8_t>& encoded() const { return bytes_; }
+    const std::vector<Checkpoint>& checkpoints() const { return checkpoints_; }
+
+    // line() over a raw encoding.
+    static int lookup(const uint8_t* bytes, size_t size,
+                      const Checkpoint* checkpoints, size_t checkpointCount,
+                      size_t offset);
+
+    // True if a raw encoding (from an untrusted file, say) decodes to whole
+    // entries whose runs cover exactly `codeSize` bytes, and every
+    // checkpoint, in order, marks one of those runs. lookup() is only safe
+    // on encodings that pass.
+    static bool validate(const uint8_t* bytes, size_t size,
+                         const Checkpoint* checkpoints, size_t checkpointCount,
+                         size_t codeSize);
+
+private:
+    std::vector<uint8_t> bytes_;
+    std::vector<Checkpoint> checkpoints_;
+    size_t count_ = 0;
+    size_t runs_ = 0;
+    size_t runStart_ = 0;
+    int lastLine_ = 0;
+};
+
+class CompiledChunk;
+
+// Bytes a chunk spends on each part (allocated capacity for a Chunk, the
+// used size for a CompiledChunk, whose block holds exactly these).
+struct ChunkMemory {
+    size_t code = 0;
+    size_t lines = 0;
+    size_t constants = 0;
+
+    size_t total() const { return code + lines + constants; }
 };
 
-// A chunk of bytecode - represents a sequence of instructions
+// A chunk of bytecode - represents a sequence of instructions.
+// This is the mutable builder the compiler writes to; the VM runs the
+// frozen form (see freeze()).
 class Chunk {
 public:
     Chunk() = default;
@@ -36,23 +127,106 @@ public:
 
     // Accessors
     const std::vector<uint8_t>& code() const { return code_; }
-    const std::vector<int>& lines() const { return lines_; }
+    const LineTable& lines() const { return lines_; }
     const ValueArray& constants() const { return constants_; }
 
     // Access individual elements
     uint8_t code(size_t index) const { return code_[index]; }
-    int line(size_t index) const { return lines_[index]; }
+    int line(size_t index) const { return lines_.line(index); }
     Value constant(size_t index) const { return constants_[index]; }
 
     size_t count() const { return code_.size(); }
 
+    ChunkMemory memory() const {
+        return {code_.capacity(), lines_.byteSize(), constants_.capacity() * sizeof(Value)};
+    }
+
+    // Empty the chunk, keeping its allocations for the next compile.
+    void clear();
+
+    // Copy the chunk into its execution form. The second overload reuses
+    // `into`'s block when it is large enough.
+    CompiledChunk freeze() const;
+    void freeze(CompiledChunk& into) const;
+
 private:
     std::vector<uint8_t> code_;     // The bytecode
-    std::vector<int> lines_;        // Line numbers for each byte
+    LineTable lines_;               // Line numbers, run-length encoded
     ValueArray constants_;          // Constant pool
 };
 
+// Immutable, execution-ready copy of a Chunk.
+// Constants, code and the line table live in one block aligned to a cache
+// line, in that order, so a chunk costs a single allocation and a small
+// expression's constants and code share the first cache lines. String
+// constants point at objects owned by whoever compiled the chunk.
+class CompiledChunk {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    CompiledChunk() = default;
+    ~CompiledChunk();
+
+    CompiledChunk(CompiledChunk&& other) noexcept;
+    CompiledChunk& operator=(CompiledChunk&& other) noexcept;
+    CompiledChunk(const CompiledChunk&) = delete;
+    CompiledChunk& operator=(const CompiledChunk&) = delete;
+
+    // A chunk over memory owned by someone else (such as a mapped .loxc
+    // file), which must outlive it.
+    static CompiledChunk borrow(const Value* constants, size_t constantCount,
+                                const uint8_t* code, size_t count,
+                                const LineTable::Checkpoint* checkpoints,
+                                size_t checkpointCount,
+                                const uint8_t* lineBytes, size_t lineByteCount);
+
+    const uint8_t* code() const { return code_; }
+    uint8_t code(size_t index) const { return code_[index]; }
+    Value constant(size_t index) const { return constants_[index]; }
+    int line(size_t offset) const {
+        return LineTable::lookup(lineBytes_, lineByteCount_, checkpoints_,
+                                 checkpointCount_, offset);
+    }
+
+    size_t count() const { return count_; }
+    size_t constantCount() const { return constantCount_; }
+
+    // The encoded line table (see LineTable), for serialization.
+    const LineTable::Checkpoint* checkpoints() const { return checkpoints_; }
+    size_t checkpointCount() const { return checkpointCount_; }
+    const uint8_t* lineBytes() const { return lineBytes_; }
+    size_t lineByteCount() const { return lineByteCount_; }
+
+    // Size of the block (0 until the first freeze, and for borrowed chunks).
+    size_t byteSize() const { return capacity_; }
+
+    ChunkMemory memory() const {
+        return {count_,
+                checkpointCount_ * sizeof(LineTable::Checkpoint) + lineByteCount_,
+                constantCount_ * sizeof(Value)};
+    }
+
+private:
+    friend class Chunk;
+
+    void release();
+
+    uint8_t* block_ = nullptr;
+    size_t capacity_ = 0;
+    const Value* constants_ = nullptr;
+    const uint8_t* code_ = nullptr;
+    const LineTable::Checkpoint* checkpoints_ = nullptr;
+    const uint8_t* lineBytes_ = nullptr;
+    size_t count_ = 0;
+    size_t constantCount_ = 0;
+    size_t checkpointCount_ = 0;
+    size_t lineByteCount_ = 0;
+};
+
 // Helper to convert OpCode to string
 const char* opCodeName(OpCode code);
 
+// The unchecked variant of a numeric opcode, or `code` itself if it has none.
+OpCode uncheckedNumberOp(OpCode code);
+
 #endif // CHUNK_HPP
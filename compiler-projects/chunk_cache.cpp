@@ -0,0 +1,105 @@
+#include "chunk_cache.hpp"
+#include "object.hpp"
+#include <cstring>
+
+uint64_t hashSource(std::string_view source) {
+    const uint64_t kMultiplier = 0xbf58476d1ce4e5b9ull;
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ source.size();
+
+    const char* p = source.data();
+    size_t remaining = source.size();
+    while (remaining >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        hash = (hash ^ word) * kMultiplier;
+        hash ^= hash >> 31;
+        p += 8;
+        remaining -= 8;
+    }
+    if (remaining > 0) {
+        uint64_t word = 0;
+        memcpy(&word, p, remaining);
+        hash = (hash ^ word) * kMultiplier;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+ChunkCache::ChunkCache(size_t capacity) : capacity_(capacity) {
+}
+
+ChunkCache::~ChunkCache() {
+    clear();
+}
+
+const CompiledChunk* ChunkCache::get(std::string_view source, int optLevel,
+                             ParseMode parseMode, LineMode lineMode,
+                             PhaseTimings* timings) {
+    uint64_t hash = hashSource(source) ^ static_cast<uint64_t>(optLevel) ^
+                    (static_cast<uint64_t>(lineMode) << 8);
+
+    auto found = index_.find(hash);
+    if (found != index_.end()) {
+        Entry& entry = *found->second;
+        if (entry.optLevel == optLevel && entry.lineMode == lineMode &&
+            entry.source == source) {
+            stats_.hits++;
+            entries_.splice(entries_.begin(), entries_, found->second);
+            return &entry.chunk;
+        }
+    }
+    stats_.misses++;
+
+    if (capacity_ == 0) return nullptr;
+
+    Entry entry;
+    entry.hash = hash;
+    entry.optLevel = optLevel;
+    entry.lineMode = lineMode;
+    entry.source = std::string(source);
+
+    Chunk chunk;
+    bool compiled;
+    {
+        ScopedObjectList objects(&entry.objects, &heap_);
+        compiled = compile(source, chunk, optLevel, parseMode, lineMode, timings);
+    }
+
+    if (!compiled) {
+        freeObjects(entry.objects, &heap_);
+        return nullptr;
+    }
+    entry.chunk = chunk.freeze();
+
+    // A colliding entry under the same hash is replaced.
+    if (found != index_.end()) {
+        freeObjects(found->second->objects, &heap_);
+        entries_.erase(found->second);
+        index_.erase(found);
+        stats_.evictions++;
+    }
+    if (entries_.size() >= capacity_) evictLast();
+
+    entries_.push_front(std::move(entry));
+    index_[hash] = entries_.begin();
+    return &entries_.front().chunk;
+}
+
+void ChunkCache::evictLast() {
+    Entry& victim = entries_.back();
+    freeObjects(victim.objects, &heap_);
+    index_.erase(victim.hash);
+    entries_.pop_back();
+    stats_.evictions++;
+}
+
+void ChunkCache::setCapacity(size_t capacity) {
+    capacity_ = capacity;
+    while (entries_.size() > capacity_) evictLast();
+}
+
+void ChunkCache::clear() {
+    for (Entry& entry : entries_) freeObjects(entry.objects, &heap_);
+    entries_.clear();
+    index_.clear();
+}
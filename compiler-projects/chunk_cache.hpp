@@ -0,0 +1,87 @@
+#ifndef CHUNK_CACHE_HPP
+#define CHUNK_CACHE_HPP
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include "object.hpp"
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct ChunkCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// LRU cache of compiled chunks keyed by a hash of (source, optLevel,
+// lineMode).
+//
+// Each entry owns the heap objects created while compiling it (its string
+// constants), so they stay alive exactly as long as the entry is resident
+// and are freed when it is evicted. A capacity of 0 disables caching.
+class ChunkCache {
+public:
+    explicit ChunkCache(size_t capacity = 0);
+    ~ChunkCache();
+
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    // Return the cached (frozen) chunk for `source`, compiling and inserting it on
+    // a miss. Returns nullptr if the source does not compile (failures are
+    // not cached) or if the capacity is 0. A miss compiles into the entry's
+    // own object list; the thread's list is restored before returning.
+    // Misses are compiled with `timings` (see Compiler::setTimings()).
+    const CompiledChunk* get(std::string_view source, int optLevel,
+                     ParseMode parseMode = ParseMode::RECURSIVE,
+                     LineMode lineMode = LineMode::EAGER,
+                     PhaseTimings* timings = nullptr);
+
+    // Change the capacity, evicting least recently used entries if needed.
+    void setCapacity(size_t capacity);
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return entries_.size(); }
+
+    const ChunkCacheStats& stats() const { return stats_; }
+
+    // The string constants owned by resident entries.
+    const HeapStats& heapStats() const { return heap_; }
+
+    // Drop every entry (counters are kept).
+    void clear();
+
+    // Call fn(source, optLevel, lineMode, chunk) for every entry, most
+    // recently used first.
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const Entry& entry : entries_) {
+            fn(std::string_view(entry.source), entry.optLevel, entry.lineMode, entry.chunk);
+        }
+    }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        int optLevel;
+        LineMode lineMode;      // Decides what the chunk's line table holds
+        std::string source;     // Full key, to rule out hash collisions
+        CompiledChunk chunk;
+        Obj* objects = nullptr; // Objects allocated while compiling
+    };
+
+    void evictLast();
+
+    size_t capacity_;
+    std::list<Entry> entries_;  // Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+    ChunkCacheStats stats_;
+    HeapStats heap_;
+};
+
+// Fast, non-cryptographic hash of a source string (8 bytes per step).
+uint64_t hashSource(std::string_view source);
+
+#endif // CHUNK_CACHE_HPP
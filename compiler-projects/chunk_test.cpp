@@ -3,6 +3,8 @@
 #include <cassert>
 #include <cstdio>
 #include <string>
+#include <utility>
+#include <vector>
 
 // Simple test framework
 static int tests_run = 0;
@@ -84,11 +86,93 @@ TEST(test_line_tracking) {
     assert(chunk.line(3) == 3);
 }
 
+TEST(test_line_table) {
+    // Enough runs to cross several checkpoints, with lines going back
+    // (as optimized code can) and offsets large enough for multi-byte
+    // varints (as LAZY mode records).
+    std::vector<int> expected;
+    for (int run = 0; run < 200; run++) {
+        int line = run % 7 == 3 ? run - 20 : run * 1000;
+        for (int i = 0; i < 1 + run % 5; i++) expected.push_back(line);
+    }
+
+    Chunk chunk;
+    for (int line : expected) chunk.write(static_cast<uint8_t>(OpCode::OP_NIL), line);
+
+    assert(chunk.lines().count() == expected.size());
+    assert(chunk.lines().runs() == 200);
+    for (size_t i = 0; i < expected.size(); i++) {
+        assert(chunk.line(i) == expected[i]);
+    }
+    assert(chunk.lines().byteSize() < expected.size() * sizeof(int));
+
+    Chunk same, other;
+    for (int line : expected) {
+        same.write(static_cast<uint8_t>(OpCode::OP_NIL), line);
+        other.write(static_cast<uint8_t>(OpCode::OP_NIL), line + 1);
+    }
+    assert(chunk.lines() == same.lines());
+    assert(chunk.lines() != other.lines());
+}
+
+TEST(test_freeze) {
+    Chunk chunk;
+    for (int i = 0; i < 40; i++) {
+        int constant = chunk.addConstant(NUMBER_VAL(i * 0.5));
+        chunk.write(static_cast<uint8_t>(OpCode::OP_CONSTANT), 1 + i / 3);
+        chunk.write(static_cast<uint8_t>(constant), 1 + i / 3);
+    }
+    chunk.write(static_cast<uint8_t>(OpCode::OP_RETURN), 99);
+
+    CompiledChunk frozen = chunk.freeze();
+    // Constants open the block, so it starts code() minus their size.
+    uintptr_t block = reinterpret_cast<uintptr_t>(frozen.code()) -
+                      chunk.constants().size() * sizeof(Value);
+    assert(block % CompiledChunk::ALIGNMENT == 0);
+    assert(frozen.count() == chunk.count());
+    assert(frozen.constantCount() == chunk.constants().size());
+    assert(frozen.byteSize() % CompiledChunk::ALIGNMENT == 0);
+    for (size_t i = 0; i < chunk.count(); i++) {
+        assert(frozen.code(i) == chunk.code(i));
+        assert(frozen.line(i) == chunk.line(i));
+    }
+    for (size_t i = 0; i < chunk.constants().size(); i++) {
+        assert(AS_NUMBER(frozen.constant(i)) == AS_NUMBER(chunk.constant(i)));
+    }
+
+    // Freezing something smaller into it reuses the block.
+    Chunk small;
+    small.write(static_cast<uint8_t>(OpCode::OP_NIL), 7);
+    small.write(static_cast<uint8_t>(OpCode::OP_RETURN), 7);
+    size_t capacity = frozen.byteSize();
+    small.freeze(frozen);
+    assert(frozen.byteSize() == capacity);
+    assert(reinterpret_cast<uintptr_t>(frozen.code()) == block);
+    assert(frozen.count() == 2);
+    assert(frozen.code(1) == static_cast<uint8_t>(OpCode::OP_RETURN));
+    assert(frozen.line(1) == 7);
+
+    // Moving transfers the block.
+    CompiledChunk moved = std::move(frozen);
+    assert(moved.count() == 2);
+    assert(frozen.byteSize() == 0);
+}
+
 TEST(test_opcode_names) {
     assert(std::string(opCodeName(OpCode::OP_CONSTANT)) == "OP_CONSTANT");
     assert(std::string(opCodeName(OpCode::OP_RETURN)) == "OP_RETURN");
 }
 
+TEST(test_unchecked_number_op) {
+    assert(uncheckedNumberOp(OpCode::OP_ADD) == OpCode::OP_ADD_NUMBER);
+    assert(uncheckedNumberOp(OpCode::OP_LESS) == OpCode::OP_LESS_NUMBER);
+    assert(uncheckedNumberOp(OpCode::OP_NEGATE) == OpCode::OP_NEGATE_NUMBER);
+    // Opcodes without a type check map to themselves.
+    assert(uncheckedNumberOp(OpCode::OP_EQUAL) == OpCode::OP_EQUAL);
+    assert(uncheckedNumberOp(OpCode::OP_NOT) == OpCode::OP_NOT);
+    assert(std::string(opCodeName(OpCode::OP_ADD_NUMBER)) == "OP_ADD_NUMBER");
+}
+
 TEST(test_disassemble) {
     Chunk chunk;
     int constantIdx = chunk.addConstant(NUMBER_VAL(1.2));
@@ -112,7 +196,10 @@ int main() {
     RUN_TEST(test_multiple_constants);
     RUN_TEST(test_write_constant_instruction);
     RUN_TEST(test_line_tracking);
+    RUN_TEST(test_line_table);
+    RUN_TEST(test_freeze);
     RUN_TEST(test_opcode_names);
+    RUN_TEST(test_unchecked_number_op);
     RUN_TEST(test_disassemble);
 
     printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
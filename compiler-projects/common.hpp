@@ -5,7 +5,10 @@
 #include <cstdint>
 
 // Debug flags (uncomment to enable)
+// Builds that define CLOX_NO_DEBUG (e.g. the benchmarks) compile them out.
+#ifndef CLOX_NO_DEBUG
 #define DEBUG_PRINT_CODE
 #define DEBUG_TRACE_EXECUTION
+#endif
 
 #endif // COMMON_HPP
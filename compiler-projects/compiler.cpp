@@ -1,58 +1,70 @@
 #include "compiler.hpp"
-#include "scanner.hpp"
 #include "object.hpp"
 #include "debug.hpp"
+#include <algorithm>
 #include <cstdio>
-#include <cstdlib>
 
-// ---- Types ----
-
-struct Parser {
-    Token current;
-    Token previous;
-    bool hadError;
-    bool panicMode;
-};
-
-enum class Precedence {
-    PREC_NONE,
-    PREC_ASSIGNMENT,  // =
-    PREC_OR,          // or
-    PREC_AND,         // and
-    PREC_EQUALITY,    // == !=
-    PREC_COMPARISON,  // < > <= >=
-    PREC_TERM,        // + -
-    PREC_FACTOR,      // * /
-    PREC_UNARY,       // ! -
-    PREC_CALL,        // . ()
-    PREC_PRIMARY,
-};
-
-using ParseFn = void (*)();
+Compiler::Compiler(std::string_view source, Chunk& chunk, int optLevel,
+                   ParseMode parseMode, LineMode lineMode)
+    : source_(source)
+    , lineMode_(lineMode)
+    , lines_(source)
+    , errorEnd_(0)
+    , scanner_(source, ScanMode::BOUNDED, lineMode)
+    , tokens_(nullptr)
+    , nextToken_(0)
+    , chunk_(chunk)
+    , parser_()
+    , optLevel_(optLevel)
+    , parseMode_(parseMode)
+    , graph_()
+    , timings_(nullptr)
+    , scanTime_(0)
+    , scanCalls_(0)
+    , optimizeTime_(0)
+{
+}
 
-struct ParseRule {
-    ParseFn prefix;
-    ParseFn infix;
-    Precedence precedence;
-};
+Compiler::Compiler(const TokenBuffer& tokens, Chunk& chunk, int optLevel,
+                   ParseMode parseMode)
+    : source_(tokens.source())
+    , lineMode_(LineMode::EAGER)
+    , lines_(tokens.source())
+    , errorEnd_(0)
+    , scanner_(tokens.source())
+    , tokens_(&tokens)
+    , nextToken_(0)
+    , chunk_(chunk)
+    , parser_()
+    , optLevel_(optLevel)
+    , parseMode_(parseMode)
+    , graph_()
+    , timings_(nullptr)
+    , scanTime_(0)
+    , scanCalls_(0)
+    , optimizeTime_(0)
+{
+}
 
-// ---- State ----
+// ---- Error handling ----
 
-static Parser parser;
-static Scanner* currentScanner = nullptr;
-static Chunk* compilingChunk = nullptr;
+int Compiler::location(const Token& token) const {
+    if (lineMode_ == LineMode::EAGER) return token.line;
 
-static Chunk* currentChunk() {
-    return compilingChunk;
+    // The scanner stamps a token with the line it ends on, so record the
+    // end offset; LineIndex then gives back exactly the eager line.
+    if (token.type == TokenType::ERROR) return static_cast<int>(errorEnd_);
+    if (token.lexeme.data() == nullptr) return 0;
+    return static_cast<int>(token.lexeme.data() + token.lexeme.size() - source_.data());
 }
 
-// ---- Error handling ----
-
-static void errorAt(const Token& token, const char* message) {
-    if (parser.panicMode) return;
-    parser.panicMode = true;
+void Compiler::errorAt(const Token& token, const char* message) {
+    if (parser_.panicMode) return;
+    parser_.panicMode = true;
 
-    fprintf(stderr, "[line %d] Error", token.line);
+    int line = token.line;
+    if (lineMode_ == LineMode::LAZY) line = lines_.line(static_cast<size_t>(location(token)));
+    fprintf(stderr, "[line %d] Error", line);
 
     if (token.type == TokenType::END_OF_FILE) {
         fprintf(stderr, " at end");
@@ -63,32 +75,49 @@ static void errorAt(const Token& token, const char* message) {
     }
 
     fprintf(stderr, ": %s\n", message);
-    parser.hadError = true;
+    parser_.hadError = true;
 }
 
-static void error(const char* message) {
-    errorAt(parser.previous, message);
+void Compiler::error(const char* message) {
+    errorAt(parser_.previous, message);
 }
 
-static void errorAtCurrent(const char* message) {
-    errorAt(parser.current, message);
+void Compiler::errorAtCurrent(const char* message) {
+    errorAt(parser_.current, message);
 }
 
 // ---- Front end ----
 
-static void advance() {
-    parser.previous = parser.current;
+Token Compiler::nextToken() {
+    if (!tokens_) {
+        if (timings_ == nullptr) return scanner_.scanToken();
+        uint64_t start = phaseClock();
+        Token token = scanner_.scanToken();
+        scanTime_ += phaseClock() - start;
+        scanCalls_++;
+        return token;
+    }
+
+    // Keep returning the final END_OF_FILE, as the scanner does.
+    Token token = tokens_->token(nextToken_);
+    if (nextToken_ + 1 < tokens_->size()) nextToken_++;
+    return token;
+}
+
+void Compiler::advance() {
+    parser_.previous = parser_.current;
 
     for (;;) {
-        parser.current = currentScanner->scanToken();
-        if (parser.current.type != TokenType::ERROR) break;
+        parser_.current = nextToken();
+        if (parser_.current.type != TokenType::ERROR) break;
 
-        errorAtCurrent(parser.current.lexeme.data());
+        if (!tokens_) errorEnd_ = scanner_.position();
+        errorAtCurrent(parser_.current.lexeme.data());
     }
 }
 
-static void consume(TokenType type, const char* message) {
-    if (parser.current.type == type) {
+void Compiler::consume(TokenType type, const char* message) {
+    if (parser_.current.type == type) {
         advance();
         return;
     }
@@ -98,20 +127,27 @@ static void consume(TokenType type, const char* message) {
 
 // ---- Emitting bytecode ----
 
-static void emitByte(uint8_t byte) {
-    currentChunk()->write(byte, parser.previous.line);
+void Compiler::emitByte(uint8_t byte) {
+    // When optimizing, only opcodes reach here (constant operands go
+    // through emitConstant), so they can be replayed into the graph.
+    if (optLevel_ > 0) {
+        graph_.apply(static_cast<OpCode>(byte), location(parser_.previous));
+        return;
+    }
+    currentChunk()->write(byte, location(parser_.previous));
 }
 
-static void emitBytes(uint8_t byte1, uint8_t byte2) {
+void Compiler::emitBytes(uint8_t byte1, uint8_t byte2) {
     emitByte(byte1);
     emitByte(byte2);
 }
 
-static void emitReturn() {
-    emitByte(static_cast<uint8_t>(OpCode::OP_RETURN));
+void Compiler::emitReturn() {
+    currentChunk()->write(static_cast<uint8_t>(OpCode::OP_RETURN),
+                          location(parser_.previous));
 }
 
-static uint8_t makeConstant(Value value) {
+uint8_t Compiler::makeConstant(Value value) {
     int constant = currentChunk()->addConstant(value);
     if (constant > UINT8_MAX) {
         error("Too many constants in one chunk.");
@@ -120,14 +156,54 @@ static uint8_t makeConstant(Value value) {
     return static_cast<uint8_t>(constant);
 }
 
-static void emitConstant(Value value) {
+void Compiler::emitConstant(Value value) {
+    if (optLevel_ > 0) {
+        graph_.constant(value, location(parser_.previous));
+        return;
+    }
     emitBytes(static_cast<uint8_t>(OpCode::OP_CONSTANT), makeConstant(value));
 }
 
-static void endCompiler() {
+// ---- Static types ----
+
+// Each parse function leaves the static type of the subexpression it
+// compiled on types_, mirroring the value the VM will have on its stack.
+// A type describes the value *if evaluation gets that far*: an operand
+// that fails its own type check aborts before the operator runs, so the
+// operator may still rely on the type.
+
+void Compiler::pushType(StaticType type) {
+    types_.push_back(type);
+}
+
+StaticType Compiler::popType() {
+    // The stack can be short after a parse error.
+    if (types_.empty()) return StaticType::UNKNOWN;
+    StaticType type = types_.back();
+    types_.pop_back();
+    return type;
+}
+
+void Compiler::emitNumberOp(OpCode op, bool provenNumbers) {
+    // The expression graph does its own typing and specializes when it
+    // linearizes, so it is always fed the checked opcode.
+    if (provenNumbers && optLevel_ == 0) op = uncheckedNumberOp(op);
+    emitByte(static_cast<uint8_t>(op));
+}
+
+void Compiler::endCompiler() {
+    optimizeTime_ = 0;
+    if (optLevel_ > 0 && !parser_.hadError) {
+        uint64_t start = timings_ != nullptr ? phaseClock() : 0;
+        graph_.optimize(optLevel_);
+        if (!graph_.linearize(*currentChunk())) {
+            error("Too many constants in one chunk.");
+        }
+        if (timings_ != nullptr) optimizeTime_ = phaseClock() - start;
+    }
     emitReturn();
 #ifdef DEBUG_PRINT_CODE
-    if (!parser.hadError) {
+    if (!parser_.hadError) {
         disassembleChunk(*currentChunk(), "code");
     }
 #endif
@@ -135,61 +211,75 @@ static void endCompiler() {
 
 // ---- Pratt parser ----
 
-// Forward declarations
-static void expression();
-static ParseRule* getRule(TokenType type);
-static void parsePrecedence(Precedence precedence);
-
-static void number() {
-    double value = strtod(parser.previous.lexeme.data(), nullptr);
-    emitConstant(NUMBER_VAL(value));
+void Compiler::number() {
+    emitConstant(NUMBER_VAL(parseNumber(parser_.previous.lexeme)));
+    pushType(StaticType::NUMBER);
 }
 
-static void literal() {
-    switch (parser.previous.type) {
+void Compiler::literal() {
+    switch (parser_.previous.type) {
         case TokenType::FALSE: emitByte(static_cast<uint8_t>(OpCode::OP_FALSE)); break;
         case TokenType::NIL:   emitByte(static_cast<uint8_t>(OpCode::OP_NIL)); break;
         case TokenType::TRUE:  emitByte(static_cast<uint8_t>(OpCode::OP_TRUE)); break;
         default: return; // Unreachable.
     }
+    pushType(parser_.previous.type == TokenType::NIL ? StaticType::NIL
+                                                     : StaticType::BOOL);
 }
 
-static void string() {
+void Compiler::string() {
     // Strip the leading and trailing quote characters.
     emitConstant(OBJ_VAL(reinterpret_cast<Obj*>(
-        copyString(parser.previous.lexeme.data() + 1,
-                   static_cast<int>(parser.previous.lexeme.size()) - 2))));
+        copyString(parser_.previous.lexeme.data() + 1,
+                   static_cast<int>(parser_.previous.lexeme.size()) - 2))));
+    pushType(StaticType::STRING);
 }
 
-static void grouping() {
+void Compiler::grouping() {
     expression();
     consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
 }
 
-static void unary() {
-    TokenType operatorType = parser.previous.type;
+void Compiler::unary() {
+    TokenType operatorType = parser_.previous.type;
 
     // Compile the operand.
     parsePrecedence(Precedence::PREC_UNARY);
 
+    emitUnary(operatorType);
+}
+
+void Compiler::emitUnary(TokenType operatorType) {
+    StaticType operand = popType();
+
     // Emit the operator instruction.
     switch (operatorType) {
         case TokenType::BANG:
             emitByte(static_cast<uint8_t>(OpCode::OP_NOT));
+            pushType(StaticType::BOOL);
             break;
         case TokenType::MINUS:
-            emitByte(static_cast<uint8_t>(OpCode::OP_NEGATE));
+            emitNumberOp(OpCode::OP_NEGATE, operand == StaticType::NUMBER);
+            pushType(StaticType::NUMBER);
             break;
         default: return; // Unreachable.
     }
 }
 
-static void binary() {
-    TokenType operatorType = parser.previous.type;
-    ParseRule* rule = getRule(operatorType);
+void Compiler::binary() {
+    TokenType operatorType = parser_.previous.type;
+    const ParseRule* rule = getRule(operatorType);
     parsePrecedence(
         static_cast<Precedence>(static_cast<int>(rule->precedence) + 1));
 
+    emitBinary(operatorType);
+}
+
+void Compiler::emitBinary(TokenType operatorType) {
+    StaticType right = popType();
+    StaticType left = popType();
+    bool numbers = left == StaticType::NUMBER && right == StaticType::NUMBER;
+
     switch (operatorType) {
         case TokenType::BANG_EQUAL:
             emitBytes(static_cast<uint8_t>(OpCode::OP_EQUAL),
@@ -197,113 +287,254 @@ static void binary() {
         case TokenType::EQUAL_EQUAL:
             emitByte(static_cast<uint8_t>(OpCode::OP_EQUAL)); break;
         case TokenType::GREATER:
-            emitByte(static_cast<uint8_t>(OpCode::OP_GREATER)); break;
+            emitNumberOp(OpCode::OP_GREATER, numbers); break;
         case TokenType::GREATER_EQUAL:
-            emitBytes(static_cast<uint8_t>(OpCode::OP_LESS),
-                      static_cast<uint8_t>(OpCode::OP_NOT)); break;
+            emitNumberOp(OpCode::OP_LESS, numbers);
+            emitByte(static_cast<uint8_t>(OpCode::OP_NOT)); break;
         case TokenType::LESS:
-            emitByte(static_cast<uint8_t>(OpCode::OP_LESS)); break;
+            emitNumberOp(OpCode::OP_LESS, numbers); break;
         case TokenType::LESS_EQUAL:
-            emitBytes(static_cast<uint8_t>(OpCode::OP_GREATER),
-                      static_cast<uint8_t>(OpCode::OP_NOT)); break;
+            emitNumberOp(OpCode::OP_GREATER, numbers);
+            emitByte(static_cast<uint8_t>(OpCode::OP_NOT)); break;
         case TokenType::PLUS:
-            emitByte(static_cast<uint8_t>(OpCode::OP_ADD)); break;
+            emitNumberOp(OpCode::OP_ADD, numbers); break;
         case TokenType::MINUS:
-            emitByte(static_cast<uint8_t>(OpCode::OP_SUBTRACT)); break;
+            emitNumberOp(OpCode::OP_SUBTRACT, numbers); break;
         case TokenType::STAR:
-            emitByte(static_cast<uint8_t>(OpCode::OP_MULTIPLY)); break;
+            emitNumberOp(OpCode::OP_MULTIPLY, numbers); break;
         case TokenType::SLASH:
-            emitByte(static_cast<uint8_t>(OpCode::OP_DIVIDE)); break;
+            emitNumberOp(OpCode::OP_DIVIDE, numbers); break;
         default: return; // Unreachable.
     }
+
+    switch (operatorType) {
+        case TokenType::PLUS:
+            if (numbers) {
+                pushType(StaticType::NUMBER);
+            } else if (left == StaticType::STRING && right == StaticType::STRING) {
+                pushType(StaticType::STRING);
+            } else {
+                pushType(StaticType::UNKNOWN);
+            }
+            break;
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+            pushType(StaticType::NUMBER);
+            break;
+        default:
+            pushType(StaticType::BOOL);
+            break;
+    }
 }
 
 // Parse rules table — one entry per TokenType, in enum declaration order.
-static ParseRule rules[] = {
-    /* LEFT_PAREN    */ {grouping, nullptr, Precedence::PREC_NONE},
-    /* RIGHT_PAREN   */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* LEFT_BRACE    */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* RIGHT_BRACE   */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* COMMA         */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* DOT           */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* MINUS         */ {unary,    binary,  Precedence::PREC_TERM},
-    /* PLUS          */ {nullptr,  binary,  Precedence::PREC_TERM},
-    /* SEMICOLON     */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* SLASH         */ {nullptr,  binary,  Precedence::PREC_FACTOR},
-    /* STAR          */ {nullptr,  binary,  Precedence::PREC_FACTOR},
-    /* BANG          */ {unary,    nullptr, Precedence::PREC_NONE},
-    /* BANG_EQUAL    */ {nullptr,  binary,  Precedence::PREC_EQUALITY},
-    /* EQUAL         */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* EQUAL_EQUAL   */ {nullptr,  binary,  Precedence::PREC_EQUALITY},
-    /* GREATER       */ {nullptr,  binary,  Precedence::PREC_COMPARISON},
-    /* GREATER_EQUAL */ {nullptr,  binary,  Precedence::PREC_COMPARISON},
-    /* LESS          */ {nullptr,  binary,  Precedence::PREC_COMPARISON},
-    /* LESS_EQUAL    */ {nullptr,  binary,  Precedence::PREC_COMPARISON},
-    /* IDENTIFIER    */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* STRING        */ {string,   nullptr, Precedence::PREC_NONE},
-    /* NUMBER        */ {number,   nullptr, Precedence::PREC_NONE},
-    /* AND           */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* CLASS         */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* ELSE          */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* FALSE         */ {literal,  nullptr, Precedence::PREC_NONE},
-    /* FOR           */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* FUN           */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* IF            */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* NIL           */ {literal,  nullptr, Precedence::PREC_NONE},
-    /* OR            */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* PRINT         */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* RETURN        */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* SUPER         */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* THIS          */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* TRUE          */ {literal,  nullptr, Precedence::PREC_NONE},
-    /* VAR           */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* WHILE         */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* ERROR         */ {nullptr,  nullptr, Precedence::PREC_NONE},
-    /* END_OF_FILE   */ {nullptr,  nullptr, Precedence::PREC_NONE},
+// Read-only and shared by every Compiler instance.
+const ParseRule Compiler::rules_[] = {
+    /* LEFT_PAREN    */ {&Compiler::grouping, nullptr,           Precedence::PREC_NONE},
+    /* RIGHT_PAREN   */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* LEFT_BRACE    */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* RIGHT_BRACE   */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* COMMA         */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* DOT           */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* MINUS         */ {&Compiler::unary,    &Compiler::binary, Precedence::PREC_TERM},
+    /* PLUS          */ {nullptr,             &Compiler::binary, Precedence::PREC_TERM},
+    /* SEMICOLON     */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* SLASH         */ {nullptr,             &Compiler::binary, Precedence::PREC_FACTOR},
+    /* STAR          */ {nullptr,             &Compiler::binary, Precedence::PREC_FACTOR},
+    /* BANG          */ {&Compiler::unary,    nullptr,           Precedence::PREC_NONE},
+    /* BANG_EQUAL    */ {nullptr,             &Compiler::binary, Precedence::PREC_EQUALITY},
+    /* EQUAL         */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* EQUAL_EQUAL   */ {nullptr,             &Compiler::binary, Precedence::PREC_EQUALITY},
+    /* GREATER       */ {nullptr,             &Compiler::binary, Precedence::PREC_COMPARISON},
+    /* GREATER_EQUAL */ {nullptr,             &Compiler::binary, Precedence::PREC_COMPARISON},
+    /* LESS          */ {nullptr,             &Compiler::binary, Precedence::PREC_COMPARISON},
+    /* LESS_EQUAL    */ {nullptr,             &Compiler::binary, Precedence::PREC_COMPARISON},
+    /* IDENTIFIER    */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* STRING        */ {&Compiler::string,   nullptr,           Precedence::PREC_NONE},
+    /* NUMBER        */ {&Compiler::number,   nullptr,           Precedence::PREC_NONE},
+    /* AND           */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* CLASS         */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* ELSE          */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* FALSE         */ {&Compiler::literal,  nullptr,           Precedence::PREC_NONE},
+    /* FOR           */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* FUN           */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* IF            */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* NIL           */ {&Compiler::literal,  nullptr,           Precedence::PREC_NONE},
+    /* OR            */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* PRINT         */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* RETURN        */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* SUPER         */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* THIS          */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* TRUE          */ {&Compiler::literal,  nullptr,           Precedence::PREC_NONE},
+    /* VAR           */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* WHILE         */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* ERROR         */ {nullptr,             nullptr,           Precedence::PREC_NONE},
+    /* END_OF_FILE   */ {nullptr,             nullptr,           Precedence::PREC_NONE},
 };
 
-static ParseRule* getRule(TokenType type) {
-    return &rules[static_cast<int>(type)];
+const ParseRule* Compiler::getRule(TokenType type) {
+    return &rules_[static_cast<int>(type)];
 }
 
-static void parsePrecedence(Precedence precedence) {
+void Compiler::parsePrecedence(Precedence precedence) {
     advance();
-    ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+    ParseFn prefixRule = getRule(parser_.previous.type)->prefix;
     if (prefixRule == nullptr) {
         error("Expect expression.");
         return;
     }
 
-    prefixRule();
+    (this->*prefixRule)();
 
-    while (precedence <= getRule(parser.current.type)->precedence) {
+    while (precedence <= getRule(parser_.current.type)->precedence) {
         advance();
-        ParseFn infixRule = getRule(parser.previous.type)->infix;
-        infixRule();
+        ParseFn infixRule = getRule(parser_.previous.type)->infix;
+        (this->*infixRule)();
     }
 }
 
-static void expression() {
-    parsePrecedence(Precedence::PREC_ASSIGNMENT);
+// Explicit-stack equivalent of parsePrecedence(). Each recursive call that
+// parsePrecedence() would make is a Frame on the heap instead, so nesting
+// depth is limited by memory rather than by the native stack. Tokens are
+// consumed and bytecode emitted in exactly the same order.
+void Compiler::parsePrecedenceIterative(Precedence precedence) {
+    enum class FrameKind {
+        LOOP,       // A parsePrecedence() call, in its infix loop
+        GROUPING,   // grouping(): consume ')' once the inner expression ends
+        UNARY,      // unary(): emit the operator once its operand ends
+        BINARY,     // binary(): emit the operator once its right operand ends
+    };
+    struct Frame {
+        FrameKind kind;
+        Precedence precedence;  // LOOP only
+        TokenType operatorType; // UNARY and BINARY only
+    };
+
+    std::vector<Frame> frames;
+    frames.push_back({FrameKind::LOOP, precedence, TokenType::ERROR});
+    bool needOperand = true;
+
+    while (!frames.empty()) {
+        if (needOperand) {
+            // Entry of parsePrecedence(): parse a prefix expression.
+            advance();
+            ParseFn prefixRule = getRule(parser_.previous.type)->prefix;
+            if (prefixRule == nullptr) {
+                error("Expect expression.");
+                frames.pop_back();  // Returns without running the infix loop.
+                needOperand = false;
+            } else if (prefixRule == &Compiler::grouping) {
+                frames.push_back({FrameKind::GROUPING, Precedence::PREC_NONE,
+                                  TokenType::ERROR});
+                frames.push_back({FrameKind::LOOP, Precedence::PREC_ASSIGNMENT,
+                                  TokenType::ERROR});
+            } else if (prefixRule == &Compiler::unary) {
+                frames.push_back({FrameKind::UNARY, Precedence::PREC_NONE,
+                                  parser_.previous.type});
+                frames.push_back({FrameKind::LOOP, Precedence::PREC_UNARY,
+                                  TokenType::ERROR});
+            } else {
+                (this->*prefixRule)();  // Leaf: number, string or literal.
+                needOperand = false;
+            }
+            continue;
+        }
+
+        // The operand below the top frame is complete; resume that frame.
+        Frame& frame = frames.back();
+        switch (frame.kind) {
+            case FrameKind::LOOP: {
+                const ParseRule* rule = getRule(parser_.current.type);
+                if (frame.precedence <= rule->precedence) {
+                    // Every infix rule is binary().
+                    advance();
+                    TokenType operatorType = parser_.previous.type;
+                    Precedence next = static_cast<Precedence>(
+                        static_cast<int>(getRule(operatorType)->precedence) + 1);
+                    frames.push_back({FrameKind::BINARY, Precedence::PREC_NONE,
+                                      operatorType});
+                    frames.push_back({FrameKind::LOOP, next, TokenType::ERROR});
+                    needOperand = true;
+                } else {
+                    frames.pop_back();
+                }
+                break;
+            }
+            case FrameKind::GROUPING:
+                frames.pop_back();
+                consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+                break;
+            case FrameKind::UNARY: {
+                TokenType operatorType = frame.operatorType;
+                frames.pop_back();
+                emitUnary(operatorType);
+                break;
+            }
+            case FrameKind::BINARY: {
+                TokenType operatorType = frame.operatorType;
+                frames.pop_back();
+                emitBinary(operatorType);
+                break;
+            }
+        }
+    }
 }
 
-// ---- Public API ----
+void Compiler::expression() {
+    if (parseMode_ == ParseMode::EXPLICIT_STACK) {
+        parsePrecedenceIterative(Precedence::PREC_ASSIGNMENT);
+    } else {
+        parsePrecedence(Precedence::PREC_ASSIGNMENT);
+    }
+}
 
-bool compile(std::string_view source, Chunk& chunk) {
-    Scanner scanner(source);
-    currentScanner = &scanner;
-    compilingChunk = &chunk;
+bool Compiler::compile() {
+    if (timings_ == nullptr) return parse();
+
+    // Scanning is interleaved with parsing: nextToken() adds up the time
+    // spent in the scanner, and the compile is charged what remains. Each
+    // timed call costs two clock reads, one inside its interval and one
+    // outside; neither is charged to either phase.
+    scanTime_ = 0;
+    scanCalls_ = 0;
+    uint64_t start = phaseClock();
+    bool compiled = parse();
+    uint64_t elapsed = phaseClock() - start;
+
+    uint64_t clockTime = scanCalls_ * phaseClockCost();
+    uint64_t scanTime = scanTime_ - std::min(scanTime_, clockTime);
+    uint64_t charged = scanTime_ + clockTime + optimizeTime_;
+    if (tokens_ == nullptr) timings_->record(Phase::SCAN, scanTime);
+    timings_->record(Phase::COMPILE, elapsed - std::min(elapsed, charged));
+    if (optLevel_ > 0 && compiled) timings_->record(Phase::OPTIMIZE, optimizeTime_);
+    return compiled;
+}
 
-    parser.hadError = false;
-    parser.panicMode = false;
+bool Compiler::parse() {
+    parser_.hadError = false;
+    parser_.panicMode = false;
+    nextToken_ = 0;
 
     advance();
     expression();
     consume(TokenType::END_OF_FILE, "Expect end of expression.");
     endCompiler();
 
-    currentScanner = nullptr;
-    compilingChunk = nullptr;
+    return !parser_.hadError;
+}
+
+// ---- Public API ----
+
+bool compile(std::string_view source, Chunk& chunk, int optLevel,
+             ParseMode parseMode, LineMode lineMode, PhaseTimings* timings) {
+    Compiler compiler(source, chunk, optLevel, parseMode, lineMode);
+    compiler.setTimings(timings);
+    return compiler.compile();
+}
 
-    return !parser.hadError;
+bool compile(const TokenBuffer& tokens, Chunk& chunk, int optLevel,
+             ParseMode parseMode) {
+    Compiler compiler(tokens, chunk, optLevel, parseMode);
+    return compiler.compile();
 }
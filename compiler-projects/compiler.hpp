@@ -2,10 +2,162 @@
 #define COMPILER_HPP
 
 #include "chunk.hpp"
+#include "ir.hpp"
+#include "line_index.hpp"
+#include "phase_timing.hpp"
+#include "scanner.hpp"
 #include <string_view>
+#include <vector>
+
+enum class Precedence {
+    PREC_NONE,
+    PREC_ASSIGNMENT,  // =
+    PREC_OR,          // or
+    PREC_AND,         // and
+    PREC_EQUALITY,    // == !=
+    PREC_COMPARISON,  // < > <= >=
+    PREC_TERM,        // + -
+    PREC_FACTOR,      // * /
+    PREC_UNARY,       // ! -
+    PREC_CALL,        // . ()
+    PREC_PRIMARY,
+};
+
+// How the Pratt parser nests. RECURSIVE follows the grammar with native
+// recursion (one chain of calls per nesting level). EXPLICIT_STACK keeps
+// the same state in a heap-allocated stack so arbitrarily deep generated
+// input cannot overflow the native stack; it emits identical bytecode.
+enum class ParseMode {
+    RECURSIVE,
+    EXPLICIT_STACK,
+};
+
+class Compiler;
+
+// Parse rules are member functions so they operate on the compiler
+// instance that is driving them rather than on shared global state.
+using ParseFn = void (Compiler::*)();
+
+struct ParseRule {
+    ParseFn prefix;
+    ParseFn infix;
+    Precedence precedence;
+};
+
+// Pratt compiler for one expression.
+// All parser state lives in the instance, so separate Compilers can run
+// concurrently on different threads. String constants are still linked into
+// the calling thread's object list (see setObjectList()).
+//
+// At optLevel 0 bytecode is emitted in a single pass. Higher levels route
+// the emitted operations through an ExprGraph, optimize it and linearize
+// the result into the chunk (see ExprGraph::optimize()).
+class Compiler {
+public:
+    // With LineMode::LAZY the scanner does not count lines and the chunk's
+    // line table holds source byte offsets instead (the end of the token
+    // each instruction came from); resolve them with a LineIndex over the
+    // same source. Diagnostics still print line numbers.
+    Compiler(std::string_view source, Chunk& chunk, int optLevel = 0,
+             ParseMode parseMode = ParseMode::RECURSIVE,
+             LineMode lineMode = LineMode::EAGER);
+
+    // Read tokens from an already tokenized source instead of scanning.
+    // The buffer is not modified and can be compiled again.
+    Compiler(const TokenBuffer& tokens, Chunk& chunk, int optLevel = 0,
+             ParseMode parseMode = ParseMode::RECURSIVE);
+
+    // Compile the whole source into the chunk.
+    // Returns true if compilation succeeded (no errors), false otherwise.
+    bool compile();
+
+    // Record scan, compile and optimize times into `timings` (nullptr, the
+    // default, records nothing). SCAN is the time spent in the scanner's
+    // own calls, read around each token; COMPILE is the rest. The clock
+    // reads themselves are subtracted from both.
+    void setTimings(PhaseTimings* timings) { timings_ = timings; }
+
+private:
+    struct Parser {
+        Token current;
+        Token previous;
+        bool hadError = false;
+        bool panicMode = false;
+    };
+
+    Chunk* currentChunk() { return &chunk_; }
+
+    // Line number, or in LAZY mode source offset, recorded for a token.
+    int location(const Token& token) const;
+
+    bool parse();
+
+    // Error handling
+    void errorAt(const Token& token, const char* message);
+    void error(const char* message);
+    void errorAtCurrent(const char* message);
+
+    // Front end
+    Token nextToken();
+    void advance();
+    void consume(TokenType type, const char* message);
+
+    // Emitting bytecode
+    void emitByte(uint8_t byte);
+    void emitBytes(uint8_t byte1, uint8_t byte2);
+    void emitReturn();
+    uint8_t makeConstant(Value value);
+    void emitConstant(Value value);
+    void endCompiler();
+
+    // Static types (see pushType())
+    void pushType(StaticType type);
+    StaticType popType();
+    void emitNumberOp(OpCode op, bool provenNumbers);
+
+    // Pratt parser
+    void number();
+    void literal();
+    void string();
+    void grouping();
+    void unary();
+    void binary();
+    void emitUnary(TokenType operatorType);
+    void emitBinary(TokenType operatorType);
+    void parsePrecedence(Precedence precedence);
+    void parsePrecedenceIterative(Precedence precedence);
+    void expression();
+
+    static const ParseRule* getRule(TokenType type);
+    static const ParseRule rules_[];
+
+    std::string_view source_;
+    LineMode lineMode_;
+    LineIndex lines_;               // Only consulted on errors in LAZY mode
+    size_t errorEnd_;               // End offset of the last ERROR token
+    Scanner scanner_;
+    const TokenBuffer* tokens_;     // Token source when not scanning
+    size_t nextToken_;
+    Chunk& chunk_;
+    Parser parser_;
+    int optLevel_;
+    ParseMode parseMode_;
+    ExprGraph graph_;
+    std::vector<StaticType> types_;
+    PhaseTimings* timings_;
+    uint64_t scanTime_;             // Part of the last parse() spent scanning
+    uint64_t scanCalls_;            // Timed scanToken() calls behind scanTime_
+    uint64_t optimizeTime_;         // Part of the last parse() spent optimizing
+};
 
 // Compile a single expression from source code into bytecode.
 // Returns true if compilation succeeded (no errors), false otherwise.
-bool compile(std::string_view source, Chunk& chunk);
+bool compile(std::string_view source, Chunk& chunk, int optLevel = 0,
+             ParseMode parseMode = ParseMode::RECURSIVE,
+             LineMode lineMode = LineMode::EAGER, PhaseTimings* timings = nullptr);
+
+// Compile a single expression from a tokenized source (see tokenize()).
+bool compile(const TokenBuffer& tokens, Chunk& chunk, int optLevel = 0,
+             ParseMode parseMode = ParseMode::RECURSIVE);
 
 #endif // COMPILER_HPP
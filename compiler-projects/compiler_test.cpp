@@ -2,9 +2,16 @@
 #include "vm.hpp"
 #include "chunk.hpp"
 #include "object.hpp"
+#include "static_compiler.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 // Test framework matching the project's existing style
 static int tests_run = 0;
@@ -63,6 +70,28 @@ TEST(test_compile_decimal) {
     assert(result && "Decimal number should compile");
 }
 
+TEST(test_compile_number_view) {
+    // The source view ends mid-literal; only "12" may be parsed.
+    Chunk chunk;
+    suppress_output();
+    bool result = compile(std::string_view("12345", 2), chunk);
+    restore_output();
+    assert(result);
+    assert(AS_NUMBER(chunk.constant(0)) == 12.0);
+}
+
+TEST(test_compile_number_out_of_range) {
+    Chunk huge;
+    Chunk tiny;
+    suppress_output();
+    bool result = compile("1" + std::string(400, '0'), huge) &&
+                  compile("0." + std::string(400, '0') + "1", tiny);
+    restore_output();
+    assert(result);
+    assert(AS_NUMBER(huge.constant(0)) == HUGE_VAL);
+    assert(AS_NUMBER(tiny.constant(0)) == 0.0);
+}
+
 TEST(test_compile_addition) {
     Chunk chunk;
     suppress_output();
@@ -152,7 +181,7 @@ TEST(test_bytecode_number) {
 }
 
 TEST(test_bytecode_binary) {
-    // "1 + 2" -> OP_CONSTANT 0, OP_CONSTANT 1, OP_ADD, OP_RETURN
+    // "1 + 2" -> OP_CONSTANT 0, OP_CONSTANT 1, OP_ADD_NUMBER, OP_RETURN
     Chunk chunk;
     suppress_output();
     bool result = compile("1 + 2", chunk);
@@ -163,12 +192,12 @@ TEST(test_bytecode_binary) {
     assert(AS_NUMBER(chunk.constant(static_cast<size_t>(chunk.code(1)))) == 1.0);
     assert(chunk.code(2) == static_cast<uint8_t>(OpCode::OP_CONSTANT));
     assert(AS_NUMBER(chunk.constant(static_cast<size_t>(chunk.code(3)))) == 2.0);
-    assert(chunk.code(4) == static_cast<uint8_t>(OpCode::OP_ADD));
+    assert(chunk.code(4) == static_cast<uint8_t>(OpCode::OP_ADD_NUMBER));
     assert(chunk.code(5) == static_cast<uint8_t>(OpCode::OP_RETURN));
 }
 
 TEST(test_bytecode_negate) {
-    // "-5" -> OP_CONSTANT 0, OP_NEGATE, OP_RETURN
+    // "-5" -> OP_CONSTANT 0, OP_NEGATE_NUMBER, OP_RETURN
     Chunk chunk;
     suppress_output();
     bool result = compile("-5", chunk);
@@ -177,7 +206,7 @@ TEST(test_bytecode_negate) {
     assert(chunk.count() == 4);
     assert(chunk.code(0) == static_cast<uint8_t>(OpCode::OP_CONSTANT));
     assert(AS_NUMBER(chunk.constant(0)) == 5.0);
-    assert(chunk.code(2) == static_cast<uint8_t>(OpCode::OP_NEGATE));
+    assert(chunk.code(2) == static_cast<uint8_t>(OpCode::OP_NEGATE_NUMBER));
     assert(chunk.code(3) == static_cast<uint8_t>(OpCode::OP_RETURN));
 }
 
@@ -189,10 +218,10 @@ TEST(test_bytecode_precedence) {
     restore_output();
     assert(result);
     // OP_CONSTANT 0(2), OP_CONSTANT 1(3), OP_CONSTANT 2(4),
-    // OP_MULTIPLY, OP_ADD, OP_RETURN
+    // OP_MULTIPLY_NUMBER, OP_ADD_NUMBER, OP_RETURN
     assert(chunk.count() == 9);
-    assert(chunk.code(6) == static_cast<uint8_t>(OpCode::OP_MULTIPLY));
-    assert(chunk.code(7) == static_cast<uint8_t>(OpCode::OP_ADD));
+    assert(chunk.code(6) == static_cast<uint8_t>(OpCode::OP_MULTIPLY_NUMBER));
+    assert(chunk.code(7) == static_cast<uint8_t>(OpCode::OP_ADD_NUMBER));
 }
 
 // ---- Error tests (should fail) ----
@@ -586,12 +615,671 @@ TEST(test_vm_empty_string_concat) {
     assert(result == InterpretResult::INTERPRET_OK);
 }
 
+// ---- Reentrant compiler tests ----
+
+TEST(test_compiler_instance) {
+    Chunk chunk;
+    suppress_output();
+    Compiler compiler("1 + 2", chunk);
+    bool result = compiler.compile();
+    restore_output();
+    assert(result);
+    assert(chunk.count() == 6);
+    assert(chunk.code(4) == static_cast<uint8_t>(OpCode::OP_ADD_NUMBER));
+}
+
+TEST(test_compiler_instances_independent) {
+    // An error in one compiler must not leak into another.
+    Chunk bad;
+    Chunk good;
+    suppress_output();
+    Compiler badCompiler("(1 +", bad);
+    Compiler goodCompiler("3 * 4", good);
+    bool badResult = badCompiler.compile();
+    bool goodResult = goodCompiler.compile();
+    restore_output();
+    assert(!badResult);
+    assert(goodResult);
+}
+
+// Deterministic generator for the concurrency test.
+static std::string generateExpression(int seed) {
+    static const char* ops[] = {" + ", " - ", " * ", " / ", " < ", " == "};
+    std::string source = "(" + std::to_string(seed % 97) + ".5";
+    for (int i = 0; i < 1 + seed % 7; i++) {
+        source += ops[(seed + i) % 6];
+        if ((seed + i) % 5 == 0) source += "-";
+        source += std::to_string((seed * 31 + i) % 1000);
+    }
+    source += ")";
+    if (seed % 3 == 0) source = "!" + source;
+    if (seed % 4 == 0) source = "\"s" + std::to_string(seed) + "\" == \"t\"";
+    return source;
+}
+
+static bool sameChunk(const Chunk& a, const Chunk& b) {
+    if (a.code() != b.code() || a.lines() != b.lines()) return false;
+    if (a.constants().size() != b.constants().size()) return false;
+    for (size_t i = 0; i < a.constants().size(); i++) {
+        if (!valuesEqual(a.constant(i), b.constant(i))) return false;
+    }
+    return true;
+}
+
+TEST(test_compile_concurrent) {
+    const int kExpressions = 4000;
+    const int kThreads = 8;
+
+    std::vector<std::string> sources;
+    for (int i = 0; i < kExpressions; i++) {
+        sources.push_back(generateExpression(i));
+    }
+
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    suppress_output();
+
+    // Reference bytecode, compiled sequentially.
+    std::vector<Chunk> expected(kExpressions);
+    for (int i = 0; i < kExpressions; i++) {
+        assert(compile(sources[i], expected[i]));
+    }
+
+    // Every thread compiles every expression into its own chunks.
+    std::vector<std::vector<Chunk>> actual(
+        kThreads, std::vector<Chunk>(kExpressions));
+    std::vector<Obj*> threadObjects(kThreads, nullptr);
+    std::vector<int> failures(kThreads, 0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < kThreads; t++) {
+        workers.emplace_back([&, t]() {
+            setObjectList(&threadObjects[t]);
+            for (int i = 0; i < kExpressions; i++) {
+                // Stagger start points so threads hit different sources.
+                int index = (i + t * 97) % kExpressions;
+                if (!compile(sources[index], actual[t][index])) {
+                    failures[t]++;
+                }
+            }
+            setObjectList(nullptr);
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    restore_output();
+
+    for (int t = 0; t < kThreads; t++) {
+        assert(failures[t] == 0);
+        for (int i = 0; i < kExpressions; i++) {
+            assert(sameChunk(expected[i], actual[t][i]));
+        }
+        freeObjects(threadObjects[t]);
+    }
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+// ---- Optimizing middle-end tests ----
+
+// Compile at the given level and return the opcodes (constant operands skipped).
+static std::vector<OpCode> compiledOps(const char* source, int optLevel, Chunk& chunk) {
+    suppress_output();
+    bool result = compile(source, chunk, optLevel);
+    restore_output();
+    assert(result);
+    std::vector<OpCode> ops;
+    for (size_t offset = 0; offset < chunk.count(); offset++) {
+        OpCode op = static_cast<OpCode>(chunk.code(offset));
+        ops.push_back(op);
+        if (op == OpCode::OP_CONSTANT) offset++;
+    }
+    return ops;
+}
+
+TEST(test_opt0_matches_single_pass) {
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("(1 + 2) * 1", 0, chunk);
+    assert(ops.size() == 6);
+    assert(ops[4] == OpCode::OP_MULTIPLY_NUMBER);
+}
+
+TEST(test_opt1_multiply_by_one) {
+    // (1 + 2) * 1 => 1 + 2
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("(1 + 2) * 1", 1, chunk);
+    assert(ops.size() == 4);
+    assert(ops[2] == OpCode::OP_ADD_NUMBER);
+    assert(ops[3] == OpCode::OP_RETURN);
+}
+
+TEST(test_opt1_double_negate) {
+    // --5 => 5
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("--5", 1, chunk);
+    assert(ops.size() == 2);
+    assert(ops[0] == OpCode::OP_CONSTANT);
+    assert(AS_NUMBER(chunk.constant(0)) == 5.0);
+}
+
+TEST(test_opt1_double_not) {
+    // !!true => true, but !!nil must still produce a bool
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("!!true", 1, chunk);
+    assert(ops.size() == 2 && ops[0] == OpCode::OP_TRUE);
+
+    Chunk nilChunk;
+    ops = compiledOps("!!nil", 1, nilChunk);
+    assert(ops.size() == 4);
+}
+
+TEST(test_opt1_add_negated) {
+    // (2 - 1) + -3 => (2 - 1) - 3
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("(2 - 1) + -3", 1, chunk);
+    assert(ops.size() == 6);
+    assert(ops[4] == OpCode::OP_SUBTRACT_NUMBER);
+}
+
+TEST(test_opt1_keeps_type_errors) {
+    // "a" * 1 must still raise a runtime error
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("\"a\" * 1", 1, chunk);
+    assert(ops.size() == 4);
+    assert(ops[2] == OpCode::OP_MULTIPLY);
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_opt1_shares_constants) {
+    // Identical subexpressions are one DAG node, so one constant slot.
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("\"ab\" == \"ab\"", 1, chunk);
+    assert(ops.size() == 4);
+    assert(chunk.constants().size() == 1);
+    assert(chunk.code(1) == chunk.code(3));
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_opt2_constant_folding) {
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("(1 + 2) * 3 > 4", 2, chunk);
+    assert(ops.size() == 2);
+    assert(ops[0] == OpCode::OP_TRUE);
+
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    Chunk stringChunk;
+    ops = compiledOps("\"foo\" + \"bar\"", 2, stringChunk);
+    assert(ops.size() == 2);
+    assert(strcmp(AS_CSTRING(stringChunk.constant(0)), "foobar") == 0);
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_opt2_no_fold_on_error) {
+    // -true and 1 < "a" fail at runtime, so they are left alone.
+    suppress_output();
+    VM vm;
+    vm.setOptLevel(2);
+    InterpretResult negate = vm.interpret("-true");
+    InterpretResult compare = vm.interpret("1 < \"a\"");
+    restore_output();
+    assert(negate == InterpretResult::INTERPRET_RUNTIME_ERROR);
+    assert(compare == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+TEST(test_opt2_strength_reduction) {
+    // x / 4 => x * 0.25 (x cannot be folded here)
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("-true / 4", 2, chunk);
+    // -true is typed NUMBER-if-it-succeeds, so the multiply is unchecked.
+    assert(ops.size() == 5);
+    assert(ops[1] == OpCode::OP_NEGATE);
+    assert(ops[3] == OpCode::OP_MULTIPLY_NUMBER);
+    assert(AS_NUMBER(chunk.constant(0)) == 0.25);
+
+    // Not a power of two: keep the division.
+    Chunk other;
+    ops = compiledOps("-true / 3", 2, other);
+    assert(ops[3] == OpCode::OP_DIVIDE_NUMBER);
+}
+
+TEST(test_opt_levels_agree_at_runtime) {
+    const char* sources[] = {
+        "(-1 + 2) * 3 - -4", "!(5 - 4 > 3 * 2 == !nil)", "1 / 0 == 2 / 0",
+        "\"a\" + \"b\" == \"ab\"", "-true", "\"x\" * 1", "--nil",
+    };
+    for (const char* source : sources) {
+        suppress_output();
+        VM vm0;
+        VM vm2;
+        vm2.setOptLevel(2);
+        InterpretResult r0 = vm0.interpret(source);
+        InterpretResult r2 = vm2.interpret(source);
+        restore_output();
+        assert(r0 == r2);
+    }
+}
+
+// ---- Static type inference tests ----
+
+TEST(test_types_unchecked_when_proven) {
+    // (1 + 2) * 3 > 4 -> every operator specialized
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("(1 + 2) * 3 > 4", 0, chunk);
+    assert(ops.size() == 8);
+    assert(ops[2] == OpCode::OP_ADD_NUMBER);
+    assert(ops[4] == OpCode::OP_MULTIPLY_NUMBER);
+    assert(ops[6] == OpCode::OP_GREATER_NUMBER);
+}
+
+TEST(test_types_compound_comparisons) {
+    // >= and <= keep their trailing OP_NOT
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("1 >= 2", 0, chunk);
+    assert(ops.size() == 5);
+    assert(ops[2] == OpCode::OP_LESS_NUMBER);
+    assert(ops[3] == OpCode::OP_NOT);
+}
+
+TEST(test_types_checked_when_unknown) {
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+
+    Chunk strings;
+    std::vector<OpCode> ops = compiledOps("\"a\" + \"b\"", 0, strings);
+    assert(ops[2] == OpCode::OP_ADD);
+
+    Chunk mixed;
+    ops = compiledOps("nil + 1", 0, mixed);
+    assert(ops[2] == OpCode::OP_ADD);
+
+    Chunk negateBool;
+    ops = compiledOps("-true", 0, negateBool);
+    assert(ops[1] == OpCode::OP_NEGATE);
+
+    Chunk notNumber;
+    ops = compiledOps("!1 < 2", 0, notNumber);
+    assert(ops[3] == OpCode::OP_LESS);
+
+    // "a" + "b" is a string, so adding a number stays checked.
+    Chunk concatThenNumber;
+    ops = compiledOps("\"a\" + \"b\" - 1", 0, concatThenNumber);
+    assert(ops[4] == OpCode::OP_SUBTRACT);
+
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_types_result_of_failing_operand) {
+    // (true - 1) is NUMBER if it succeeds, so the outer add is unchecked;
+    // the inner subtract still reports the error at runtime.
+    Chunk chunk;
+    std::vector<OpCode> ops = compiledOps("(true - 1) + 2", 0, chunk);
+    assert(ops[2] == OpCode::OP_SUBTRACT);
+    assert(ops[4] == OpCode::OP_ADD_NUMBER);
+
+    suppress_output();
+    VM vm;
+    InterpretResult result = vm.interpret("(true - 1) + 2");
+    restore_output();
+    assert(result == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
+// ---- Explicit-stack parser tests ----
+
+static bool compilesAlike(const std::string& source, int optLevel) {
+    Chunk recursive;
+    Chunk iterative;
+    bool a = compile(source, recursive, optLevel, ParseMode::RECURSIVE);
+    bool b = compile(source, iterative, optLevel, ParseMode::EXPLICIT_STACK);
+    return a == b && (!a || sameChunk(recursive, iterative));
+}
+
+TEST(test_explicit_stack_same_bytecode) {
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    suppress_output();
+    const char* sources[] = {
+        "42", "-5", "!true", "1 + 2 * 3", "(1 + 2) * 3", "(-1 + 2) * 3 - -4",
+        "!(5 - 4 > 3 * 2 == !nil)", "1 <= 2 != 3 >= 4", "\"a\" + \"b\"",
+        "1 - 2 - 3 - 4", "--(-(1))", "((1 / 2) < (3 / 4)) == false",
+    };
+    bool same = true;
+    for (const char* source : sources) {
+        for (int level = 0; level <= 2; level++) {
+            same = same && compilesAlike(source, level);
+        }
+    }
+    for (int i = 0; i < 1000; i++) {
+        same = same && compilesAlike(generateExpression(i), 0);
+    }
+    restore_output();
+    assert(same);
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_explicit_stack_errors) {
+    // Same diagnostics outcome and same partial state for malformed input.
+    suppress_output();
+    const char* sources[] = {
+        "", "(", "(1 +", "1 +", ")", "(((1)", "1 2", "-", "!!", "1 + * 2",
+        "(1 + 2))", "\"oops", "@", "var",
+    };
+    bool same = true;
+    for (const char* source : sources) {
+        same = same && compilesAlike(source, 0);
+    }
+    restore_output();
+    assert(same);
+}
+
+static std::string nestedSource(int depth) {
+    // Alternate grouping and unary minus: -(-(-( ... 1 ... )))
+    std::string source;
+    source.reserve(static_cast<size_t>(depth) * 3 + 1);
+    for (int i = 0; i < depth; i++) source += "-(";
+    source += "1";
+    source.append(static_cast<size_t>(depth), ')');
+    return source;
+}
+
+static void* compileDeepOnSmallStack(void* arg) {
+    const std::string* source = static_cast<const std::string*>(arg);
+    Chunk chunk;
+    bool ok = compile(*source, chunk, 0, ParseMode::EXPLICIT_STACK) &&
+              chunk.count() == static_cast<size_t>(source->size() / 3) + 3;
+    return reinterpret_cast<void*>(ok ? 1 : 0);
+}
+
+TEST(test_explicit_stack_deep_nesting) {
+    // 200k nesting levels on a 256 KiB native stack: far too deep for the
+    // recursive parser, fine for the explicit stack.
+    std::string source = nestedSource(200000);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+
+    suppress_output();
+    pthread_t thread;
+    void* result = nullptr;
+    int created = pthread_create(&thread, &attr, compileDeepOnSmallStack, &source);
+    if (created == 0) pthread_join(thread, &result);
+    restore_output();
+    pthread_attr_destroy(&attr);
+
+    assert(created == 0);
+    assert(result != nullptr);
+}
+
+TEST(test_vm_explicit_stack) {
+    suppress_output();
+    VM vm;
+    vm.setParseMode(ParseMode::EXPLICIT_STACK);
+    InterpretResult result = vm.interpret(nestedSource(1000));
+    restore_output();
+    assert(result == InterpretResult::INTERPRET_OK);
+}
+
+// ---- Token buffer front end tests ----
+
+TEST(test_token_buffer_same_bytecode) {
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    suppress_output();
+    bool same = true;
+    for (int i = 0; i < 1000; i++) {
+        std::string source = generateExpression(i);
+        TokenBuffer tokens = tokenize(source);
+        for (int level = 0; level <= 2; level++) {
+            Chunk scanned;
+            Chunk buffered;
+            bool a = compile(source, scanned, level);
+            bool b = compile(tokens, buffered, level);
+            same = same && a == b && (!a || sameChunk(scanned, buffered));
+        }
+    }
+    restore_output();
+    assert(same);
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_token_buffer_errors) {
+    suppress_output();
+    const char* sources[] = {"", "(1 +", "1 2", "\"oops", "@", "1 + @ 2"};
+    bool same = true;
+    for (const char* source : sources) {
+        Chunk scanned;
+        Chunk buffered;
+        TokenBuffer tokens = tokenize(source);
+        same = same && !compile(source, scanned) && !compile(tokens, buffered) &&
+               sameChunk(scanned, buffered);
+    }
+    restore_output();
+    assert(same);
+}
+
+TEST(test_token_buffer_reused) {
+    // One tokenization, several passes over it
+    TokenBuffer tokens = tokenize("(1 + 2) * 3");
+    Chunk first;
+    Chunk second;
+    suppress_output();
+    bool a = compile(tokens, first, 0);
+    bool b = compile(tokens, second, 2);
+    restore_output();
+    assert(a && b);
+    assert(first.count() == 9);
+    assert(second.count() == 3);   // Folded to a single constant
+}
+
+// ---- Lazy line numbers ----
+
+// Run `body` with stdout suppressed and return what it wrote to stderr.
+template <typename Body>
+static std::string capture_errors(Body body) {
+    FILE* capture = tmpfile();
+    suppress_output();
+    if (capture) stderr = capture;
+    body();
+    restore_output();
+    if (!capture) return "";
+
+    std::string text;
+    rewind(capture);
+    for (int c = fgetc(capture); c != EOF; c = fgetc(capture)) text += static_cast<char>(c);
+    fclose(capture);
+    return text;
+}
+
+static const char* multiLineSources[] = {
+    "1 +\n\n  2 *\n(3\n-\n4)",
+    "\"a\nb\" +\n\"c\"",
+    "!(5 - 4\n > 3 * 2\n == !nil)",
+    "// comment\n\n-(\n1\n)",
+};
+
+TEST(test_lazy_lines_resolve_to_eager) {
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    suppress_output();
+    bool same = true;
+    for (const char* source : multiLineSources) {
+        LineIndex index(source);
+        for (int level = 0; level <= 2; level++) {
+            Chunk eager;
+            Chunk lazy;
+            same = same && compile(source, eager, level) &&
+                   compile(source, lazy, level, ParseMode::RECURSIVE, LineMode::LAZY);
+            same = same && eager.code() == lazy.code();
+            for (size_t i = 0; same && i < eager.count(); i++) {
+                same = eager.line(i) == index.line(static_cast<size_t>(lazy.line(i)));
+            }
+        }
+    }
+    restore_output();
+    assert(same);
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_lazy_lines_compile_errors) {
+    const char* sources[] = {
+        "1 +\n\n", "\n\n@", "1\n+\n\"open\nstring", "(1\n\n2", "\n1 2", "",
+    };
+    for (const char* source : sources) {
+        std::string eager = capture_errors([&] {
+            Chunk chunk;
+            compile(source, chunk);
+        });
+        std::string lazy = capture_errors([&] {
+            Chunk chunk;
+            compile(source, chunk, 0, ParseMode::RECURSIVE, LineMode::LAZY);
+        });
+        assert(!eager.empty());
+        assert(eager == lazy);
+    }
+}
+
+TEST(test_lazy_lines_runtime_error) {
+    const char* source = "1 +\n\n-\ntrue";
+    std::string eager = capture_errors([&] {
+        VM vm;
+        vm.interpret(source);
+    });
+    std::string lazy = capture_errors([&] {
+        VM vm;
+        vm.setLineMode(LineMode::LAZY);
+        vm.setCacheCapacity(4);     // Cached chunks keep offsets as well
+        vm.interpret(source);
+        vm.interpret(source);
+    });
+    assert(eager.find("[line 4] in script") != std::string::npos);
+    assert(lazy == eager + eager);
+}
+
+TEST(test_timed_compile_same_bytecode) {
+    // A timed compile scans an extra time; nothing else may change.
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    suppress_output();
+    PhaseTimings timings;
+    bool same = true;
+    for (int i = 0; i < 200; i++) {
+        std::string source = generateExpression(i);
+        for (int level = 0; level <= 2; level++) {
+            for (LineMode mode : {LineMode::EAGER, LineMode::LAZY}) {
+                Chunk plain;
+                Chunk timed;
+                bool a = compile(source, plain, level, ParseMode::RECURSIVE, mode);
+                bool b = compile(source, timed, level, ParseMode::RECURSIVE, mode, &timings);
+                same = same && a == b && (!a || sameChunk(plain, timed));
+            }
+        }
+    }
+    restore_output();
+    assert(same);
+    assert(timings.phase(Phase::COMPILE).count() == 200 * 3 * 2);
+    assert(timings.phase(Phase::SCAN).count() == 200 * 3 * 2);
+    assert(timings.phase(Phase::OPTIMIZE).count() > 0);
+    assert(timings.phase(Phase::EXECUTE).count() == 0);
+    freeObjects(objects);
+    setObjectList(nullptr);
+
+    const char* sources[] = {"", "(1 +", "1 2", "\"oops", "@", "1 + @ 2"};
+    for (const char* source : sources) {
+        std::string plain = capture_errors([&] {
+            Chunk chunk;
+            compile(source, chunk);
+        });
+        std::string timed = capture_errors([&] {
+            Chunk chunk;
+            compile(source, chunk, 0, ParseMode::RECURSIVE, LineMode::EAGER, &timings);
+        });
+        assert(!plain.empty());
+        assert(plain == timed);
+    }
+}
+
+// ---- Compile-time expressions ----
+
+// Images built by the constexpr compiler. They must match compile()
+// byte for byte, line for line and constant for constant.
+static constexpr auto kStaticArithmetic = compileStatic("1 + 2 * 3 - 4 / 5");
+static constexpr auto kStaticLogic = compileStatic("!(5 - 4\n > 3 * 2\n == !nil)");
+static constexpr auto kStaticCompare = compileStatic("1 <= 2 != (3 >= 4.25)");
+static constexpr auto kStaticStrings = compileStatic("\"a\nb\" +\n\"c\" == \"a\nbc\"");
+static constexpr auto kStaticUnknown = compileStatic("-(nil) + \"\" * true");
+static constexpr auto kStaticComment = compileStatic("// comment\n\n-(\n1\n)\n");
+static constexpr auto kStaticManyLines = compileStatic(
+    "1\n+ 2\n+ 3\n+ 4\n+ 5\n+ 6\n+ 7\n+ 8\n+ 9\n+ 10\n"
+    "+ 11\n+ 12\n+ 13\n+ 14\n+ 15\n+ 16\n+ 17\n+ 18\n+ 19\n+ 20");
+
+static bool sameAsRuntime(const char* source, const CompiledChunk& image) {
+    Chunk chunk;
+    if (!compile(source, chunk)) return false;
+    if (chunk.count() != image.count() || chunk.constants().size() != image.constantCount()) {
+        return false;
+    }
+    for (size_t i = 0; i < chunk.count(); i++) {
+        if (chunk.code()[i] != image.code(i) || chunk.line(i) != image.line(i)) return false;
+    }
+    for (size_t i = 0; i < image.constantCount(); i++) {
+        if (!valuesEqual(chunk.constants()[i], image.constant(i))) return false;
+    }
+    const std::vector<uint8_t>& bytes = chunk.lines().encoded();
+    return bytes.size() == image.lineByteCount() &&
+           std::equal(bytes.begin(), bytes.end(), image.lineBytes()) &&
+           chunk.lines().checkpoints().size() == image.checkpointCount();
+}
+
+TEST(test_static_matches_runtime) {
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    suppress_output();
+    bool same = sameAsRuntime("1 + 2 * 3 - 4 / 5", staticProgram<kStaticArithmetic>()) &&
+                sameAsRuntime("!(5 - 4\n > 3 * 2\n == !nil)", staticProgram<kStaticLogic>()) &&
+                sameAsRuntime("1 <= 2 != (3 >= 4.25)", staticProgram<kStaticCompare>()) &&
+                sameAsRuntime("\"a\nb\" +\n\"c\" == \"a\nbc\"", staticProgram<kStaticStrings>()) &&
+                sameAsRuntime("-(nil) + \"\" * true", staticProgram<kStaticUnknown>()) &&
+                sameAsRuntime("// comment\n\n-(\n1\n)\n", staticProgram<kStaticComment>());
+    restore_output();
+    assert(same);
+    assert(staticProgram<kStaticManyLines>().checkpointCount() == 2);
+    freeObjects(objects);
+    setObjectList(nullptr);
+}
+
+TEST(test_static_run) {
+    // The image is shared: one CompiledChunk however often it is asked for.
+    assert(&staticProgram<kStaticStrings>() == &staticProgram<kStaticStrings>());
+    VM vm;
+    suppress_output();
+    InterpretResult strings = vm.interpret(staticProgram<kStaticStrings>());
+    InterpretResult logic = vm.interpret(staticProgram<kStaticLogic>());
+    InterpretResult unknown = vm.interpret(staticProgram<kStaticUnknown>());
+    restore_output();
+    assert(strings == InterpretResult::INTERPRET_OK);
+    assert(logic == InterpretResult::INTERPRET_OK);
+    assert(unknown == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
 int main() {
     printf("=== Compiler Unit Tests (Chapter 19 - Strings) ===\n\n");
 
     // Expression compilation
     RUN_TEST(test_compile_number);
     RUN_TEST(test_compile_decimal);
+    RUN_TEST(test_compile_number_view);
+    RUN_TEST(test_compile_number_out_of_range);
     RUN_TEST(test_compile_addition);
     RUN_TEST(test_compile_subtraction);
     RUN_TEST(test_compile_multiplication);
@@ -658,6 +1346,58 @@ int main() {
     RUN_TEST(test_vm_empty_string);
     RUN_TEST(test_vm_empty_string_concat);
 
+    // Reentrant compiler
+    printf("\n--- Reentrant compiler ---\n");
+    RUN_TEST(test_compiler_instance);
+    RUN_TEST(test_compiler_instances_independent);
+    RUN_TEST(test_compile_concurrent);
+
+    // Optimizing middle-end
+    printf("\n--- Optimizing middle-end ---\n");
+    RUN_TEST(test_opt0_matches_single_pass);
+    RUN_TEST(test_opt1_multiply_by_one);
+    RUN_TEST(test_opt1_double_negate);
+    RUN_TEST(test_opt1_double_not);
+    RUN_TEST(test_opt1_add_negated);
+    RUN_TEST(test_opt1_keeps_type_errors);
+    RUN_TEST(test_opt1_shares_constants);
+    RUN_TEST(test_opt2_constant_folding);
+    RUN_TEST(test_opt2_no_fold_on_error);
+    RUN_TEST(test_opt2_strength_reduction);
+    RUN_TEST(test_opt_levels_agree_at_runtime);
+
+    // Static type inference
+    printf("\n--- Static type inference ---\n");
+    RUN_TEST(test_types_unchecked_when_proven);
+    RUN_TEST(test_types_compound_comparisons);
+    RUN_TEST(test_types_checked_when_unknown);
+    RUN_TEST(test_types_result_of_failing_operand);
+
+    // Explicit-stack parser
+    printf("\n--- Explicit-stack parser ---\n");
+    RUN_TEST(test_explicit_stack_same_bytecode);
+    RUN_TEST(test_explicit_stack_errors);
+    RUN_TEST(test_explicit_stack_deep_nesting);
+    RUN_TEST(test_vm_explicit_stack);
+
+    // Token buffer front end
+    printf("\n--- Token buffer front end ---\n");
+    RUN_TEST(test_token_buffer_same_bytecode);
+    RUN_TEST(test_token_buffer_errors);
+    RUN_TEST(test_token_buffer_reused);
+
+    // Lazy line numbers
+    printf("\n--- Lazy line numbers ---\n");
+    RUN_TEST(test_lazy_lines_resolve_to_eager);
+    RUN_TEST(test_lazy_lines_compile_errors);
+    RUN_TEST(test_lazy_lines_runtime_error);
+    RUN_TEST(test_timed_compile_same_bytecode);
+
+    // Compile-time expressions
+    printf("\n--- Compile-time expressions ---\n");
+    RUN_TEST(test_static_matches_runtime);
+    RUN_TEST(test_static_run);
+
     printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
 
     if (devnull) fclose(devnull);
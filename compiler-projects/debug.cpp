@@ -7,7 +7,8 @@ static int simpleInstruction(const char* name, int offset) {
     return offset + 1;
 }
 
-static int constantInstruction(const char* name, const Chunk& chunk, int offset) {
+template <typename ChunkType>
+static int constantInstruction(const char* name, const ChunkType& chunk, int offset) {
     uint8_t constantIndex = chunk.code(offset + 1);
     printf("%-16s %4d '", name, constantIndex);
     printValue(chunk.constant(constantIndex));
@@ -23,7 +24,9 @@ void disassembleChunk(const Chunk& chunk, const char* name) {
     }
 }
 
-int disassembleInstruction(const Chunk& chunk, int offset) {
+// Shared by Chunk and CompiledChunk, which expose the same accessors.
+template <typename ChunkType>
+static int disassembleAt(const ChunkType& chunk, int offset) {
     printf("%04d ", offset);
 
     // Show line number or | if same as previous
@@ -63,8 +66,30 @@ int disassembleInstruction(const Chunk& chunk, int offset) {
             return simpleInstruction("OP_NEGATE", offset);
         case OpCode::OP_RETURN:
             return simpleInstruction("OP_RETURN", offset);
+        case OpCode::OP_GREATER_NUMBER:
+            return simpleInstruction("OP_GREATER_NUMBER", offset);
+        case OpCode::OP_LESS_NUMBER:
+            return simpleInstruction("OP_LESS_NUMBER", offset);
+        case OpCode::OP_ADD_NUMBER:
+            return simpleInstruction("OP_ADD_NUMBER", offset);
+        case OpCode::OP_SUBTRACT_NUMBER:
+            return simpleInstruction("OP_SUBTRACT_NUMBER", offset);
+        case OpCode::OP_MULTIPLY_NUMBER:
+            return simpleInstruction("OP_MULTIPLY_NUMBER", offset);
+        case OpCode::OP_DIVIDE_NUMBER:
+            return simpleInstruction("OP_DIVIDE_NUMBER", offset);
+        case OpCode::OP_NEGATE_NUMBER:
+            return simpleInstruction("OP_NEGATE_NUMBER", offset);
         default:
             printf("Unknown opcode %d\n", instruction);
             return offset + 1;
     }
 }
+
+int disassembleInstruction(const Chunk& chunk, int offset) {
+    return disassembleAt(chunk, offset);
+}
+
+int disassembleInstruction(const CompiledChunk& chunk, int offset) {
+    return disassembleAt(chunk, offset);
+}
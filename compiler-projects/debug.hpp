@@ -9,5 +9,6 @@ void disassembleChunk(const Chunk& chunk, const char* name);
 // Disassemble a single instruction at the given offset
 // Returns the offset of the next instruction
 int disassembleInstruction(const Chunk& chunk, int offset);
+int disassembleInstruction(const CompiledChunk& chunk, int offset);
 
 #endif // DEBUG_HPP
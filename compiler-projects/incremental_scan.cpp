@@ -0,0 +1,58 @@
+#include "incremental_scan.hpp"
+
+// How far past its last character a token's scan can look: a number
+// checks the next two characters for a fractional part.
+static constexpr size_t MAX_LOOKAHEAD = 2;
+
+size_t retokenize(TokenBuffer& tokens, std::string_view source, const SourceEdit& edit) {
+    // Keep every token whose scan ended (lookahead included) before the
+    // edit; the scanner state after such a token is just its end and line.
+    size_t keep = tokens.lowerBound(edit.offset);
+    while (keep > 0) {
+        size_t end = static_cast<size_t>(tokens.offset(keep - 1)) + tokens.length(keep - 1);
+        if (end + MAX_LOOKAHEAD <= edit.offset) break;
+        keep--;
+    }
+
+    size_t restart = 0;
+    int line = 1;
+    if (keep > 0) {
+        restart = static_cast<size_t>(tokens.offset(keep - 1)) + tokens.length(keep - 1);
+        line = tokens.line(keep - 1);
+    }
+
+    // Offsets past the edit move by `delta`.
+    size_t newEditEnd = edit.offset + edit.inserted.size();
+    long delta = static_cast<long>(edit.inserted.size()) - static_cast<long>(edit.removed);
+
+    TokenBuffer scanned(source);
+    Scanner scanner(source, restart, line);
+    for (;;) {
+        Token token = scanner.scanToken();
+        size_t offset = scanner.tokenStart();
+        uint32_t length = static_cast<uint32_t>(scanner.position() - offset);
+
+        if (offset >= newEditEnd) {
+            size_t oldOffset = static_cast<size_t>(static_cast<long>(offset) - delta);
+            size_t resume = tokens.lowerBound(oldOffset);
+            if (resume < tokens.size() && tokens.offset(resume) == oldOffset) {
+                int lineDelta = token.line - tokens.line(resume);
+                tokens.splice(keep, resume, scanned, delta, lineDelta, source);
+                return scanned.size();
+            }
+        }
+
+        if (token.type == TokenType::ERROR) {
+            scanned.pushError(token.lexeme.data(), static_cast<uint32_t>(offset), length, token.line);
+        } else {
+            scanned.push(token.type, static_cast<uint32_t>(offset), length, token.line);
+        }
+
+        // END_OF_FILE always lines up with the old one; this only runs for
+        // an edit that does not match the old source.
+        if (token.type == TokenType::END_OF_FILE) {
+            tokens.splice(keep, tokens.size(), scanned, 0, 0, source);
+            return scanned.size();
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef INCREMENTAL_SCAN_HPP
+#define INCREMENTAL_SCAN_HPP
+
+#include "scanner.hpp"
+#include <string_view>
+
+// One text edit: `removed` bytes at `offset` of the old source were
+// replaced by `inserted`.
+struct SourceEdit {
+    size_t offset;
+    size_t removed;
+    std::string_view inserted;
+};
+
+// Bring `tokens` (a tokenization of the old source) up to date with
+// `source`, which is the old source with `edit` applied. Afterwards
+// `tokens` equals tokenize(source).
+//
+// Scanning restarts at the end of the last token the edit cannot affect
+// and stops as soon as a new token starts where an old token past the edit
+// started: from there on the text and the scanner state are the same, so
+// the old tokens are kept, moved by the size of the edit. An edit that
+// opens or closes a string keeps scanning until the token streams line up
+// again. Returns the number of tokens scanned.
+size_t retokenize(TokenBuffer& tokens, std::string_view source, const SourceEdit& edit);
+
+#endif // INCREMENTAL_SCAN_HPP
@@ -0,0 +1,418 @@
+#include "ir.hpp"
+#include "object.hpp"
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+// ---- Helpers ----
+
+StaticType staticTypeOf(Value value) {
+    switch (value.type) {
+        case ValueType::VAL_BOOL:   return StaticType::BOOL;
+        case ValueType::VAL_NIL:    return StaticType::NIL;
+        case ValueType::VAL_NUMBER: return StaticType::NUMBER;
+        case ValueType::VAL_OBJ:
+            return IS_STRING(value) ? StaticType::STRING : StaticType::UNKNOWN;
+    }
+    return StaticType::UNKNOWN;
+}
+
+static StaticType inferType(const IrNode& node, const std::vector<IrNode>& nodes) {
+    switch (node.op) {
+        case OpCode::OP_CONSTANT: return staticTypeOf(node.value);
+        case OpCode::OP_NIL:      return StaticType::NIL;
+        case OpCode::OP_TRUE:
+        case OpCode::OP_FALSE:
+        case OpCode::OP_NOT:
+        case OpCode::OP_EQUAL:
+        case OpCode::OP_GREATER:
+        case OpCode::OP_LESS:     return StaticType::BOOL;
+        case OpCode::OP_NEGATE:
+        case OpCode::OP_SUBTRACT:
+        case OpCode::OP_MULTIPLY:
+        case OpCode::OP_DIVIDE:   return StaticType::NUMBER;
+        case OpCode::OP_ADD: {
+            StaticType a = nodes[node.left].type;
+            StaticType b = nodes[node.right].type;
+            if (a == StaticType::NUMBER && b == StaticType::NUMBER) return StaticType::NUMBER;
+            if (a == StaticType::STRING && b == StaticType::STRING) return StaticType::STRING;
+            return StaticType::UNKNOWN;
+        }
+        default: return StaticType::UNKNOWN;
+    }
+}
+
+static int operandCount(OpCode op) {
+    switch (op) {
+        case OpCode::OP_NOT:
+        case OpCode::OP_NEGATE:   return 1;
+        case OpCode::OP_EQUAL:
+        case OpCode::OP_GREATER:
+        case OpCode::OP_LESS:
+        case OpCode::OP_ADD:
+        case OpCode::OP_SUBTRACT:
+        case OpCode::OP_MULTIPLY:
+        case OpCode::OP_DIVIDE:   return 2;
+        default:                  return 0;
+    }
+}
+
+static uint64_t numberBits(double number) {
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    return bits;
+}
+
+// FNV-1a over the fields that identify a node.
+static uint64_t hashNode(const IrNode& node) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t word) {
+        hash ^= word;
+        hash *= 1099511628211ull;
+    };
+    mix(static_cast<uint64_t>(node.op));
+    mix(static_cast<uint64_t>(static_cast<int64_t>(node.left)));
+    mix(static_cast<uint64_t>(static_cast<int64_t>(node.right)));
+    if (node.op == OpCode::OP_CONSTANT) {
+        mix(static_cast<uint64_t>(node.value.type));
+        if (IS_NUMBER(node.value)) {
+            mix(numberBits(AS_NUMBER(node.value)));
+        } else if (IS_BOOL(node.value)) {
+            mix(AS_BOOL(node.value));
+        } else if (IS_STRING(node.value)) {
+            ObjString* string = AS_STRING(node.value);
+            for (int i = 0; i < string->length; i++) {
+                mix(static_cast<unsigned char>(string->chars[i]));
+            }
+        }
+    }
+    return hash;
+}
+
+static bool sameNode(const IrNode& a, const IrNode& b) {
+    if (a.op != b.op || a.left != b.left || a.right != b.right) return false;
+    if (a.op != OpCode::OP_CONSTANT) return true;
+    if (a.value.type != b.value.type) return false;
+    // Compare numbers bitwise so that 0 and -0 stay distinct.
+    if (IS_NUMBER(a.value)) {
+        return numberBits(AS_NUMBER(a.value)) == numberBits(AS_NUMBER(b.value));
+    }
+    return valuesEqual(a.value, b.value);
+}
+
+static bool isFalsey(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// ---- Building ----
+
+int ExprGraph::intern(const IrNode& node) {
+    uint64_t hash = hashNode(node);
+    auto range = interned_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (sameNode(nodes_[it->second], node)) return it->second;
+    }
+
+    IrNode added = node;
+    added.type = inferType(node, nodes_);
+    nodes_.push_back(added);
+    int id = static_cast<int>(nodes_.size() - 1);
+    interned_.emplace(hash, id);
+    return id;
+}
+
+int ExprGraph::makeConstant(Value value, int line) {
+    IrNode node{OpCode::OP_CONSTANT, StaticType::UNKNOWN, value, -1, -1, line};
+    // Keep literals that have dedicated opcodes out of the constant pool.
+    if (IS_NIL(value)) node.op = OpCode::OP_NIL;
+    if (IS_BOOL(value)) node.op = AS_BOOL(value) ? OpCode::OP_TRUE : OpCode::OP_FALSE;
+    if (node.op != OpCode::OP_CONSTANT) node.value = NIL_VAL();
+    return intern(node);
+}
+
+void ExprGraph::constant(Value value, int line) {
+    stack_.push_back(makeConstant(value, line));
+}
+
+void ExprGraph::apply(OpCode op, int line) {
+    IrNode node{op, StaticType::UNKNOWN, NIL_VAL(), -1, -1, line};
+    int operands = operandCount(op);
+
+    // After a parse error the stack may be short; the compiler discards
+    // the graph in that case, so just keep it consistent.
+    if (static_cast<int>(stack_.size()) < operands) return;
+
+    if (operands == 2) {
+        node.right = stack_.back(); stack_.pop_back();
+        node.left = stack_.back(); stack_.pop_back();
+    } else if (operands == 1) {
+        node.left = stack_.back(); stack_.pop_back();
+    }
+    stack_.push_back(intern(node));
+}
+
+bool ExprGraph::isConstant(int id) const {
+    switch (nodes_[id].op) {
+        case OpCode::OP_CONSTANT:
+        case OpCode::OP_NIL:
+        case OpCode::OP_TRUE:
+        case OpCode::OP_FALSE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ExprGraph::isNumberConstant(int id, double number) const {
+    const IrNode& node = nodes_[id];
+    return node.op == OpCode::OP_CONSTANT && IS_NUMBER(node.value) &&
+           numberBits(AS_NUMBER(node.value)) == numberBits(number);
+}
+
+// ---- Passes ----
+
+void ExprGraph::rewrite(RewriteFn rule) {
+    // Nodes are stored in topological order (operands before users), so a
+    // single forward sweep sees every operand's replacement first. New
+    // nodes appended by the rule are already in rewritten form.
+    size_t count = nodes_.size();
+    std::vector<int> replacement(count);
+    for (size_t id = 0; id < count; id++) {
+        IrNode node = nodes_[id];
+        if (node.left >= 0) node.left = replacement[node.left];
+        if (node.right >= 0) node.right = replacement[node.right];
+        replacement[id] = (this->*rule)(node);
+    }
+    for (int& entry : stack_) entry = replacement[entry];
+}
+
+static Value literalValue(const IrNode& node) {
+    switch (node.op) {
+        case OpCode::OP_NIL:   return NIL_VAL();
+        case OpCode::OP_TRUE:  return BOOL_VAL(true);
+        case OpCode::OP_FALSE: return BOOL_VAL(false);
+        default:               return node.value;
+    }
+}
+
+// Evaluate operators whose operands are all compile-time constants.
+// Only folds operations that cannot fail at runtime, so runtime errors
+// (and their messages) are preserved.
+int ExprGraph::foldConstants(const IrNode& node) {
+    int operands = operandCount(node.op);
+    if (operands == 0) return intern(node);
+    if (!isConstant(node.left)) return intern(node);
+    if (operands == 2 && !isConstant(node.right)) return intern(node);
+
+    Value a = literalValue(nodes_[node.left]);
+    Value b = operands == 2 ? literalValue(nodes_[node.right]) : NIL_VAL();
+    bool numbers = IS_NUMBER(a) && IS_NUMBER(b);
+
+    switch (node.op) {
+        case OpCode::OP_NOT:
+            return makeConstant(BOOL_VAL(isFalsey(a)), node.line);
+        case OpCode::OP_NEGATE:
+            if (!IS_NUMBER(a)) break;
+            return makeConstant(NUMBER_VAL(-AS_NUMBER(a)), node.line);
+        case OpCode::OP_EQUAL:
+            return makeConstant(BOOL_VAL(valuesEqual(a, b)), node.line);
+        case OpCode::OP_GREATER:
+            if (!numbers) break;
+            return makeConstant(BOOL_VAL(AS_NUMBER(a) > AS_NUMBER(b)), node.line);
+        case OpCode::OP_LESS:
+            if (!numbers) break;
+            return makeConstant(BOOL_VAL(AS_NUMBER(a) < AS_NUMBER(b)), node.line);
+        case OpCode::OP_ADD:
+            if (numbers) {
+                return makeConstant(NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b)), node.line);
+            }
+            if (IS_STRING(a) && IS_STRING(b)) {
+                ObjString* left = AS_STRING(a);
+                ObjString* right = AS_STRING(b);
+                int length = left->length + right->length;
+                char* chars = new char[length + 1];
+                memcpy(chars, left->chars, left->length);
+                memcpy(chars + left->length, right->chars, right->length);
+                chars[length] = '\0';
+                return makeConstant(
+                    OBJ_VAL(reinterpret_cast<Obj*>(takeString(chars, length))),
+                    node.line);
+            }
+            break;
+        case OpCode::OP_SUBTRACT:
+            if (!numbers) break;
+            return makeConstant(NUMBER_VAL(AS_NUMBER(a) - AS_NUMBER(b)), node.line);
+        case OpCode::OP_MULTIPLY:
+            if (!numbers) break;
+            return makeConstant(NUMBER_VAL(AS_NUMBER(a) * AS_NUMBER(b)), node.line);
+        case OpCode::OP_DIVIDE:
+            if (!numbers) break;
+            return makeConstant(NUMBER_VAL(AS_NUMBER(a) / AS_NUMBER(b)), node.line);
+        default:
+            break;
+    }
+    return intern(node);
+}
+
+// Algebraic identities that hold exactly under IEEE 754. Each requires the
+// surviving operand to be a proven number (or bool), otherwise the rewrite
+// could remove or change a runtime type error.
+//
+// Note that x + 0 is not an identity (-0 + 0 is +0), but x + -0 and x - 0 are.
+int ExprGraph::simplify(const IrNode& node) {
+    int left = node.left;
+    int right = node.right;
+    auto isNumber = [this](int id) { return nodes_[id].type == StaticType::NUMBER; };
+
+    switch (node.op) {
+        case OpCode::OP_NEGATE:
+            // --x => x
+            if (nodes_[left].op == OpCode::OP_NEGATE && isNumber(nodes_[left].left)) {
+                return nodes_[left].left;
+            }
+            break;
+        case OpCode::OP_NOT:
+            // !!x => x when x is already a bool
+            if (nodes_[left].op == OpCode::OP_NOT &&
+                nodes_[nodes_[left].left].type == StaticType::BOOL) {
+                return nodes_[left].left;
+            }
+            break;
+        case OpCode::OP_MULTIPLY:
+            // x * 1 => x, 1 * x => x
+            if (isNumberConstant(right, 1.0) && isNumber(left)) return left;
+            if (isNumberConstant(left, 1.0) && isNumber(right)) return right;
+            break;
+        case OpCode::OP_DIVIDE:
+            // x / 1 => x
+            if (isNumberConstant(right, 1.0) && isNumber(left)) return left;
+            break;
+        case OpCode::OP_ADD:
+            // x + -0 => x, -0 + x => x
+            if (isNumberConstant(right, -0.0) && isNumber(left)) return left;
+            if (isNumberConstant(left, -0.0) && isNumber(right)) return right;
+            // x + -y => x - y
+            if (nodes_[right].op == OpCode::OP_NEGATE && isNumber(left) &&
+                isNumber(nodes_[right].left)) {
+                IrNode rewritten = node;
+                rewritten.op = OpCode::OP_SUBTRACT;
+                rewritten.right = nodes_[right].left;
+                return intern(rewritten);
+            }
+            break;
+        case OpCode::OP_SUBTRACT:
+            // x - 0 => x
+            if (isNumberConstant(right, 0.0) && isNumber(left)) return left;
+            // x - -y => x + y
+            if (nodes_[right].op == OpCode::OP_NEGATE && isNumber(left) &&
+                isNumber(nodes_[right].left)) {
+                IrNode rewritten = node;
+                rewritten.op = OpCode::OP_ADD;
+                rewritten.right = nodes_[right].left;
+                return intern(rewritten);
+            }
+            break;
+        default:
+            break;
+    }
+    return intern(node);
+}
+
+// Replace expensive operators with cheaper equivalents.
+int ExprGraph::reduceStrength(const IrNode& node) {
+    if (node.op == OpCode::OP_DIVIDE) {
+        // x / 2^k => x * 2^-k. Exact because the reciprocal of a power of
+        // two is itself representable.
+        const IrNode& divisor = nodes_[node.right];
+        if (divisor.op == OpCode::OP_CONSTANT && IS_NUMBER(divisor.value)) {
+            double d = AS_NUMBER(divisor.value);
+            int exponent;
+            double mantissa = std::frexp(d, &exponent);
+            double reciprocal = 1.0 / d;
+            if (std::isfinite(d) && (mantissa == 0.5 || mantissa == -0.5) &&
+                std::isnormal(reciprocal)) {
+                IrNode rewritten = node;
+                rewritten.op = OpCode::OP_MULTIPLY;
+                rewritten.right = makeConstant(NUMBER_VAL(reciprocal), divisor.line);
+                return intern(rewritten);
+            }
+        }
+    }
+    return intern(node);
+}
+
+// Drop nodes no longer reachable from the stack and renumber the rest.
+void ExprGraph::eliminateDeadNodes() {
+    std::vector<bool> live(nodes_.size(), false);
+    for (int id : stack_) live[id] = true;
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        if (!live[i]) continue;
+        if (nodes_[i].left >= 0) live[nodes_[i].left] = true;
+        if (nodes_[i].right >= 0) live[nodes_[i].right] = true;
+    }
+
+    std::vector<int> renumber(nodes_.size(), -1);
+    std::vector<IrNode> kept;
+    interned_.clear();
+    for (size_t i = 0; i < nodes_.size(); i++) {
+        if (!live[i]) continue;
+        IrNode node = nodes_[i];
+        if (node.left >= 0) node.left = renumber[node.left];
+        if (node.right >= 0) node.right = renumber[node.right];
+        renumber[i] = static_cast<int>(kept.size());
+        interned_.emplace(hashNode(node), renumber[i]);
+        kept.push_back(node);
+    }
+    nodes_ = std::move(kept);
+    for (int& entry : stack_) entry = renumber[entry];
+}
+
+void ExprGraph::optimize(int level) {
+    if (level <= 0 || stack_.empty()) return;
+
+    if (level >= 2) rewrite(&ExprGraph::foldConstants);
+    rewrite(&ExprGraph::simplify);
+    if (level >= 2) rewrite(&ExprGraph::reduceStrength);
+    eliminateDeadNodes();
+}
+
+// ---- Output ----
+
+bool ExprGraph::linearize(Chunk& chunk) const {
+    if (stack_.empty()) return true;
+
+    // Shared constant nodes share one pool slot.
+    std::vector<int> constantSlot(nodes_.size(), -1);
+
+    // Iterative post-order walk; a stack machine has no temporaries, so a
+    // shared subexpression is re-emitted at each use.
+    std::vector<std::pair<int, bool>> work;
+    work.push_back({root(), false});
+    while (!work.empty()) {
+        auto [id, expanded] = work.back();
+        work.pop_back();
+        const IrNode& node = nodes_[id];
+
+        if (!expanded) {
+            work.push_back({id, true});
+            if (node.right >= 0) work.push_back({node.right, false});
+            if (node.left >= 0) work.push_back({node.left, false});
+            continue;
+        }
+
+        // Specialize operators whose operands are proven numbers.
+        OpCode op = node.op;
+        if (node.left >= 0 && nodes_[node.left].type == StaticType::NUMBER &&
+            (node.right < 0 || nodes_[node.right].type == StaticType::NUMBER)) {
+            op = uncheckedNumberOp(op);
+        }
+
+        chunk.write(static_cast<uint8_t>(op), node.line);
+        if (node.op == OpCode::OP_CONSTANT) {
+            if (constantSlot[id] < 0) constantSlot[id] = chunk.addConstant(node.value);
+            if (constantSlot[id] > UINT8_MAX) return false;
+            chunk.write(static_cast<uint8_t>(constantSlot[id]), node.line);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef IR_HPP
+#define IR_HPP
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include "value.hpp"
+#include <unordered_map>
+#include <vector>
+
+// Static type of an expression, assuming its evaluation succeeds.
+// UNKNOWN means the operands do not pin the result down (or it will
+// raise a runtime error).
+enum class StaticType {
+    UNKNOWN,
+    NIL,
+    BOOL,
+    NUMBER,
+    STRING,
+};
+
+// One node of the expression DAG. Operators reuse the VM's OpCode so the
+// linearizer emits one instruction per use of a node.
+struct IrNode {
+    OpCode op;
+    StaticType type;
+    Value value;    // Payload for OP_CONSTANT nodes
+    int left;       // Operand node ids, -1 when unused
+    int right;
+    int line;
+};
+
+// Typed, hash-consed expression DAG sitting between the Pratt parser and
+// bytecode emission (optional, enabled by a non-zero optimization level).
+//
+// The compiler feeds it the same opcode stream it would otherwise write to
+// the chunk; the graph keeps a symbolic operand stack and turns each opcode
+// into a node. Structurally identical subexpressions are interned to one
+// node, so the passes see (and rewrite) each of them once. A stack machine
+// has no temporaries, though: linearize() re-emits a shared node at every
+// use, and only shared constants end up sharing a pool slot.
+class ExprGraph {
+public:
+    // ---- Building ----
+
+    // Push a constant leaf.
+    void constant(Value value, int line);
+
+    // Apply an operator to the operands on top of the symbolic stack.
+    void apply(OpCode op, int line);
+
+    // ---- Optimization ----
+
+    // Level 1: algebraic simplification and dead-node elimination.
+    // Level 2: also constant folding and strength reduction.
+    void optimize(int level);
+
+    // ---- Output ----
+
+    // Emit the expression rooted at the top of the stack into `chunk`
+    // (without the trailing OP_RETURN). Returns false if the chunk ran out
+    // of constant slots.
+    bool linearize(Chunk& chunk) const;
+
+    bool empty() const { return stack_.empty(); }
+    int root() const { return stack_.back(); }
+    const IrNode& node(int id) const { return nodes_[id]; }
+    size_t nodeCount() const { return nodes_.size(); }
+
+private:
+    using RewriteFn = int (ExprGraph::*)(const IrNode& node);
+
+    int intern(const IrNode& node);
+    int makeConstant(Value value, int line);
+    bool isConstant(int id) const;
+    bool isNumberConstant(int id, double number) const;
+
+    // Rebuild the graph bottom-up, replacing each node by `rule(node)`.
+    void rewrite(RewriteFn rule);
+
+    // Passes (each returns the id of the node replacing `node`)
+    int foldConstants(const IrNode& node);
+    int simplify(const IrNode& node);
+    int reduceStrength(const IrNode& node);
+    void eliminateDeadNodes();
+
+    std::vector<IrNode> nodes_;
+    std::vector<int> stack_;
+    std::unordered_multimap<uint64_t, int> interned_;
+};
+
+// Type of a value known at compile time.
+StaticType staticTypeOf(Value value);
+
+#endif // IR_HPP
@@ -0,0 +1,22 @@
+#include "line_index.hpp"
+#include "scan_kernels.hpp"
+#include <algorithm>
+
+void LineIndex::build() const {
+    const char* begin = source_.data();
+    const char* end = begin + source_.size();
+
+    newlines_.reserve(countNewlines(begin, end));
+    for (const char* p = findNewline(begin, end); p < end; p = findNewline(p + 1, end)) {
+        newlines_.push_back(static_cast<size_t>(p - begin));
+    }
+    built_ = true;
+}
+
+int LineIndex::line(size_t offset) const {
+    if (!built_) build();
+
+    // Newlines strictly before `offset`, plus one
+    auto before = std::lower_bound(newlines_.begin(), newlines_.end(), offset);
+    return static_cast<int>(before - newlines_.begin()) + 1;
+}
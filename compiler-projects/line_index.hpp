@@ -0,0 +1,29 @@
+#ifndef LINE_INDEX_HPP
+#define LINE_INDEX_HPP
+
+#include <string_view>
+#include <vector>
+
+// Maps byte offsets in a source to 1-based line numbers.
+//
+// Used with LineMode::LAZY, where nothing counts lines while scanning and
+// offsets are only turned into lines when a diagnostic is printed. The
+// index of newline offsets is built (with the vectorized newline kernels)
+// on the first lookup, so a source that never errors never pays for it.
+class LineIndex {
+public:
+    explicit LineIndex(std::string_view source) : source_(source) {}
+
+    // Line containing byte `offset` (offsets past the end map to the last
+    // line).
+    int line(size_t offset) const;
+
+private:
+    void build() const;
+
+    std::string_view source_;
+    mutable bool built_ = false;
+    mutable std::vector<size_t> newlines_;   // Offsets of every '\n'
+};
+
+#endif // LINE_INDEX_HPP
@@ -1,43 +1,158 @@
 // Main entry point for the Lox interpreter
 // Supports multiple modes:
 //   ./clox                  - Interactive REPL
-//   ./clox <file>           - Execute a .lox file
+//   ./clox <file>           - Execute a .lox file (or a precompiled .loxc)
+//   ./clox --compile-only [-o out.loxc] <file>
+//                           - Compile a .lox file to bytecode without running it
 //   ./clox --demo           - Run demo: compile & execute a sample expression
 //   ./clox --scan [file]    - Scan-only mode (print tokens without compiling)
 //   ./clox --debug [file]   - Debug mode (verbose output through compiler)
+//   ./clox --decode-trace <trace> <file>
+//                           - Print a saved trace of <file>, disassembled
 //   ./clox --test           - Run built-in self-tests
 //   ./clox --help           - Show usage
+//
+// Global options (before the mode):
+//   --opt-level <n>         - Compiler optimization level (0-2, default 0)
+//   --scan-threads <n>      - Tokenize --scan input on n threads (0 = all)
+//   --profile <text|json>   - Print an opcode profile to stderr on exit
+//   --trace <out>           - Save a binary instruction trace to <out> on exit
+//                             (render it with --decode-trace <out> <file>)
+//   --sample <out>          - Sample the running source line every 1ms of
+//                             CPU time; save folded stacks to <out> on exit
+//   --stats                 - Print the VM's memory statistics and phase
+//                             timings to stderr on exit
 
 #include "common.hpp"
+#include "bytecode_file.hpp"
 #include "compiler.hpp"
+#include "object.hpp"
+#include "parallel_scan.hpp"
+#include "profiler.hpp"
+#include "sampler.hpp"
 #include "scanner.hpp"
+#include "source_file.hpp"
+#include "trace.hpp"
 #include "vm.hpp"
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <iomanip>
-#include <sstream>
+#include <memory>
 #include <string>
 
+// ---- Global options ----
+
+static int optLevel = 0;
+static int scanThreads = -1;    // -1: single-threaded Scanner
+
+enum class ProfileFormat { NONE, TEXT, JSON };
+static ProfileFormat profileFormat = ProfileFormat::NONE;
+static const char* tracePath = nullptr;
+static const char* samplePath = nullptr;
+static bool printStats = false;
+
+// ---- Profiling, tracing, sampling and statistics ----
+
+static OpcodeProfile profile;
+static std::unique_ptr<TraceBuffer> trace;     // Only allocated with --trace
+static std::unique_ptr<SamplingProfiler> sampler;   // Only allocated with --sample
+static const char* sampleRoot = nullptr;
+
+// `name` (the file, or "repl") is the root frame of --sample's stacks.
+static void instrument(VM& vm, const char* name) {
+    vm.setPhaseTiming(printStats);
+    if (profileFormat != ProfileFormat::NONE) vm.setProfile(&profile);
+    if (tracePath != nullptr) {
+        trace.reset(new TraceBuffer());
+        vm.setTrace(trace.get());
+    }
+    if (samplePath != nullptr) {
+        sampler.reset(new SamplingProfiler());
+        sampleRoot = name;
+        vm.setSampling(true);
+        if (!sampler->start()) exit(71);
+    }
+}
+
+static void printHeap(const char* name, const HeapStats& heap) {
+    fprintf(stderr, "%-14s %8zu objects %10zu bytes live %10zu peak %8llu allocated\n", name,
+            heap.liveObjectCount(), heap.liveByteCount(), heap.peakBytes,
+            static_cast<unsigned long long>(heap.allocations));
+    for (int type = 0; type < OBJ_TYPE_COUNT; type++) {
+        fprintf(stderr, "  %-12s %8zu objects %10zu bytes\n",
+                objTypeName(static_cast<ObjType>(type)), heap.liveObjects[type],
+                heap.liveBytes[type]);
+    }
+}
+
+static void printChunk(const char* name, const ChunkMemory& memory) {
+    fprintf(stderr, "%-14s %8zu code %8zu lines %8zu constants %10zu bytes\n", name,
+            memory.code, memory.lines, memory.constants, memory.total());
+}
+
+static void printVMStats(const VMStats& stats) {
+    fprintf(stderr, "== VM stats ==\n");
+    printHeap("heap", stats.heap);
+    fprintf(stderr, "%-14s %8llu ops     %10llu bytes copied\n", "concatenation",
+            static_cast<unsigned long long>(stats.concatenations),
+            static_cast<unsigned long long>(stats.concatenatedBytes));
+    printChunk("last chunk", stats.chunk);
+    printChunk("builder", stats.builder);
+    if (stats.cachedChunkCount > 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "cache (%zu)", stats.cachedChunkCount);
+        printChunk(name, stats.cachedChunks);
+        printHeap("cache heap", stats.cacheHeap);
+    }
+}
+
+// Called on every exit after instrument(), including failed runs.
+static void finishInstruments(const VM& vm) {
+    fflush(stdout);     // Keep the reports after the program's output
+    if (printStats) {
+        printVMStats(vm.stats());
+        vm.phaseTimings().print(stderr);
+    }
+    if (profileFormat == ProfileFormat::TEXT) profile.print(stderr);
+    if (profileFormat == ProfileFormat::JSON) profile.printJson(stderr);
+    if (tracePath != nullptr && !writeTrace(*trace, tracePath)) {
+        fprintf(stderr, "Could not write trace \"%s\".\n", tracePath);
+    }
+    if (samplePath != nullptr) {
+        sampler->stop();
+        if (sampler->dropped() > 0) {
+            fprintf(stderr, "Sample buffer full: %llu samples dropped.\n",
+                    static_cast<unsigned long long>(sampler->dropped()));
+        }
+        if (!sampler->writeFolded(samplePath, sampleRoot)) {
+            fprintf(stderr, "Could not write samples \"%s\".\n", samplePath);
+        }
+    }
+}
+
 // ---- File reading ----
 
-static std::string readFile(const char* path) {
-    std::ifstream file(path);
-    if (!file) {
+// Maps the file when possible; Scanner and VM work on the mapping directly.
+static void loadFile(const char* path, SourceFile& file) {
+    if (!file.open(path)) {
         fprintf(stderr, "Could not open file \"%s\".\n", path);
         exit(74);
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
 }
 
 // ---- REPL ----
 
+// Interactive sessions often re-enter the same expression.
+static const size_t REPL_CACHE_CAPACITY = 64;
+
 static void repl() {
     VM vm;
+    vm.setOptLevel(optLevel);
+    vm.setCacheCapacity(REPL_CACHE_CAPACITY);
+    instrument(vm, "repl");
     std::string line;
 
     printf("clox REPL (Chapter 19 - Strings)\n");
@@ -53,39 +168,130 @@ static void repl() {
 
         vm.interpret(line);
     }
+    finishInstruments(vm);
 }
 
 // ---- File execution ----
 
 static void runFile(const char* path) {
-    std::string source = readFile(path);
+    SourceFile file;
+    loadFile(path, file);
 
     VM vm;
-    InterpretResult result = vm.interpret(std::string_view(source));
+    vm.setOptLevel(optLevel);
+    instrument(vm, path);
+    InterpretResult result;
+    if (isBytecode(file.text())) {
+        // Runs straight from the mapping; nothing is scanned or compiled.
+        BytecodeFile bytecode;
+        uint64_t start = phaseClock();
+        bool loaded = bytecode.load(file.text());
+        if (printStats) vm.phaseTimings().record(Phase::VERIFY, phaseClock() - start);
+        if (!loaded) {
+            fprintf(stderr, "Invalid bytecode file \"%s\": %s.\n", path, bytecode.error());
+            finishInstruments(vm);
+            exit(65);
+        }
+        result = vm.interpret(bytecode.chunk());
+    } else {
+        result = vm.interpret(file.text());
+    }
+    finishInstruments(vm);
 
     if (result == InterpretResult::INTERPRET_COMPILE_ERROR) exit(65);
     if (result == InterpretResult::INTERPRET_RUNTIME_ERROR) exit(70);
 }
 
-// ---- Scan-only mode (original scanner behavior) ----
+// ---- Compile-only mode ----
 
-static void runScanner(std::string_view source) {
-    Scanner scanner(source);
+// `output` defaults to the input path with a "c" appended (x.lox -> x.loxc).
+static void compileFile(const char* path, const char* output) {
+    SourceFile file;
+    loadFile(path, file);
 
-    int line = -1;
-    for (;;) {
-        Token token = scanner.scanToken();
+    std::string defaultOutput = std::string(path) + "c";
+    if (output == nullptr) output = defaultOutput.c_str();
 
-        if (token.line != line) {
-            std::cout << std::setw(4) << token.line << " ";
-            line = token.line;
-        } else {
-            std::cout << "   | ";
+    // Line numbers, not offsets: the source is not around at run time.
+    Chunk chunk;
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    bool compiled = compile(file.text(), chunk, optLevel);
+    setObjectList(nullptr);
+
+    bool written = compiled && writeBytecode(chunk, output);
+    freeObjects(objects);
+
+    if (!compiled) exit(65);
+    if (!written) {
+        fprintf(stderr, "Could not write file \"%s\".\n", output);
+        exit(74);
+    }
+}
+
+// ---- Trace decoding ----
+
+// `path` must be the program that was traced, compiled with the same
+// --opt-level; runs of any other chunk are printed without disassembly.
+static void decodeTrace(const char* tracedPath, const char* path) {
+    std::vector<TraceRecord> records;
+    if (!readTrace(tracedPath, records)) exit(65);
+
+    SourceFile file;
+    loadFile(path, file);
+
+    BytecodeFile bytecode;
+    CompiledChunk compiled;
+    Obj* objects = nullptr;
+    const CompiledChunk* chunk = &compiled;
+    if (isBytecode(file.text())) {
+        if (!bytecode.load(file.text())) {
+            fprintf(stderr, "Invalid bytecode file \"%s\": %s.\n", path, bytecode.error());
+            exit(65);
         }
+        chunk = &bytecode.chunk();
+    } else {
+        Chunk builder;
+        setObjectList(&objects);
+        bool ok = compile(file.text(), builder, optLevel);
+        setObjectList(nullptr);
+        if (!ok) exit(65);
+        builder.freeze(compiled);
+    }
+
+    printTrace(records, *chunk);
+    freeObjects(objects);
+}
+
+// ---- Scan-only mode (original scanner behavior) ----
 
-        std::cout << std::setw(16) << std::left << tokenTypeName(token.type)
-                  << " '" << token.lexeme << "'" << std::endl;
+static void printToken(const Token& token, int& line) {
+    if (token.line != line) {
+        std::cout << std::setw(4) << token.line << " ";
+        line = token.line;
+    } else {
+        std::cout << "   | ";
+    }
+
+    std::cout << std::setw(16) << std::left << tokenTypeName(token.type)
+              << " '" << token.lexeme << "'" << std::endl;
+}
+
+// `mode` is ScanMode::SENTINEL when a NUL follows the source (string
+// literals, std::string and most mapped files).
+static void runScanner(std::string_view source, ScanMode mode = ScanMode::SENTINEL) {
+    int line = -1;
+
+    if (scanThreads >= 0) {
+        TokenBuffer tokens = tokenizeParallel(source, static_cast<unsigned>(scanThreads));
+        for (size_t i = 0; i < tokens.size(); i++) printToken(tokens.token(i), line);
+        return;
+    }
 
+    Scanner scanner(source, mode);
+    for (;;) {
+        Token token = scanner.scanToken();
+        printToken(token, line);
         if (token.type == TokenType::END_OF_FILE) break;
     }
 }
@@ -107,6 +313,7 @@ static void runDemo() {
     printf("Compilation + Execution:\n");
     printf("------------------------------\n");
     VM vm;
+    vm.setOptLevel(optLevel);
     InterpretResult result = vm.interpret(DEMO_SOURCE);
     printf("------------------------------\n");
     printf("Result: %s\n",
@@ -116,28 +323,31 @@ static void runDemo() {
 // ---- Debug mode ----
 
 static void runDebug(const char* path) {
-    std::string source;
+    SourceFile file;
+    std::string_view source = DEMO_SOURCE;
+    ScanMode scanMode = ScanMode::SENTINEL;
     if (path) {
-        source = readFile(path);
-    } else {
-        source = DEMO_SOURCE;
+        loadFile(path, file);
+        source = file.text();
+        if (!file.hasSentinel()) scanMode = ScanMode::BOUNDED;
     }
 
     printf("=== Debug Mode ===\n\n");
     printf("Source (%zu bytes):\n", source.size());
     printf("------------------------------\n");
-    printf("%s\n", source.c_str());
+    printf("%.*s\n", static_cast<int>(source.size()), source.data());
     printf("------------------------------\n\n");
 
     printf("Step 1: Scanner tokens\n");
     printf("------------------------------\n");
-    runScanner(source);
+    runScanner(source, scanMode);
     printf("------------------------------\n\n");
 
     printf("Step 2: Compile + Execute\n");
     printf("------------------------------\n");
     VM vm;
-    InterpretResult result = vm.interpret(std::string_view(source));
+    vm.setOptLevel(optLevel);
+    InterpretResult result = vm.interpret(source);
     printf("------------------------------\n");
     printf("Result: %s\n",
            result == InterpretResult::INTERPRET_OK ? "OK" :
@@ -327,19 +537,89 @@ static void runTests() {
 static void printUsage() {
     printf("Usage: clox [options] [file]\n\n");
     printf("Options:\n");
-    printf("  <file>           Execute a .lox source file\n");
+    printf("  <file>           Execute a .lox source file or .loxc bytecode file\n");
+    printf("  --compile-only [-o <out>] <file>\n");
+    printf("                   Write bytecode for <file> to <out> (default <file>c)\n");
     printf("  --demo           Run demo with sample expression\n");
     printf("  --scan [file]    Scan-only mode (print named tokens)\n");
     printf("  --debug [file]   Debug mode (scanner + compiler verbose output)\n");
+    printf("  --decode-trace <trace> <file>\n");
+    printf("                   Print a trace saved by --trace, disassembled against <file>\n");
     printf("  --test           Run built-in self-tests\n");
     printf("  --help           Show this help message\n");
     printf("\n");
+    printf("Global options (before any of the above):\n");
+    printf("  --opt-level <n>  Compiler optimization level (0-2, default 0)\n");
+    printf("  --scan-threads <n>  Tokenize --scan input on n threads (0 = all cores)\n");
+    printf("  --profile <text|json>\n");
+    printf("                   Print per-opcode counts and time to stderr on exit\n");
+    printf("  --trace <out>    Save a binary trace of the last executed instructions\n");
+    printf("  --sample <out>   Sample the running source line every 1ms of CPU time and\n");
+    printf("                   save folded stacks (for flamegraph.pl) to <out> on exit\n");
+    printf("  --stats          Print memory statistics and phase timings to stderr on exit\n");
+    printf("\n");
     printf("With no arguments, starts an interactive REPL.\n");
 }
 
 // ---- Main ----
 
+// More scan threads than this is a typo, not a machine.
+static const int MAX_SCAN_THREADS = 1024;
+
+// The whole of `text` as a decimal integer in [min, max]; anything else
+// exits with the usage message.
+static int parseIntOption(const char* option, const char* text, long min, long max) {
+    char* end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || errno != 0 || value < min || value > max) {
+        fprintf(stderr, "Invalid value for %s: %s (expected %ld-%ld)\n", option, text, min, max);
+        printUsage();
+        exit(64);
+    }
+    return static_cast<int>(value);
+}
+
 int main(int argc, char* argv[]) {
+    // Consume global options, then dispatch on the remaining arguments.
+    while (argc > 1 && (strcmp(argv[1], "--stats") == 0 ||
+                        strcmp(argv[1], "--opt-level") == 0 ||
+                        strcmp(argv[1], "--scan-threads") == 0 ||
+                        strcmp(argv[1], "--profile") == 0 ||
+                        strcmp(argv[1], "--trace") == 0 ||
+                        strcmp(argv[1], "--sample") == 0)) {
+        if (strcmp(argv[1], "--stats") == 0) {
+            printStats = true;
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+            continue;
+        }
+        if (argc < 3) {
+            fprintf(stderr, "%s requires a value\n", argv[1]);
+            printUsage();
+            exit(64);
+        }
+        if (strcmp(argv[1], "--opt-level") == 0) {
+            optLevel = parseIntOption(argv[1], argv[2], 0, 2);
+        } else if (strcmp(argv[1], "--scan-threads") == 0) {
+            scanThreads = parseIntOption(argv[1], argv[2], 0, MAX_SCAN_THREADS);
+        } else if (strcmp(argv[1], "--trace") == 0) {
+            tracePath = argv[2];
+        } else if (strcmp(argv[1], "--sample") == 0) {
+            samplePath = argv[2];
+        } else if (strcmp(argv[2], "text") == 0 || strcmp(argv[2], "json") == 0) {
+            profileFormat = argv[2][0] == 't' ? ProfileFormat::TEXT : ProfileFormat::JSON;
+        } else {
+            fprintf(stderr, "Unknown profile format: %s\n", argv[2]);
+            printUsage();
+            exit(64);
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
     if (argc == 1) {
         repl();
     } else if (strcmp(argv[1], "--help") == 0) {
@@ -350,13 +630,33 @@ int main(int argc, char* argv[]) {
         runTests();
     } else if (strcmp(argv[1], "--scan") == 0) {
         if (argc > 2) {
-            std::string source = readFile(argv[2]);
+            SourceFile file;
+            loadFile(argv[2], file);
             printf("Scanning %s:\n", argv[2]);
-            runScanner(source);
+            runScanner(file.text(), file.hasSentinel() ? ScanMode::SENTINEL
+                                                       : ScanMode::BOUNDED);
         } else {
             printf("Scanning sample code:\n");
             runScanner(DEMO_SOURCE);
         }
+    } else if (strcmp(argv[1], "--compile-only") == 0) {
+        const char* output = nullptr;
+        int next = 2;
+        if (argc > 3 && strcmp(argv[2], "-o") == 0) {
+            output = argv[3];
+            next = 4;
+        }
+        if (next != argc - 1) {
+            printUsage();
+            exit(64);
+        }
+        compileFile(argv[next], output);
+    } else if (strcmp(argv[1], "--decode-trace") == 0) {
+        if (argc != 4) {
+            printUsage();
+            exit(64);
+        }
+        decodeTrace(argv[2], argv[3]);
     } else if (strcmp(argv[1], "--debug") == 0) {
         runDebug(argc > 2 ? argv[2] : nullptr);
     } else if (argv[1][0] == '-') {
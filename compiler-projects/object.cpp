@@ -1,13 +1,63 @@
 #include "object.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
-// Global pointer to the active VM's object list head.
+// Pointer to the active VM's object list head.
 // Set by the VM before compilation/execution via setObjectList().
-static Obj** objectsHead = nullptr;
+// Thread-local so that VMs and compilers on different threads each link
+// their allocations into their own list.
+static thread_local Obj** objectsHead = nullptr;
+static thread_local HeapStats* heapStats = nullptr;
 
-void setObjectList(Obj** listHead) {
+void setObjectList(Obj** listHead, HeapStats* stats) {
     objectsHead = listHead;
+    heapStats = stats;
+}
+
+ScopedObjectList::ScopedObjectList(Obj** listHead, HeapStats* stats)
+    : savedHead_(objectsHead), savedStats_(heapStats) {
+    setObjectList(listHead, stats);
+}
+
+ScopedObjectList::~ScopedObjectList() {
+    setObjectList(savedHead_, savedStats_);
+}
+
+size_t HeapStats::liveObjectCount() const {
+    size_t count = 0;
+    for (int type = 0; type < OBJ_TYPE_COUNT; type++) count += liveObjects[type];
+    return count;
+}
+
+size_t HeapStats::liveByteCount() const {
+    size_t bytes = 0;
+    for (int type = 0; type < OBJ_TYPE_COUNT; type++) bytes += liveBytes[type];
+    return bytes;
+}
+
+size_t objectSize(const Obj* object) {
+    switch (object->type) {
+        case ObjType::OBJ_STRING:
+            return sizeof(ObjString) +
+                   static_cast<size_t>(reinterpret_cast<const ObjString*>(object)->length) + 1;
+    }
+    return 0;
+}
+
+const char* objTypeName(ObjType type) {
+    switch (type) {
+        case ObjType::OBJ_STRING: return "string";
+    }
+    return "unknown";
+}
+
+static void countAllocation(const Obj* object) {
+    int type = static_cast<int>(object->type);
+    heapStats->liveObjects[type]++;
+    heapStats->liveBytes[type] += objectSize(object);
+    heapStats->allocations++;
+    heapStats->peakBytes = std::max(heapStats->peakBytes, heapStats->liveByteCount());
 }
 
 // Allocate a raw Obj and link it into the VM's object list.
@@ -32,6 +82,8 @@ static ObjString* allocateString(char* chars, int length) {
         allocateObject(sizeof(ObjString), ObjType::OBJ_STRING));
     string->length = length;
     string->chars = chars;
+    // Counted once complete: the size depends on the length.
+    if (heapStats) countAllocation(&string->obj);
     return string;
 }
 
@@ -54,7 +106,13 @@ void printObject(Value value) {
     }
 }
 
-void freeObject(Obj* object) {
+void freeObject(Obj* object, HeapStats* stats) {
+    if (stats) {
+        int type = static_cast<int>(object->type);
+        stats->liveObjects[type]--;
+        stats->liveBytes[type] -= objectSize(object);
+    }
+
     switch (object->type) {
         case ObjType::OBJ_STRING: {
             ObjString* string = reinterpret_cast<ObjString*>(object);
@@ -65,11 +123,11 @@ void freeObject(Obj* object) {
     }
 }
 
-void freeObjects(Obj* objects) {
+void freeObjects(Obj* objects, HeapStats* stats) {
     Obj* object = objects;
     while (object != nullptr) {
         Obj* next = object->next;
-        freeObject(object);
+        freeObject(object, stats);
         object = next;
     }
 }
@@ -9,6 +9,8 @@ enum class ObjType {
     OBJ_STRING,
 };
 
+constexpr int OBJ_TYPE_COUNT = static_cast<int>(ObjType::OBJ_STRING) + 1;
+
 // Base object struct — every heap-allocated Lox object starts with this.
 // Objects form an intrusive linked list via `next` for GC tracking.
 struct Obj {
@@ -43,10 +45,46 @@ inline const char* AS_CSTRING(Value value) {
     return (reinterpret_cast<ObjString*>(AS_OBJ(value)))->chars;
 }
 
-// Set the global pointer to the active VM's object list head.
+// Allocation counters for the objects of one list. Bytes include the
+// object header and anything it owns (a string's characters).
+struct HeapStats {
+    size_t liveObjects[OBJ_TYPE_COUNT] = {};
+    size_t liveBytes[OBJ_TYPE_COUNT] = {};
+    size_t peakBytes = 0;       // Highest liveBytes() seen
+    uint64_t allocations = 0;   // Objects ever allocated
+
+    size_t liveObjectCount() const;
+    size_t liveByteCount() const;
+};
+
+// Set the calling thread's pointer to the active VM's object list head.
 // The VM calls this before compilation/execution so that
-// allocateObject() can link new objects into the VM's list.
-void setObjectList(Obj** listHead);
+// allocateObject() can link new objects into the VM's list. Allocations
+// are also counted in `stats`, if given; free the list with the same one.
+void setObjectList(Obj** listHead, HeapStats* stats = nullptr);
+
+// Points the calling thread at another object list for its lifetime, then
+// restores the list (and stats) that was set before. For code that
+// allocates into a list of its own (a cache entry, a Program) on behalf of
+// a caller that may have a list set.
+class ScopedObjectList {
+public:
+    ScopedObjectList(Obj** listHead, HeapStats* stats = nullptr);
+    ~ScopedObjectList();
+
+    ScopedObjectList(const ScopedObjectList&) = delete;
+    ScopedObjectList& operator=(const ScopedObjectList&) = delete;
+
+private:
+    Obj** savedHead_;
+    HeapStats* savedStats_;
+};
+
+// Bytes held by an object, as counted in HeapStats.
+size_t objectSize(const Obj* object);
+
+// Name of an object type, for reports.
+const char* objTypeName(ObjType type);
 
 // Allocate a new ObjString that copies `length` bytes from `chars`.
 ObjString* copyString(const char* chars, int length);
@@ -58,10 +96,10 @@ ObjString* takeString(char* chars, int length);
 // Print an Obj-typed Value.
 void printObject(Value value);
 
-// Free a single object.
-void freeObject(Obj* object);
+// Free a single object, uncounting it from `stats` if given.
+void freeObject(Obj* object, HeapStats* stats = nullptr);
 
 // Free all objects in the linked list starting from `objects`.
-void freeObjects(Obj* objects);
+void freeObjects(Obj* objects, HeapStats* stats = nullptr);
 
 #endif // OBJECT_HPP
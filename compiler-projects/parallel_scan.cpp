@@ -0,0 +1,130 @@
+#include "parallel_scan.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// One slice of the source and the tokens scanned from it on their own.
+// Offsets are relative to the whole source; lines count from 1 at `begin`.
+struct ScanChunk {
+    size_t begin;
+    size_t end;
+    TokenBuffer tokens;
+};
+
+// Split points just after a newline, roughly `parts` equal pieces.
+static std::vector<ScanChunk> splitAtNewlines(std::string_view source, unsigned parts) {
+    std::vector<ScanChunk> chunks;
+    size_t begin = 0;
+    for (unsigned i = 1; i < parts; i++) {
+        size_t target = std::max(begin, source.size() / parts * i);
+        size_t newline = source.find('\n', target);
+        if (newline == std::string_view::npos || newline + 1 >= source.size()) break;
+        chunks.push_back({begin, newline + 1, TokenBuffer(source)});
+        begin = newline + 1;
+    }
+    chunks.push_back({begin, source.size(), TokenBuffer(source)});
+    return chunks;
+}
+
+static void scanChunk(std::string_view source, ScanChunk& chunk) {
+    chunk.tokens.reserve((chunk.end - chunk.begin) / 5 + 1);
+    Scanner scanner(source.substr(0, chunk.end), chunk.begin, 1);
+    scanner.tokenize(chunk.tokens);
+}
+
+// An unterminated string is the only token a chunk boundary can cut short.
+static bool isOpenString(const TokenBuffer& tokens, size_t index) {
+    return tokens.type(index) == TokenType::ERROR && tokens.length(index) > 0 &&
+           tokens.source()[tokens.offset(index)] == '"';
+}
+
+static TokenBuffer mergeChunks(std::string_view source, const std::vector<ScanChunk>& chunks) {
+    size_t count = chunks.size();
+
+    // Absolute line of each chunk's first character. Every newline is
+    // counted exactly once by the scanner, so a chunk's EOF line is one
+    // more than the newlines in it.
+    std::vector<int> firstLine(count + 1, 1);
+    size_t total = 0;
+    for (size_t k = 0; k < count; k++) {
+        const TokenBuffer& tokens = chunks[k].tokens;
+        firstLine[k + 1] = firstLine[k] + tokens.line(tokens.size() - 1) - 1;
+        total += tokens.size();
+    }
+
+    TokenBuffer merged(source);
+    merged.reserve(total);
+
+    size_t k = 0;       // Chunk whose tokens are valid from index j on
+    size_t j = 0;
+    for (;;) {
+        const TokenBuffer& tokens = chunks[k].tokens;
+        size_t last = tokens.size() - 1;    // END_OF_FILE of the chunk
+        int lineDelta = firstLine[k] - 1;
+        bool open = k + 1 < count && last > j && isOpenString(tokens, last - 1);
+
+        merged.append(tokens, j, open ? last - 1 : last, lineDelta);
+        if (!open) {
+            if (k + 1 == count) {
+                merged.append(tokens, last, last + 1, lineDelta);
+                return merged;
+            }
+            k++;
+            j = 0;
+            continue;
+        }
+
+        // The string runs on into later chunks, whose own scans read its
+        // tail as code. Rescan from the opening quote until a token starts
+        // where one of their tokens does; from there they agree again.
+        size_t start = tokens.offset(last - 1);
+        int line = firstLine[k + 1] - static_cast<int>(
+            std::count(source.begin() + start, source.begin() + chunks[k].end, '\n'));
+        Scanner scanner(source, start, line);
+        for (;;) {
+            Token token = scanner.scanToken();
+            size_t offset = scanner.tokenStart();
+            uint32_t length = static_cast<uint32_t>(scanner.position() - offset);
+
+            if (token.type != TokenType::END_OF_FILE && offset > start) {
+                while (k + 1 < count && offset >= chunks[k + 1].begin) k++;
+                const TokenBuffer& candidate = chunks[k].tokens;
+                size_t index = candidate.lowerBound(offset);
+                if (index < candidate.size() && candidate.offset(index) == offset &&
+                    candidate.type(index) == token.type &&
+                    candidate.length(index) == length) {
+                    j = index;
+                    break;
+                }
+            }
+
+            if (token.type == TokenType::ERROR) {
+                merged.pushError(token.lexeme.data(), static_cast<uint32_t>(offset),
+                                 length, token.line);
+            } else {
+                merged.push(token.type, static_cast<uint32_t>(offset), length, token.line);
+            }
+            if (token.type == TokenType::END_OF_FILE) return merged;
+        }
+    }
+}
+
+TokenBuffer tokenizeParallel(std::string_view source, unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t parts = std::min<size_t>(threads, source.size() / PARALLEL_SCAN_MIN_CHUNK);
+    if (parts <= 1 || source.size() > UINT32_MAX) return tokenize(source);
+
+    std::vector<ScanChunk> chunks = splitAtNewlines(source, static_cast<unsigned>(parts));
+    if (chunks.size() == 1) return tokenize(source);
+
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < chunks.size(); k++) {
+        workers.emplace_back(scanChunk, source, std::ref(chunks[k]));
+    }
+    scanChunk(source, chunks[0]);
+    for (std::thread& worker : workers) worker.join();
+
+    return mergeChunks(source, chunks);
+}
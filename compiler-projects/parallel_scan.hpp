@@ -0,0 +1,23 @@
+#ifndef PARALLEL_SCAN_HPP
+#define PARALLEL_SCAN_HPP
+
+#include "scanner.hpp"
+#include <string_view>
+
+// Tokenize `source` on up to `threads` worker threads (0 = one per
+// hardware thread). The result is identical to tokenize(source).
+//
+// The source is cut into chunks that start right after a newline, and each
+// chunk is scanned independently as if it began between tokens. Since `//`
+// comments end at the newline, the only way a chunk can start mid-token is
+// inside a multi-line string; the merge pass detects strings left open at
+// the end of a chunk and rescans sequentially from the opening quote until
+// its token boundaries line up with a chunk's again.
+//
+// Sources smaller than PARALLEL_SCAN_MIN_CHUNK per thread use fewer
+// threads (down to a plain sequential scan).
+TokenBuffer tokenizeParallel(std::string_view source, unsigned threads = 0);
+
+constexpr size_t PARALLEL_SCAN_MIN_CHUNK = 64 * 1024;
+
+#endif // PARALLEL_SCAN_HPP
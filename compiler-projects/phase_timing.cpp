@@ -0,0 +1,98 @@
+#include "phase_timing.hpp"
+#include <algorithm>
+
+const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::SCAN:     return "scan";
+        case Phase::COMPILE:  return "compile";
+        case Phase::OPTIMIZE: return "optimize";
+        case Phase::VERIFY:   return "verify";
+        case Phase::EXECUTE:  return "execute";
+    }
+    return "unknown";
+}
+
+uint64_t phaseClockCost() {
+    // Best of several runs of back-to-back reads: the cost without
+    // preemption or cache misses.
+    static const uint64_t cost = [] {
+        const int kReads = 64;
+        uint64_t best = UINT64_MAX;
+        for (int run = 0; run < 16; run++) {
+            uint64_t start = phaseClock();
+            uint64_t end = start;
+            for (int i = 0; i < kReads; i++) end = phaseClock();
+            best = std::min(best, (end - start) / kReads);
+        }
+        return best;
+    }();
+    return cost;
+}
+
+void PhaseHistogram::add(uint64_t nanoseconds) {
+    int index = 0;
+    while (index + 1 < BUCKETS && nanoseconds >= (uint64_t{2} << index)) index++;
+    buckets_[index]++;
+    count_++;
+    total_ += nanoseconds;
+    min_ = std::min(min_, nanoseconds);
+    max_ = std::max(max_, nanoseconds);
+}
+
+uint64_t PhaseHistogram::quantile(double fraction) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (int index = 0; index < BUCKETS; index++) {
+        seen += buckets_[index];
+        if (seen >= rank) return std::min(max_, (uint64_t{2} << index) - 1);
+    }
+    return max_;
+}
+
+void PhaseTimings::clear() {
+    for (PhaseHistogram& histogram : phases_) histogram = PhaseHistogram();
+}
+
+// 1500 -> "1.5us"
+static void formatDuration(char* buffer, size_t size, uint64_t nanoseconds) {
+    if (nanoseconds < 1000) {
+        snprintf(buffer, size, "%lluns", static_cast<unsigned long long>(nanoseconds));
+    } else if (nanoseconds < 1000000) {
+        snprintf(buffer, size, "%.1fus", static_cast<double>(nanoseconds) / 1e3);
+    } else if (nanoseconds < 1000000000) {
+        snprintf(buffer, size, "%.1fms", static_cast<double>(nanoseconds) / 1e6);
+    } else {
+        snprintf(buffer, size, "%.2fs", static_cast<double>(nanoseconds) / 1e9);
+    }
+}
+
+void PhaseTimings::print(FILE* out) const {
+    fprintf(out, "== Phase timings ==\n");
+    fprintf(out, "%-10s %8s %10s %10s %10s %10s %10s\n", "phase", "count", "total", "mean",
+            "p50", "p99", "max");
+    for (int index = 0; index < PHASE_COUNT; index++) {
+        const PhaseHistogram& histogram = phases_[index];
+        if (histogram.count() == 0) continue;
+
+        char total[16], mean[16], p50[16], p99[16], max[16];
+        formatDuration(total, sizeof(total), histogram.total());
+        formatDuration(mean, sizeof(mean), histogram.total() / histogram.count());
+        formatDuration(p50, sizeof(p50), histogram.quantile(0.5));
+        formatDuration(p99, sizeof(p99), histogram.quantile(0.99));
+        formatDuration(max, sizeof(max), histogram.max());
+        fprintf(out, "%-10s %8llu %10s %10s %10s %10s %10s\n",
+                phaseName(static_cast<Phase>(index)),
+                static_cast<unsigned long long>(histogram.count()), total, mean, p50, p99, max);
+
+        fprintf(out, "   ");
+        for (int bucket = 0; bucket < PhaseHistogram::BUCKETS; bucket++) {
+            if (histogram.bucket(bucket) == 0) continue;
+            char bound[16];
+            formatDuration(bound, sizeof(bound), uint64_t{2} << bucket);
+            fprintf(out, " <%s:%llu", bound,
+                    static_cast<unsigned long long>(histogram.bucket(bucket)));
+        }
+        fprintf(out, "\n");
+    }
+}
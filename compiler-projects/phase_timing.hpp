@@ -0,0 +1,76 @@
+#ifndef PHASE_TIMING_HPP
+#define PHASE_TIMING_HPP
+
+#include "common.hpp"
+#include <chrono>
+#include <cstdio>
+
+// Where an evaluation's time goes, phase by phase.
+enum class Phase {
+    SCAN,       // Tokenizing the source
+    COMPILE,    // Parsing and emitting
+    OPTIMIZE,   // ExprGraph passes and linearization (opt level > 0)
+    VERIFY,     // Loading and checking a .loxc file
+    EXECUTE,    // VM::run()
+};
+
+constexpr int PHASE_COUNT = static_cast<int>(Phase::EXECUTE) + 1;
+
+const char* phaseName(Phase phase);
+
+// Nanoseconds on a monotonic clock.
+inline uint64_t phaseClock() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// What one phaseClock() read itself costs, in ns (measured once). Code that
+// reads the clock around many short intervals subtracts it per interval.
+uint64_t phaseClockCost();
+
+// Durations in power-of-two buckets: bucket i counts samples of
+// [2^i, 2^(i+1)) ns, bucket 0 also 0 ns.
+class PhaseHistogram {
+public:
+    static constexpr int BUCKETS = 40;     // Up to about 18 minutes
+
+    void add(uint64_t nanoseconds);
+
+    uint64_t count() const { return count_; }
+    uint64_t total() const { return total_; }
+    uint64_t min() const { return count_ == 0 ? 0 : min_; }
+    uint64_t max() const { return max_; }
+    uint64_t bucket(int index) const { return buckets_[index]; }
+
+    // Upper bound of the bucket holding the `fraction` quantile (0 to 1),
+    // clamped to max().
+    uint64_t quantile(double fraction) const;
+
+private:
+    uint64_t buckets_[BUCKETS] = {};
+    uint64_t count_ = 0;
+    uint64_t total_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+// One histogram per phase. A VM keeps one when timing is enabled (see
+// VM::setPhaseTiming()); the compiler records into it through compile().
+class PhaseTimings {
+public:
+    void record(Phase phase, uint64_t nanoseconds) {
+        phases_[static_cast<int>(phase)].add(nanoseconds);
+    }
+
+    const PhaseHistogram& phase(Phase phase) const { return phases_[static_cast<int>(phase)]; }
+
+    void clear();
+
+    // A summary line per phase that ran, then its non-empty buckets.
+    void print(FILE* out) const;
+
+private:
+    PhaseHistogram phases_[PHASE_COUNT];
+};
+
+#endif // PHASE_TIMING_HPP
@@ -0,0 +1,115 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Most frequent pairs shown by print().
+static const size_t PRINTED_PAIRS = 10;
+
+struct PairCount {
+    int first;
+    int second;
+    uint64_t count;
+};
+
+void OpcodeProfile::clear() {
+    memset(counts_, 0, sizeof(counts_));
+    memset(ticks_, 0, sizeof(ticks_));
+    memset(pairs_, 0, sizeof(pairs_));
+}
+
+uint64_t OpcodeProfile::instructions() const {
+    uint64_t total = 0;
+    for (int op = 0; op < OPCODE_COUNT; op++) total += counts_[op];
+    return total;
+}
+
+// Opcodes that ran, by time spent (then count) descending.
+static std::vector<int> sortedOpcodes(const uint64_t* counts, const uint64_t* ticks) {
+    std::vector<int> ops;
+    for (int op = 0; op < OPCODE_COUNT; op++) {
+        if (counts[op] > 0) ops.push_back(op);
+    }
+    std::sort(ops.begin(), ops.end(), [&](int a, int b) {
+        if (ticks[a] != ticks[b]) return ticks[a] > ticks[b];
+        if (counts[a] != counts[b]) return counts[a] > counts[b];
+        return a < b;
+    });
+    return ops;
+}
+
+static std::vector<PairCount> sortedPairs(const uint64_t (*pairs)[OPCODE_COUNT]) {
+    std::vector<PairCount> sorted;
+    for (int first = 0; first < OPCODE_COUNT; first++) {
+        for (int second = 0; second < OPCODE_COUNT; second++) {
+            if (pairs[first][second] > 0) {
+                sorted.push_back({first, second, pairs[first][second]});
+            }
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const PairCount& a, const PairCount& b) {
+        if (a.count != b.count) return a.count > b.count;
+        if (a.first != b.first) return a.first < b.first;
+        return a.second < b.second;
+    });
+    return sorted;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole);
+}
+
+void OpcodeProfile::print(FILE* out) const {
+    uint64_t totalCount = instructions();
+    uint64_t totalTicks = 0;
+    for (int op = 0; op < OPCODE_COUNT; op++) totalTicks += ticks_[op];
+
+    fprintf(out, "== Opcode profile: %llu instructions, %llu %s ==\n",
+            static_cast<unsigned long long>(totalCount),
+            static_cast<unsigned long long>(totalTicks), PROFILE_CLOCK_UNIT);
+    fprintf(out, "%-20s %12s %7s %14s %7s %9s\n", "opcode", "count", "%",
+            PROFILE_CLOCK_UNIT, "%", "per op");
+    for (int op : sortedOpcodes(counts_, ticks_)) {
+        fprintf(out, "%-20s %12llu %6.2f%% %14llu %6.2f%% %9.1f\n",
+                opCodeName(static_cast<OpCode>(op)),
+                static_cast<unsigned long long>(counts_[op]), percent(counts_[op], totalCount),
+                static_cast<unsigned long long>(ticks_[op]), percent(ticks_[op], totalTicks),
+                static_cast<double>(ticks_[op]) / static_cast<double>(counts_[op]));
+    }
+
+    std::vector<PairCount> pairs = sortedPairs(pairs_);
+    if (pairs.empty()) return;
+    fprintf(out, "\n%-41s %12s %7s\n", "opcode pair", "count", "%");
+    for (size_t i = 0; i < pairs.size() && i < PRINTED_PAIRS; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s -> %s",
+                 opCodeName(static_cast<OpCode>(pairs[i].first)),
+                 opCodeName(static_cast<OpCode>(pairs[i].second)));
+        fprintf(out, "%-41s %12llu %6.2f%%\n", name,
+                static_cast<unsigned long long>(pairs[i].count),
+                percent(pairs[i].count, totalCount));
+    }
+}
+
+void OpcodeProfile::printJson(FILE* out) const {
+    fprintf(out, "{\"clock\": \"%s\", \"instructions\": %llu, \"opcodes\": [",
+            PROFILE_CLOCK_UNIT, static_cast<unsigned long long>(instructions()));
+    const char* separator = "";
+    for (int op : sortedOpcodes(counts_, ticks_)) {
+        fprintf(out, "%s\n  {\"name\": \"%s\", \"count\": %llu, \"ticks\": %llu}", separator,
+                opCodeName(static_cast<OpCode>(op)),
+                static_cast<unsigned long long>(counts_[op]),
+                static_cast<unsigned long long>(ticks_[op]));
+        separator = ",";
+    }
+    fprintf(out, "\n], \"pairs\": [");
+    separator = "";
+    for (const PairCount& pair : sortedPairs(pairs_)) {
+        fprintf(out, "%s\n  {\"first\": \"%s\", \"second\": \"%s\", \"count\": %llu}", separator,
+                opCodeName(static_cast<OpCode>(pair.first)),
+                opCodeName(static_cast<OpCode>(pair.second)),
+                static_cast<unsigned long long>(pair.count));
+        separator = ",";
+    }
+    fprintf(out, "\n]}\n");
+}
@@ -0,0 +1,69 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include <cstdio>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timestamp for attributing time to instructions: TSC cycles on x86,
+// monotonic nanoseconds elsewhere (see PROFILE_CLOCK_UNIT).
+inline uint64_t profileClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000u +
+           static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+constexpr const char* PROFILE_CLOCK_UNIT = "cycles";
+#else
+constexpr const char* PROFILE_CLOCK_UNIT = "ns";
+#endif
+
+// Per-opcode execution counts and time, plus counts of adjacent opcode
+// pairs (candidates for fusion). Filled in by a VM given the profile with
+// VM::setProfile(); VMs without one run the unhooked loop and pay nothing.
+//
+// An instruction's time runs from its dispatch to the next dispatch (or
+// to the end of the run), so it includes the profiler's own clock read.
+class OpcodeProfile {
+public:
+    OpcodeProfile() { clear(); }
+
+    void clear();
+
+    void count(uint8_t op) { counts_[op]++; }
+    void countPair(uint8_t first, uint8_t second) { pairs_[first][second]++; }
+    void addTicks(uint8_t op, uint64_t ticks) { ticks_[op] += ticks; }
+
+    uint64_t count(OpCode op) const { return counts_[static_cast<int>(op)]; }
+    uint64_t ticks(OpCode op) const { return ticks_[static_cast<int>(op)]; }
+    uint64_t pairCount(OpCode first, OpCode second) const {
+        return pairs_[static_cast<int>(first)][static_cast<int>(second)];
+    }
+
+    // Instructions executed in total.
+    uint64_t instructions() const;
+
+    // Opcodes sorted by time spent, then the most frequent pairs.
+    void print(FILE* out) const;
+
+    // The same data as one JSON object (all opcodes that ran, all pairs).
+    void printJson(FILE* out) const;
+
+private:
+    uint64_t counts_[OPCODE_COUNT];
+    uint64_t ticks_[OPCODE_COUNT];
+    uint64_t pairs_[OPCODE_COUNT][OPCODE_COUNT];
+};
+
+#endif // PROFILER_HPP
@@ -0,0 +1,23 @@
+#include "program.hpp"
+#include "object.hpp"
+
+Program::~Program() {
+    freeObjects(objects_);
+}
+
+ProgramHandle Program::compile(std::string_view source, int optLevel,
+                               ParseMode parseMode) {
+    std::shared_ptr<Program> program(new Program());
+
+    Chunk chunk;
+    bool compiled;
+    {
+        ScopedObjectList objects(&program->objects_);
+        compiled = ::compile(source, chunk, optLevel, parseMode);
+    }
+
+    if (!compiled) return nullptr;
+
+    chunk.freeze(program->chunk_);
+    return program;
+}
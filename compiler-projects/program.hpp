@@ -0,0 +1,46 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include <memory>
+#include <string_view>
+
+// Forward declaration
+struct Obj;
+
+class Program;
+
+// Shared, read-only handle to a compiled program. Copies are cheap and
+// may be passed to other threads.
+using ProgramHandle = std::shared_ptr<const Program>;
+
+// An expression compiled once and run by any number of VMs at the same
+// time (see VM::interpret(const Program&)).
+//
+// The program owns the heap objects behind its constants (string
+// literals). They are on no VM's object list, are never freed while a
+// handle is alive, and are only ever read, so concurrent runs need no
+// locking. Strings a run creates go to the running VM as usual.
+class Program {
+public:
+    ~Program();
+
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    // Compile `source`. Returns nullptr if it does not compile. The
+    // thread's object list is untouched afterwards.
+    static ProgramHandle compile(std::string_view source, int optLevel = 0,
+                                 ParseMode parseMode = ParseMode::RECURSIVE);
+
+    const CompiledChunk& chunk() const { return chunk_; }
+
+private:
+    Program() = default;
+
+    CompiledChunk chunk_;
+    Obj* objects_ = nullptr;    // Constants' objects, freed with the program
+};
+
+#endif // PROGRAM_HPP
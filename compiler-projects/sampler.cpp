@@ -0,0 +1,139 @@
+#include "sampler.hpp"
+#include "debug.hpp"
+#include "line_index.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <sys/time.h>
+#include <utility>
+
+// The running profiler, and how many handlers are inside it. stop() clears
+// the first and then waits for the second to drain.
+static std::atomic<SamplingProfiler*> activeProfiler{nullptr};
+static std::atomic<int> activeHandlers{0};
+static bool handlerInstalled = false;
+
+SamplingProfiler::SamplingProfiler(size_t capacity)
+    : samples_(new Sample[capacity]), capacity_(capacity), next_(0), running_(false) {}
+
+SamplingProfiler::~SamplingProfiler() {
+    stop();
+}
+
+// Only touches atomics, the sample array and the published chunk, whose
+// line lookups neither allocate nor lock.
+void SamplingProfiler::handle(int /*signal*/) {
+    int savedErrno = errno;
+    activeHandlers.fetch_add(1, std::memory_order_seq_cst);
+
+    SamplingProfiler* profiler = activeProfiler.load(std::memory_order_seq_cst);
+    if (profiler != nullptr) {
+        uint64_t index = profiler->next_.fetch_add(1, std::memory_order_relaxed);
+        if (index < profiler->capacity_) {
+            Sample sample = {0, 0, false};
+            const CompiledChunk* chunk = sampleSite.chunk.load(std::memory_order_acquire);
+            size_t offset = sampleSite.offset.load(std::memory_order_relaxed);
+            if (chunk != nullptr && offset < chunk->count()) {
+                int line = chunk->line(offset);
+                const LineIndex* lines = sampleSite.lines.load(std::memory_order_relaxed);
+                if (lines != nullptr) line = lines->line(static_cast<size_t>(line));
+                sample = {line, chunk->code(offset), true};
+            }
+            profiler->samples_[index] = sample;
+        }
+    }
+
+    activeHandlers.fetch_sub(1, std::memory_order_seq_cst);
+    errno = savedErrno;
+}
+
+bool SamplingProfiler::start(int intervalMicros) {
+    SamplingProfiler* expected = nullptr;
+    if (!activeProfiler.compare_exchange_strong(expected, this)) {
+        fprintf(stderr, "A sampling profiler is already running.\n");
+        return false;
+    }
+
+    // The handler stays installed after stop(): a SIGPROF already in flight
+    // must not hit the default action, which terminates the process.
+    if (!handlerInstalled) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = handle;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) != 0) {
+            activeProfiler.store(nullptr);
+            fprintf(stderr, "Could not install the SIGPROF handler: %s.\n", strerror(errno));
+            return false;
+        }
+        handlerInstalled = true;
+    }
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = intervalMicros / 1000000;
+    timer.it_interval.tv_usec = intervalMicros % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        activeProfiler.store(nullptr);
+        fprintf(stderr, "Could not start the profiling timer: %s.\n", strerror(errno));
+        return false;
+    }
+    running_ = true;
+    return true;
+}
+
+void SamplingProfiler::stop() {
+    if (!running_) return;
+    running_ = false;
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    activeProfiler.store(nullptr, std::memory_order_seq_cst);
+    while (activeHandlers.load(std::memory_order_seq_cst) != 0) {
+        // A handler on another thread is finishing its sample.
+    }
+}
+
+size_t SamplingProfiler::sampleCount() const {
+    uint64_t taken = next_.load(std::memory_order_relaxed);
+    return taken < capacity_ ? static_cast<size_t>(taken) : capacity_;
+}
+
+uint64_t SamplingProfiler::dropped() const {
+    uint64_t taken = next_.load(std::memory_order_relaxed);
+    return taken > capacity_ ? taken - capacity_ : 0;
+}
+
+void SamplingProfiler::writeFolded(FILE* out, const char* root) const {
+    std::map<std::pair<int, int>, uint64_t> counts;     // (line, opcode)
+    uint64_t outside = 0;
+    for (size_t index = 0; index < sampleCount(); index++) {
+        const Sample& sample = samples_[index];
+        if (sample.inVM) {
+            counts[{sample.line, sample.opcode}]++;
+        } else {
+            outside++;
+        }
+    }
+
+    for (const auto& entry : counts) {
+        int opcode = entry.first.second;
+        fprintf(out, "%s;line %d;%s %llu\n", root, entry.first.first,
+                opcode < OPCODE_COUNT ? opCodeName(static_cast<OpCode>(opcode)) : "UNKNOWN",
+                static_cast<unsigned long long>(entry.second));
+    }
+    if (outside > 0) {
+        fprintf(out, "%s;(outside VM) %llu\n", root, static_cast<unsigned long long>(outside));
+    }
+}
+
+bool SamplingProfiler::writeFolded(const char* path, const char* root) const {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) return false;
+    writeFolded(file, root);
+    return fclose(file) == 0;
+}
@@ -0,0 +1,96 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+
+class LineIndex;
+
+// Statistical profile of where Lox programs spend their time, by source
+// line. OpcodeProfile says which opcodes are hot; this says which part of
+// the program they came from.
+//
+// While a SamplingProfiler runs, an ITIMER_PROF timer raises SIGPROF every
+// `interval` of CPU time. The handler reads the instruction the interrupted
+// thread is executing, as published by a VM with sampling enabled
+// (VM::setSampling()), and records its line and opcode. writeFolded()
+// writes the counts as folded stacks for flamegraph.pl or speedscope.
+//
+// The handler is process-wide, so only one profiler runs at a time.
+
+constexpr size_t SAMPLE_DEFAULT_CAPACITY = 1 << 20;
+constexpr int SAMPLE_DEFAULT_INTERVAL_US = 1000;
+
+struct Sample {
+    int32_t line;       // Source line of the instruction
+    uint8_t opcode;
+    bool inVM;          // False: the thread was not running a chunk
+};
+
+// What a thread's VM is executing. Written by the run loop, read by the
+// SIGPROF handler on the same thread.
+struct SampleSite {
+    std::atomic<const CompiledChunk*> chunk{nullptr};
+    std::atomic<const LineIndex*> lines{nullptr};     // Set if lines are offsets
+    std::atomic<uint32_t> offset{0};
+};
+
+// Constant-initialized, so reaching it needs no TLS init call - neither in
+// the loop nor in the handler.
+inline thread_local SampleSite sampleSite;
+
+class SamplingProfiler {
+public:
+    // Room for `capacity` samples; later ones are counted as dropped.
+    explicit SamplingProfiler(size_t capacity = SAMPLE_DEFAULT_CAPACITY);
+    ~SamplingProfiler();
+
+    SamplingProfiler(const SamplingProfiler&) = delete;
+    SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+
+    // Start sampling every `intervalMicros` of process CPU time. Returns
+    // false (with a message on stderr) if another profiler is running or
+    // the timer cannot be set up.
+    bool start(int intervalMicros = SAMPLE_DEFAULT_INTERVAL_US);
+
+    // Stop the timer and wait out any handler still running.
+    void stop();
+
+    size_t sampleCount() const;
+    const Sample& sample(size_t index) const { return samples_[index]; }
+    uint64_t dropped() const;
+
+    void clear() { next_.store(0, std::memory_order_relaxed); }
+
+    // One "<root>;line N;OP_NAME count" line per line and opcode, sorted
+    // by line, and "<root>;(outside VM) count" for samples taken while no
+    // chunk was running (compiling, loading, ...).
+    void writeFolded(FILE* out, const char* root) const;
+    bool writeFolded(const char* path, const char* root) const;
+
+    // Run loop side (see SampleHooks in vm.cpp). `lines` maps the chunk's
+    // line entries to lines when they are source offsets; it must already
+    // be built, since the handler cannot allocate.
+    static void enter(const CompiledChunk& chunk, const LineIndex* lines) {
+        sampleSite.offset.store(0, std::memory_order_relaxed);
+        sampleSite.lines.store(lines, std::memory_order_relaxed);
+        sampleSite.chunk.store(&chunk, std::memory_order_release);
+    }
+    static void at(size_t offset) {
+        sampleSite.offset.store(static_cast<uint32_t>(offset), std::memory_order_relaxed);
+    }
+    static void leave() { sampleSite.chunk.store(nullptr, std::memory_order_release); }
+
+private:
+    static void handle(int signal);
+
+    std::unique_ptr<Sample[]> samples_;
+    size_t capacity_;
+    std::atomic<uint64_t> next_;    // Samples taken, kept or not
+    bool running_;
+};
+
+#endif // SAMPLER_HPP
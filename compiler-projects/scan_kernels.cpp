@@ -0,0 +1,242 @@
+#include "scan_kernels.hpp"
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// ---- Scalar ----
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char* skipBlanksScalar(const char* p, const char* end, int& newlines) {
+    while (p < end && isBlank(*p)) {
+        if (*p == '\n') newlines++;
+        p++;
+    }
+    return p;
+}
+
+static const char* findNewlineScalar(const char* p, const char* end) {
+    while (p < end && *p != '\n') p++;
+    return p;
+}
+
+static size_t countNewlinesScalar(const char* p, const char* end) {
+    size_t count = 0;
+    for (; p < end; p++) count += *p == '\n';
+    return count;
+}
+
+#ifdef SCAN_KERNELS_X86
+
+// ---- SSE2 ----
+
+__attribute__((target("sse2")))
+static const char* skipBlanksSse2(const char* p, const char* end, int& newlines) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i newline = _mm_cmpeq_epi8(bytes, lf);
+        __m128i blank = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, cr), newline));
+
+        unsigned blankMask = static_cast<unsigned>(_mm_movemask_epi8(blank));
+        unsigned newlineMask = static_cast<unsigned>(_mm_movemask_epi8(newline));
+        if (blankMask != 0xFFFFu) {
+            unsigned stop = static_cast<unsigned>(__builtin_ctz(~blankMask));
+            newlines += __builtin_popcount(newlineMask & ((1u << stop) - 1));
+            return p + stop;
+        }
+        newlines += __builtin_popcount(newlineMask);
+        p += 16;
+    }
+    return skipBlanksScalar(p, end, newlines);
+}
+
+__attribute__((target("sse2")))
+static const char* findNewlineSse2(const char* p, const char* end) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, lf)));
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return findNewlineScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static size_t countNewlinesSse2(const char* p, const char* end) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t count = 0;
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        count += static_cast<size_t>(__builtin_popcount(
+            static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, lf)))));
+        p += 16;
+    }
+    return count + countNewlinesScalar(p, end);
+}
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2,popcnt")))
+static const char* skipBlanksAvx2(const char* p, const char* end, int& newlines) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    while (end - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i newline = _mm256_cmpeq_epi8(bytes, lf);
+        __m256i blank = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), _mm256_cmpeq_epi8(bytes, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, cr), newline));
+
+        uint32_t blankMask = static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+        uint32_t newlineMask = static_cast<uint32_t>(_mm256_movemask_epi8(newline));
+        if (blankMask != 0xFFFFFFFFu) {
+            unsigned stop = static_cast<unsigned>(__builtin_ctz(~blankMask));
+            uint32_t before = stop == 0 ? 0 : (0xFFFFFFFFu >> (32 - stop));
+            newlines += __builtin_popcount(newlineMask & before);
+            return p + stop;
+        }
+        newlines += __builtin_popcount(newlineMask);
+        p += 32;
+    }
+    return skipBlanksSse2(p, end, newlines);
+}
+
+__attribute__((target("avx2")))
+static const char* findNewlineAvx2(const char* p, const char* end) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, lf)));
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return findNewlineSse2(p, end);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t countNewlinesAvx2(const char* p, const char* end) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    while (end - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        count += static_cast<size_t>(__builtin_popcount(
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, lf)))));
+        p += 32;
+    }
+    return count + countNewlinesSse2(p, end);
+}
+
+#endif // SCAN_KERNELS_X86
+
+// ---- Dispatch ----
+
+using SkipBlanksFn = const char* (*)(const char*, const char*, int&);
+using FindNewlineFn = const char* (*)(const char*, const char*);
+using CountNewlinesFn = size_t (*)(const char*, const char*);
+
+struct KernelSet {
+    ScanKernel kernel;
+    SkipBlanksFn skipBlanks;
+    FindNewlineFn findNewline;
+    CountNewlinesFn countNewlines;
+};
+
+static bool cpuSupports(ScanKernel kernel) {
+    switch (kernel) {
+        case ScanKernel::SCALAR: return true;
+#ifdef SCAN_KERNELS_X86
+        case ScanKernel::SSE2:
+            __builtin_cpu_init();   // May run before libgcc's own constructor
+            return __builtin_cpu_supports("sse2");
+        case ScanKernel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#else
+        default:                 return false;
+#endif
+    }
+    return false;
+}
+
+// Indexed by ScanKernel. Constant-initialized, like `active` below, so
+// both are usable from any other file's static initializers.
+static constexpr KernelSet kernelSets[] = {
+    {ScanKernel::SCALAR, skipBlanksScalar, findNewlineScalar, countNewlinesScalar},
+#ifdef SCAN_KERNELS_X86
+    {ScanKernel::SSE2, skipBlanksSse2, findNewlineSse2, countNewlinesSse2},
+    {ScanKernel::AVX2, skipBlanksAvx2, findNewlineAvx2, countNewlinesAvx2},
+#endif
+};
+
+static const KernelSet* bestKernelSet() {
+    if (cpuSupports(ScanKernel::AVX2)) return &kernelSets[static_cast<int>(ScanKernel::AVX2)];
+    if (cpuSupports(ScanKernel::SSE2)) return &kernelSets[static_cast<int>(ScanKernel::SSE2)];
+    return &kernelSets[static_cast<int>(ScanKernel::SCALAR)];
+}
+
+// Chosen on first use. An atomic pointer, so selectScanKernel() may switch
+// sets while other threads (tokenizeParallel()'s workers) are scanning.
+static std::atomic<const KernelSet*> active{nullptr};
+
+static const KernelSet& activeSet() {
+    const KernelSet* set = active.load(std::memory_order_acquire);
+    if (set != nullptr) return *set;
+
+    // Racing first uses all pick the same set; keep whichever lands first.
+    const KernelSet* best = bestKernelSet();
+    return active.compare_exchange_strong(set, best, std::memory_order_acq_rel) ? *best : *set;
+}
+
+const char* skipBlanks(const char* p, const char* end, int& newlines) {
+    // Most calls sit between two tokens with nothing or a single space to
+    // skip; settle those without touching the vector units.
+    if (p < end && !isBlank(*p)) return p;
+    if (p + 1 < end && *p == ' ' && !isBlank(p[1])) return p + 1;
+    return activeSet().skipBlanks(p, end, newlines);
+}
+
+const char* findNewline(const char* p, const char* end) {
+    return activeSet().findNewline(p, end);
+}
+
+size_t countNewlines(const char* p, const char* end) {
+    return activeSet().countNewlines(p, end);
+}
+
+ScanKernel activeScanKernel() {
+    return activeSet().kernel;
+}
+
+bool selectScanKernel(ScanKernel kernel) {
+    if (!cpuSupports(kernel)) return false;
+    active.store(&kernelSets[static_cast<int>(kernel)], std::memory_order_release);
+    return true;
+}
+
+const char* scanKernelName(ScanKernel kernel) {
+    switch (kernel) {
+        case ScanKernel::SCALAR: return "scalar";
+        case ScanKernel::SSE2:   return "sse2";
+        case ScanKernel::AVX2:   return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,38 @@
+#ifndef SCAN_KERNELS_HPP
+#define SCAN_KERNELS_HPP
+
+#include <cstddef>
+
+// Vectorized inner loops for the scanner.
+//
+// Each kernel exists as a scalar version, an SSE2 version (16 bytes per
+// step) and an AVX2 version (32 bytes per step). The widest set the CPU
+// supports is picked at startup; kernels never read outside [p, end).
+
+enum class ScanKernel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// Skip spaces, tabs, carriage returns and newlines starting at `p`.
+// Returns the first other character (or `end`) and adds the number of
+// newlines skipped to `newlines`.
+const char* skipBlanks(const char* p, const char* end, int& newlines);
+
+// Return the first '\n' in [p, end), or `end` if there is none.
+const char* findNewline(const char* p, const char* end);
+
+// Number of '\n' characters in [p, end).
+size_t countNewlines(const char* p, const char* end);
+
+// Kernel set currently in use.
+ScanKernel activeScanKernel();
+
+// Force a kernel set (for tests and benchmarks). Returns false and leaves
+// the selection unchanged if the CPU does not support it.
+bool selectScanKernel(ScanKernel kernel);
+
+const char* scanKernelName(ScanKernel kernel);
+
+#endif // SCAN_KERNELS_HPP
@@ -1,22 +1,64 @@
 #include "scanner.hpp"
+#include "scan_kernels.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
 
-Scanner::Scanner(std::string_view source)
+// ---- Character classes ----
+
+enum : uint8_t {
+    CHAR_ALPHA = 1 << 0,    // a-z A-Z _
+    CHAR_DIGIT = 1 << 1,    // 0-9
+};
+
+static constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    for (int c = 'a'; c <= 'z'; c++) classes[c] = CHAR_ALPHA;
+    for (int c = 'A'; c <= 'Z'; c++) classes[c] = CHAR_ALPHA;
+    classes['_'] = CHAR_ALPHA;
+    for (int c = '0'; c <= '9'; c++) classes[c] = CHAR_DIGIT;
+    return classes;
+}
+
+static constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+
+static uint8_t charClass(char c) {
+    return charClasses[static_cast<unsigned char>(c)];
+}
+
+Scanner::Scanner(std::string_view source, ScanMode mode, LineMode lineMode)
     : source_(source)
     , start_(source_.data())
     , current_(source_.data())
-    , line_(1)
+    , line_(lineMode == LineMode::EAGER ? 1 : 0)
+    , mode_(mode)
+    , lineMode_(lineMode)
+{
+}
+
+Scanner::Scanner(std::string_view source, size_t offset, int line, ScanMode mode)
+    : source_(source)
+    , start_(source_.data() + offset)
+    , current_(source_.data() + offset)
+    , line_(line)
+    , mode_(mode)
+    , lineMode_(LineMode::EAGER)
 {
 }
 
 bool Scanner::isAlpha(char c) {
-    return (c >= 'a' && c <= 'z') ||
-           (c >= 'A' && c <= 'Z') ||
-           c == '_';
+    return charClass(c) & CHAR_ALPHA;
 }
 
 bool Scanner::isDigit(char c) {
-    return c >= '0' && c <= '9';
+    return charClass(c) & CHAR_DIGIT;
+}
+
+bool Scanner::isAlphaNumeric(char c) {
+    return charClass(c) & (CHAR_ALPHA | CHAR_DIGIT);
 }
 
 bool Scanner::isAtEnd() const {
@@ -28,19 +70,31 @@ char Scanner::advance() {
     return current_[-1];
 }
 
+// In SENTINEL mode the NUL after the source stops every loop on its own,
+// so the end pointer is only compared once a NUL has been read.
+template <bool Sentinel>
+bool Scanner::atEnd() const {
+    if (Sentinel) return *current_ == '\0' && isAtEnd();
+    return isAtEnd();
+}
+
+template <bool Sentinel>
 char Scanner::peek() const {
-    if (isAtEnd()) return '\0';
+    if (!Sentinel && isAtEnd()) return '\0';
     return *current_;
 }
 
+// Only called once peek() has returned a non-NUL character, so in SENTINEL
+// mode current_[1] is at worst the sentinel itself.
+template <bool Sentinel>
 char Scanner::peekNext() const {
-    if (current_ + 1 >= source_.data() + source_.size()) return '\0';
+    if (!Sentinel && current_ + 1 >= source_.data() + source_.size()) return '\0';
     return current_[1];
 }
 
+template <bool Sentinel>
 bool Scanner::match(char expected) {
-    if (isAtEnd()) return false;
-    if (*current_ != expected) return false;
+    if (peek<Sentinel>() != expected) return false;
     current_++;
     return true;
 }
@@ -57,101 +111,161 @@ Token Scanner::errorToken(const char* message) const {
                  line_);
 }
 
+// Whitespace runs and comment bodies are skipped by the vectorized kernels
+// in scan_kernels.cpp; only the `//` check itself is done here.
+template <bool Sentinel, bool CountLines>
 void Scanner::skipWhitespace() {
+    const char* end = source_.data() + source_.size();
     for (;;) {
-        char c = peek();
-        switch (c) {
-            case ' ':
-            case '\r':
-            case '\t':
-                advance();
-                break;
-            case '\n':
-                line_++;
-                advance();
-                break;
-            case '/':
-                if (peekNext() == '/') {
-                    // Comment goes until end of line
-                    while (peek() != '\n' && !isAtEnd()) advance();
-                } else {
-                    return;
-                }
-                break;
-            default:
-                return;
+        int newlines = 0;
+        current_ = skipBlanks(current_, end, newlines);
+        if (CountLines) line_ += newlines;
+
+        if (peek<Sentinel>() == '/' && peekNext<Sentinel>() == '/') {
+            // Comment goes until end of line
+            current_ = findNewline(current_ + 2, end);
+        } else {
+            return;
         }
     }
 }
 
-TokenType Scanner::checkKeyword(int start, int length,
-                                 std::string_view rest, TokenType type) const {
-    if (current_ - start_ == start + length &&
-        std::memcmp(start_ + start, rest.data(), length) == 0) {
-        return type;
+// ---- Keywords ----
+
+// The keyword set. Everything below is derived from this list at compile
+// time; adding a keyword means adding a line here (and its TokenType).
+struct Keyword {
+    std::string_view text;
+    TokenType type;
+};
+
+static constexpr Keyword keywords[] = {
+    {"and", TokenType::AND},       {"class", TokenType::CLASS},
+    {"else", TokenType::ELSE},     {"false", TokenType::FALSE},
+    {"for", TokenType::FOR},       {"fun", TokenType::FUN},
+    {"if", TokenType::IF},         {"nil", TokenType::NIL},
+    {"or", TokenType::OR},         {"print", TokenType::PRINT},
+    {"return", TokenType::RETURN}, {"super", TokenType::SUPER},
+    {"this", TokenType::THIS},     {"true", TokenType::TRUE},
+    {"var", TokenType::VAR},       {"while", TokenType::WHILE},
+};
+
+static constexpr size_t KEYWORD_COUNT = sizeof(keywords) / sizeof(keywords[0]);
+static constexpr size_t KEYWORD_MAX_LENGTH = 8;     // Fits one packed word
+static constexpr int KEYWORD_HASH_BITS = 6;
+static constexpr size_t KEYWORD_SLOTS = size_t{1} << KEYWORD_HASH_BITS;
+
+// Up to eight characters packed little-endian into one word, so a keyword
+// check is a single integer compare.
+static constexpr uint64_t packWord(const char* text, size_t length) {
+    uint64_t word = 0;
+    for (size_t i = 0; i < length; i++) {
+        word |= static_cast<uint64_t>(static_cast<unsigned char>(text[i])) << (8 * i);
     }
-    return TokenType::IDENTIFIER;
+    return word;
 }
 
-TokenType Scanner::identifierType() const {
-    switch (start_[0]) {
-        case 'a': return checkKeyword(1, 2, "nd", TokenType::AND);
-        case 'c': return checkKeyword(1, 4, "lass", TokenType::CLASS);
-        case 'e': return checkKeyword(1, 3, "lse", TokenType::ELSE);
-        case 'f':
-            if (current_ - start_ > 1) {
-                switch (start_[1]) {
-                    case 'a': return checkKeyword(2, 3, "lse", TokenType::FALSE);
-                    case 'o': return checkKeyword(2, 1, "r", TokenType::FOR);
-                    case 'u': return checkKeyword(2, 1, "n", TokenType::FUN);
-                }
-            }
-            break;
-        case 'i': return checkKeyword(1, 1, "f", TokenType::IF);
-        case 'n': return checkKeyword(1, 2, "il", TokenType::NIL);
-        case 'o': return checkKeyword(1, 1, "r", TokenType::OR);
-        case 'p': return checkKeyword(1, 4, "rint", TokenType::PRINT);
-        case 'r': return checkKeyword(1, 5, "eturn", TokenType::RETURN);
-        case 's': return checkKeyword(1, 4, "uper", TokenType::SUPER);
-        case 't':
-            if (current_ - start_ > 1) {
-                switch (start_[1]) {
-                    case 'h': return checkKeyword(2, 2, "is", TokenType::THIS);
-                    case 'r': return checkKeyword(2, 2, "ue", TokenType::TRUE);
-                }
-            }
-            break;
-        case 'v': return checkKeyword(1, 2, "ar", TokenType::VAR);
-        case 'w': return checkKeyword(1, 4, "hile", TokenType::WHILE);
+static constexpr uint32_t keywordHash(const char* text, size_t length, uint32_t seed) {
+    uint32_t key = static_cast<unsigned char>(text[0]) * 31u +
+                   static_cast<unsigned char>(text[length - 1]) * 7u +
+                   static_cast<uint32_t>(length);
+    uint32_t mixed = key * seed;
+    mixed ^= mixed >> 15;
+    return mixed & (KEYWORD_SLOTS - 1);
+}
+
+static constexpr bool isPerfectSeed(uint32_t seed) {
+    bool used[KEYWORD_SLOTS] = {};
+    for (const Keyword& keyword : keywords) {
+        uint32_t slot = keywordHash(keyword.text.data(), keyword.text.size(), seed);
+        if (used[slot]) return false;
+        used[slot] = true;
     }
-    return TokenType::IDENTIFIER;
+    return true;
 }
 
+// Smallest odd multiplier that sends every keyword to its own slot.
+// The search runs in the compiler; the static_assert below fires if a new
+// keyword set has none (then widen KEYWORD_HASH_BITS).
+static constexpr uint32_t findKeywordSeed() {
+    for (uint32_t seed = 1; seed < 20000; seed += 2) {
+        if (isPerfectSeed(seed)) return seed;
+    }
+    return 0;
+}
+
+static constexpr uint32_t keywordSeed = findKeywordSeed();
+static_assert(keywordSeed != 0, "No perfect hash seed for the keyword set");
+
+struct KeywordSlot {
+    uint64_t word;      // Packed keyword text, 0 for an empty slot
+    uint8_t length;
+    TokenType type;
+};
+
+static constexpr std::array<KeywordSlot, KEYWORD_SLOTS> makeKeywordSlots() {
+    std::array<KeywordSlot, KEYWORD_SLOTS> slots{};
+    for (const Keyword& keyword : keywords) {
+        uint32_t slot = keywordHash(keyword.text.data(), keyword.text.size(), keywordSeed);
+        slots[slot] = {packWord(keyword.text.data(), keyword.text.size()),
+                       static_cast<uint8_t>(keyword.text.size()), keyword.type};
+    }
+    return slots;
+}
+
+static constexpr std::array<KeywordSlot, KEYWORD_SLOTS> keywordSlots = makeKeywordSlots();
+
+static constexpr bool keywordsFitPackedWord() {
+    for (const Keyword& keyword : keywords) {
+        if (keyword.text.empty() || keyword.text.size() > KEYWORD_MAX_LENGTH) return false;
+    }
+    return true;
+}
+static_assert(keywordsFitPackedWord(), "Keywords must be 1 to 8 characters long");
+
+TokenType keywordType(std::string_view lexeme) {
+    if (lexeme.empty() || lexeme.size() > KEYWORD_MAX_LENGTH) return TokenType::IDENTIFIER;
+
+    const KeywordSlot& slot =
+        keywordSlots[keywordHash(lexeme.data(), lexeme.size(), keywordSeed)];
+    if (slot.length != lexeme.size()) return TokenType::IDENTIFIER;
+
+    uint64_t word = packWord(lexeme.data(), lexeme.size());
+    return word == slot.word ? slot.type : TokenType::IDENTIFIER;
+}
+
+TokenType Scanner::identifierType() const {
+    return keywordType(std::string_view(start_, current_ - start_));
+}
+
+template <bool Sentinel>
 Token Scanner::identifier() {
-    while (isAlpha(peek()) || isDigit(peek())) advance();
+    while (isAlphaNumeric(peek<Sentinel>())) advance();
     return makeToken(identifierType());
 }
 
+template <bool Sentinel>
 Token Scanner::number() {
-    while (isDigit(peek())) advance();
+    while (isDigit(peek<Sentinel>())) advance();
 
     // Look for fractional part
-    if (peek() == '.' && isDigit(peekNext())) {
+    if (peek<Sentinel>() == '.' && isDigit(peekNext<Sentinel>())) {
         // Consume the '.'
         advance();
-        while (isDigit(peek())) advance();
+        while (isDigit(peek<Sentinel>())) advance();
     }
 
     return makeToken(TokenType::NUMBER);
 }
 
+template <bool Sentinel, bool CountLines>
 Token Scanner::string() {
-    while (peek() != '"' && !isAtEnd()) {
-        if (peek() == '\n') line_++;
+    while (peek<Sentinel>() != '"' && !atEnd<Sentinel>()) {
+        if (CountLines && peek<Sentinel>() == '\n') line_++;
         advance();
     }
 
-    if (isAtEnd()) return errorToken("Unterminated string.");
+    if (atEnd<Sentinel>()) return errorToken("Unterminated string.");
 
     // The closing quote
     advance();
@@ -159,15 +273,25 @@ Token Scanner::string() {
 }
 
 Token Scanner::scanToken() {
-    skipWhitespace();
+    bool countLines = lineMode_ == LineMode::EAGER;
+    if (mode_ == ScanMode::SENTINEL) {
+        return countLines ? scanTokenIn<true, true>() : scanTokenIn<true, false>();
+    }
+    return countLines ? scanTokenIn<false, true>() : scanTokenIn<false, false>();
+}
+
+template <bool Sentinel, bool CountLines>
+Token Scanner::scanTokenIn() {
+    skipWhitespace<Sentinel, CountLines>();
     start_ = current_;
 
-    if (isAtEnd()) return makeToken(TokenType::END_OF_FILE);
+    if (atEnd<Sentinel>()) return makeToken(TokenType::END_OF_FILE);
 
     char c = advance();
 
-    if (isAlpha(c)) return identifier();
-    if (isDigit(c)) return number();
+    uint8_t cls = charClass(c);
+    if (cls & CHAR_ALPHA) return identifier<Sentinel>();
+    if (cls & CHAR_DIGIT) return number<Sentinel>();
 
     switch (c) {
         case '(': return makeToken(TokenType::LEFT_PAREN);
@@ -182,19 +306,160 @@ Token Scanner::scanToken() {
         case '/': return makeToken(TokenType::SLASH);
         case '*': return makeToken(TokenType::STAR);
         case '!':
-            return makeToken(match('=') ? TokenType::BANG_EQUAL : TokenType::BANG);
+            return makeToken(match<Sentinel>('=') ? TokenType::BANG_EQUAL : TokenType::BANG);
         case '=':
-            return makeToken(match('=') ? TokenType::EQUAL_EQUAL : TokenType::EQUAL);
+            return makeToken(match<Sentinel>('=') ? TokenType::EQUAL_EQUAL : TokenType::EQUAL);
         case '<':
-            return makeToken(match('=') ? TokenType::LESS_EQUAL : TokenType::LESS);
+            return makeToken(match<Sentinel>('=') ? TokenType::LESS_EQUAL : TokenType::LESS);
         case '>':
-            return makeToken(match('=') ? TokenType::GREATER_EQUAL : TokenType::GREATER);
-        case '"': return string();
+            return makeToken(match<Sentinel>('=') ? TokenType::GREATER_EQUAL : TokenType::GREATER);
+        case '"': return string<Sentinel, CountLines>();
     }
 
     return errorToken("Unexpected character.");
 }
 
+// ---- Token buffers ----
+
+void Scanner::tokenize(TokenBuffer& tokens) {
+    for (;;) {
+        Token token = scanToken();
+        uint32_t offset = static_cast<uint32_t>(tokenStart());
+        uint32_t length = static_cast<uint32_t>(position() - tokenStart());
+        if (token.type == TokenType::ERROR) {
+            tokens.pushError(token.lexeme.data(), offset, length, token.line);
+        } else {
+            tokens.push(token.type, offset, length, token.line);
+        }
+        if (token.type == TokenType::END_OF_FILE) return;
+    }
+}
+
+TokenBuffer tokenize(std::string_view source, ScanMode mode) {
+    TokenBuffer tokens(source);
+    if (source.size() > UINT32_MAX) {
+        tokens.pushError("Source too large.", 0, 0, 1);
+        tokens.push(TokenType::END_OF_FILE, 0, 0, 1);
+        return tokens;
+    }
+
+    // Roughly one token per five bytes of typical source.
+    tokens.reserve(source.size() / 5 + 1);
+    Scanner scanner(source, mode);
+    scanner.tokenize(tokens);
+    return tokens;
+}
+
+void TokenBuffer::push(TokenType type, uint32_t offset, uint32_t length, int line) {
+    types_.push_back(static_cast<uint8_t>(type));
+    offsets_.push_back(offset);
+    lengths_.push_back(length);
+    lines_.push_back(line);
+}
+
+void TokenBuffer::pushError(const char* message, uint32_t offset, uint32_t length, int line) {
+    errors_.emplace_back(size(), message);
+    push(TokenType::ERROR, offset, length, line);
+}
+
+void TokenBuffer::append(const TokenBuffer& other, size_t first, size_t last, int lineDelta) {
+    for (const auto& error : other.errors_) {
+        if (error.first >= first && error.first < last) {
+            errors_.emplace_back(size() + (error.first - first), error.second);
+        }
+    }
+    types_.insert(types_.end(), other.types_.begin() + first, other.types_.begin() + last);
+    offsets_.insert(offsets_.end(), other.offsets_.begin() + first, other.offsets_.begin() + last);
+    lengths_.insert(lengths_.end(), other.lengths_.begin() + first, other.lengths_.begin() + last);
+    size_t base = lines_.size();
+    lines_.insert(lines_.end(), other.lines_.begin() + first, other.lines_.begin() + last);
+    for (size_t i = base; i < lines_.size(); i++) lines_[i] += lineDelta;
+}
+
+// Overwrite `column[first, last)` with `with`, growing or shrinking the gap
+// first so each element after it moves at most once.
+template <typename T>
+static void replaceRange(std::vector<T>& column, size_t first, size_t last,
+                         const std::vector<T>& with) {
+    size_t count = last - first;
+    if (with.size() > count) {
+        column.insert(column.begin() + last, with.size() - count, T());
+    } else if (with.size() < count) {
+        column.erase(column.begin() + first + with.size(), column.begin() + last);
+    }
+    std::copy(with.begin(), with.end(), column.begin() + first);
+}
+
+void TokenBuffer::splice(size_t first, size_t last, const TokenBuffer& with,
+                         long offsetDelta, int lineDelta, std::string_view source) {
+    if (!errors_.empty() || !with.errors_.empty()) {
+        long countDelta = static_cast<long>(with.size()) - static_cast<long>(last - first);
+        std::vector<std::pair<size_t, const char*>> errors;
+        for (const auto& error : errors_) {
+            if (error.first < first) errors.push_back(error);
+        }
+        for (const auto& error : with.errors_) {
+            errors.emplace_back(first + error.first, error.second);
+        }
+        for (const auto& error : errors_) {
+            if (error.first >= last) errors.emplace_back(error.first + countDelta, error.second);
+        }
+        errors_.swap(errors);
+    }
+
+    replaceRange(types_, first, last, with.types_);
+    replaceRange(offsets_, first, last, with.offsets_);
+    replaceRange(lengths_, first, last, with.lengths_);
+    replaceRange(lines_, first, last, with.lines_);
+
+    for (size_t i = first + with.size(); i < size(); i++) {
+        offsets_[i] = static_cast<uint32_t>(static_cast<long>(offsets_[i]) + offsetDelta);
+    }
+    if (lineDelta != 0) {
+        for (size_t i = first + with.size(); i < size(); i++) lines_[i] += lineDelta;
+    }
+    source_ = source;
+}
+
+void TokenBuffer::reserve(size_t count) {
+    types_.reserve(count);
+    offsets_.reserve(count);
+    lengths_.reserve(count);
+    lines_.reserve(count);
+}
+
+void TokenBuffer::clear() {
+    types_.clear();
+    offsets_.clear();
+    lengths_.clear();
+    lines_.clear();
+    errors_.clear();
+}
+
+size_t TokenBuffer::lowerBound(size_t offset) const {
+    auto found = std::lower_bound(offsets_.begin(), offsets_.end(), offset,
+        [](uint32_t tokenOffset, size_t target) { return tokenOffset < target; });
+    return static_cast<size_t>(found - offsets_.begin());
+}
+
+const char* TokenBuffer::message(size_t index) const {
+    auto it = std::lower_bound(errors_.begin(), errors_.end(), index,
+        [](const std::pair<size_t, const char*>& error, size_t i) {
+            return error.first < i;
+        });
+    if (it == errors_.end() || it->first != index) return "";
+    return it->second;
+}
+
+Token TokenBuffer::token(size_t index) const {
+    TokenType tokenType = type(index);
+    if (tokenType == TokenType::ERROR) {
+        const char* text = message(index);
+        return Token(tokenType, std::string_view(text, std::strlen(text)), line(index));
+    }
+    return Token(tokenType, text(index), line(index));
+}
+
 const char* tokenTypeName(TokenType type) {
     switch (type) {
         case TokenType::LEFT_PAREN:     return "LEFT_PAREN";
@@ -240,3 +505,48 @@ const char* tokenTypeName(TokenType type) {
     }
     return "UNKNOWN";
 }
+
+double parseNumber(std::string_view lexeme) {
+    // Fast path (Clinger): when the digits fit in 53 bits and the fraction
+    // has at most 22 digits, both the mantissa and the power of ten are
+    // exact doubles, so a single correctly rounded division is exact.
+    static constexpr double kPowersOfTen[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    constexpr uint64_t kMaxExactMantissa = uint64_t{1} << 53;
+
+    uint64_t mantissa = 0;
+    int fractionDigits = 0;
+    bool inFraction = false;
+    bool fastPath = true;
+    for (char c : lexeme) {
+        if (c == '.') {
+            inFraction = true;
+            continue;
+        }
+        mantissa = mantissa * 10 + static_cast<uint64_t>(c - '0');
+        if (inFraction) fractionDigits++;
+        if (mantissa > kMaxExactMantissa || fractionDigits > 22) {
+            fastPath = false;
+            break;
+        }
+    }
+    if (fastPath) {
+        return static_cast<double>(mantissa) / kPowersOfTen[fractionDigits];
+    }
+
+    // Slow path: correctly rounded, still bounded to the lexeme.
+    double value = 0;
+    std::from_chars_result result =
+        std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+    if (result.ec == std::errc::result_out_of_range) {
+        // from_chars leaves `value` alone; saturate like strtod. Literals
+        // have no exponent, so a nonzero integer part means overflow.
+        bool overflow = std::any_of(lexeme.begin(), std::find(lexeme.begin(), lexeme.end(), '.'),
+                                    [](char c) { return c != '0'; });
+        return overflow ? HUGE_VAL : 0.0;
+    }
+    return value;
+}
@@ -1,8 +1,11 @@
 #ifndef SCANNER_HPP
 #define SCANNER_HPP
 
+#include <cstdint>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 enum class TokenType {
     // Single-character tokens
@@ -39,41 +42,150 @@ struct Token {
         : type(type), lexeme(lexeme), line(line) {}
 };
 
+// Every token of one source, stored as parallel arrays (structure of
+// arrays): type, byte offset and length into the source, and line. At 13
+// bytes per token against sizeof(Token) == 32 it keeps a whole file's
+// tokens compact, and the same buffer can feed several compile passes.
+//
+// The buffer refers to the source by view; the source must outlive it.
+// ERROR tokens span the offending source text, and their message is kept
+// on the side (see message()). The last token is always END_OF_FILE.
+class TokenBuffer {
+public:
+    TokenBuffer() = default;
+    explicit TokenBuffer(std::string_view source) : source_(source) {}
+
+    void push(TokenType type, uint32_t offset, uint32_t length, int line);
+    void pushError(const char* message, uint32_t offset, uint32_t length, int line);
+    // Append tokens [first, last) of `other`, shifting their lines by
+    // `lineDelta`. Both buffers must view the same source.
+    void append(const TokenBuffer& other, size_t first, size_t last, int lineDelta);
+    void reserve(size_t count);
+    void clear();
+
+    // Replace tokens [first, last) with all of `with`, then move the tokens
+    // after them by `offsetDelta` bytes and `lineDelta` lines, and view
+    // `source` from now on (used after an edit, see retokenize()).
+    void splice(size_t first, size_t last, const TokenBuffer& with,
+                long offsetDelta, int lineDelta, std::string_view source);
+
+    size_t size() const { return types_.size(); }
+    std::string_view source() const { return source_; }
+
+    TokenType type(size_t index) const { return static_cast<TokenType>(types_[index]); }
+    uint32_t offset(size_t index) const { return offsets_[index]; }
+    uint32_t length(size_t index) const { return lengths_[index]; }
+    int line(size_t index) const { return lines_[index]; }
+
+    // Source text of a token (also for ERROR tokens).
+    std::string_view text(size_t index) const {
+        return source_.substr(offsets_[index], lengths_[index]);
+    }
+
+    // Index of the first token starting at or after `offset` (size() if
+    // there is none).
+    size_t lowerBound(size_t offset) const;
+
+    // Message of an ERROR token.
+    const char* message(size_t index) const;
+
+    // The token as Scanner::scanToken() returned it.
+    Token token(size_t index) const;
+
+private:
+    std::string_view source_;
+    std::vector<uint8_t> types_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    std::vector<int> lines_;
+    std::vector<std::pair<size_t, const char*>> errors_;   // By token index
+};
+
+// How the scanner finds the end of the source.
+// BOUNDED compares against the end pointer on every look-ahead. SENTINEL
+// requires a NUL byte just past the source (source.data()[source.size()]
+// == '\0', as for std::string and string literals) and lets the hot loops
+// stop on that NUL without bounds checks; the end pointer is consulted only
+// when a NUL is actually seen. Both modes produce identical tokens.
+enum class ScanMode {
+    BOUNDED,
+    SENTINEL,
+};
+
+// Whether the scanner counts lines. EAGER sets Token::line on every token.
+// LAZY skips all newline bookkeeping and leaves Token::line at 0; callers
+// that need a line later turn a byte offset into one with a LineIndex.
+enum class LineMode {
+    EAGER,
+    LAZY,
+};
+
 class Scanner {
 public:
-    explicit Scanner(std::string_view source);
+    explicit Scanner(std::string_view source, ScanMode mode = ScanMode::BOUNDED,
+                     LineMode lineMode = LineMode::EAGER);
+
+    // Resume scanning at byte `offset` of `source`, which is on `line`.
+    // `offset` must be between tokens (not inside a string or comment).
+    Scanner(std::string_view source, size_t offset, int line,
+            ScanMode mode = ScanMode::BOUNDED);
 
     Token scanToken();
 
+    // Byte offsets into the source of the last token's first character and
+    // of the next character to scan.
+    size_t tokenStart() const { return static_cast<size_t>(start_ - source_.data()); }
+    size_t position() const { return static_cast<size_t>(current_ - source_.data()); }
+
+    // Scan every remaining token, through END_OF_FILE, into `tokens`.
+    void tokenize(TokenBuffer& tokens);
+
 private:
     bool isAtEnd() const;
     char advance();
-    char peek() const;
-    char peekNext() const;
-    bool match(char expected);
+
+    // Look-ahead; `Sentinel` drops the bounds checks (see ScanMode).
+    template <bool Sentinel> bool atEnd() const;
+    template <bool Sentinel> char peek() const;
+    template <bool Sentinel> char peekNext() const;
+    template <bool Sentinel> bool match(char expected);
 
     Token makeToken(TokenType type) const;
     Token errorToken(const char* message) const;
 
-    void skipWhitespace();
-    TokenType checkKeyword(int start, int length,
-                           std::string_view rest, TokenType type) const;
+    template <bool Sentinel, bool CountLines> Token scanTokenIn();
+    template <bool Sentinel, bool CountLines> void skipWhitespace();
     TokenType identifierType() const;
 
-    Token identifier();
-    Token number();
-    Token string();
+    template <bool Sentinel> Token identifier();
+    template <bool Sentinel> Token number();
+    template <bool Sentinel, bool CountLines> Token string();
 
     static bool isAlpha(char c);
     static bool isDigit(char c);
+    static bool isAlphaNumeric(char c);
 
     std::string_view source_;
     const char* start_;
     const char* current_;
     int line_;
+    ScanMode mode_;
+    LineMode lineMode_;
 };
 
+// Tokenize a whole source into a TokenBuffer. Sources must be smaller
+// than 4 GiB (offsets are 32-bit); a larger one yields a single ERROR token.
+TokenBuffer tokenize(std::string_view source, ScanMode mode = ScanMode::BOUNDED);
+
 // Utility function to get token type name (for debugging)
 const char* tokenTypeName(TokenType type);
 
+// Keyword type of an identifier lexeme, or IDENTIFIER if it is not one.
+// One perfect-hash probe and one packed-word compare.
+TokenType keywordType(std::string_view lexeme);
+
+// Value of a NUMBER token. Reads exactly the lexeme (no NUL terminator
+// needed) and is independent of the C locale.
+double parseNumber(std::string_view lexeme);
+
 #endif // SCANNER_HPP
@@ -1,6 +1,16 @@
 #include "scanner.hpp"
+#include "incremental_scan.hpp"
+#include "parallel_scan.hpp"
+#include "scan_kernels.hpp"
+#include "line_index.hpp"
+#include "source_file.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #define ASSERT_TOKEN(scanner, expected_type, expected_lexeme) do { \
     Token t = scanner.scanToken(); \
@@ -61,6 +71,20 @@ void test_keywords() {
     ASSERT_TYPE(s, TokenType::WHILE);
 }
 
+void test_keyword_type() {
+    assert(keywordType("and") == TokenType::AND);
+    assert(keywordType("return") == TokenType::RETURN);
+    assert(keywordType("while") == TokenType::WHILE);
+    // Prefixes, extensions and same-shape near misses stay identifiers
+    const char* notKeywords[] = {"a", "an", "andy", "classes", "fals", "falsy",
+                                 "fn", "fur", "iff", "nul", "prints", "thus",
+                                 "tree", "vat", "whale", "orx", "x", "_"};
+    for (const char* word : notKeywords) {
+        assert(keywordType(word) == TokenType::IDENTIFIER);
+    }
+    assert(keywordType("returning") == TokenType::IDENTIFIER);
+}
+
 void test_identifiers() {
     Scanner s("foo _bar baz123 andy classy");
     ASSERT_TOKEN(s, TokenType::IDENTIFIER, "foo");
@@ -112,10 +136,247 @@ void test_unexpected_char() {
     assert(t.lexeme == "Unexpected character.");
 }
 
+void test_parse_number() {
+    assert(parseNumber("0") == 0.0);
+    assert(parseNumber("123") == 123.0);
+    assert(parseNumber("45.67") == 45.67);
+    assert(parseNumber("3.14159") == 3.14159);
+    assert(parseNumber("0.1") == 0.1);
+    // Beyond the fast path: more than 2^53 / more than 22 fraction digits
+    assert(parseNumber("123456789012345678901234567890") == 123456789012345678901234567890.0);
+    assert(parseNumber("0.12345678901234567890123456789") == 0.12345678901234567890123456789);
+    // Only the lexeme is read, even without a terminator after it
+    assert(parseNumber(std::string_view("12345", 2)) == 12.0);
+    // Out of range saturates like strtod: to infinity, or to zero
+    assert(parseNumber("1" + std::string(400, '0')) == HUGE_VAL);
+    assert(parseNumber("1" + std::string(400, '0') + ".5") == HUGE_VAL);
+    assert(parseNumber("0." + std::string(400, '0') + "1") == 0.0);
+}
+
+// The batch API must record exactly what scanToken() returns.
+void test_tokenize() {
+    std::string source = "var x = 1.5; // c\nprint \"a\nb\" @ and y\n\"open";
+    TokenBuffer tokens = tokenize(source);
+    Scanner s(source);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        Token want = s.scanToken();
+        Token t = tokens.token(i);
+        assert(t.type == want.type && t.lexeme == want.lexeme && t.line == want.line);
+    }
+    assert(tokens.type(tokens.size() - 1) == TokenType::END_OF_FILE);
+
+    // Offsets/lengths index the source, including for errors
+    assert(tokens.text(1) == "x");
+    assert(tokens.offset(1) == 4 && tokens.length(1) == 1);
+    size_t bad = 7;
+    assert(tokens.type(bad) == TokenType::ERROR);
+    assert(tokens.text(bad) == "@");
+    assert(std::string(tokens.message(bad)) == "Unexpected character.");
+    assert(tokens.type(tokens.size() - 2) == TokenType::ERROR);
+    assert(tokens.line(tokens.size() - 2) == 4);
+}
+
+static bool sameTokens(const TokenBuffer& a, const TokenBuffer& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a.type(i) != b.type(i) || a.offset(i) != b.offset(i) ||
+            a.length(i) != b.length(i) || a.line(i) != b.line(i) ||
+            std::string(a.message(i)) != b.message(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Large enough to be split, with multi-line strings (some spanning several
+// chunks), quotes inside comments and bad characters.
+static std::string generateSplittableSource(unsigned seed, size_t bytes) {
+    static const char* pieces[] = {
+        "var x = 1.5;\n", "print \"one line\";\n", "// a \"quote\" in a comment\n",
+        "\"multi\nline\nstring\"\n", "  x = x + 2 * (y - 3) >= 4;\n", "@ # \n",
+        "fun f() { return nil; }\n", "\"\n",
+    };
+    std::string source;
+    while (source.size() < bytes) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned pick = (seed >> 16) % 8;
+        // Keep the lone quotes rare so that strings span whole chunks
+        if (pick == 7 && (seed >> 8) % 64 != 0) pick = 0;
+        source += pieces[pick];
+    }
+    return source;
+}
+
+void test_retokenize() {
+    // Random edits, heavy on characters that change token boundaries
+    static const char* snippets[] = {
+        "\"", "\n", "//", "=", ".", "5", "x", " ", "\"a\nb\"", "@", "/", "1.5", "!",
+    };
+    std::string source = generateSplittableSource(7, 4000);
+    TokenBuffer tokens = tokenize(source);
+    unsigned seed = 99;
+    for (int i = 0; i < 3000; i++) {
+        seed = seed * 1103515245u + 12345u;
+        size_t offset = (seed >> 8) % (source.size() + 1);
+        size_t removed = std::min<size_t>((seed >> 4) % 4, source.size() - offset);
+        std::string inserted = (seed >> 20) % 3 == 0 ? "" : snippets[(seed >> 12) % 13];
+
+        std::string edited = source.substr(0, offset) + inserted + source.substr(offset + removed);
+        retokenize(tokens, edited, {offset, removed, inserted});
+        source = edited;
+        assert(sameTokens(tokens, tokenize(source)));
+    }
+
+    // A small edit in a large file rescans a handful of tokens
+    std::string large = generateSplittableSource(3, 1 << 20);
+    size_t middle = large.find("var x", large.size() / 2);
+    TokenBuffer largeTokens = tokenize(large);
+    std::string edited = large.substr(0, middle + 4) + "yz" + large.substr(middle + 4);
+    size_t rescanned = retokenize(largeTokens, edited, {middle + 4, 0, "yz"});
+    assert(rescanned <= 3);
+    assert(sameTokens(largeTokens, tokenize(edited)));
+}
+
+void test_tokenize_parallel() {
+    for (unsigned seed = 1; seed <= 6; seed++) {
+        std::string source = generateSplittableSource(seed, 700 * 1024);
+        TokenBuffer sequential = tokenize(source);
+        for (unsigned threads : {2u, 3u, 8u}) {
+            assert(sameTokens(sequential, tokenizeParallel(source, threads)));
+        }
+    }
+
+    // Too small to split: falls back to a sequential scan
+    assert(sameTokens(tokenize("1 + \"a\nb\""), tokenizeParallel("1 + \"a\nb\"", 4)));
+}
+
+void test_line_index() {
+    std::string source = "a\n\nbc\n" + std::string(100, 'x') + "\n\"s\nt\"";
+    LineIndex index(source);
+    int line = 1;
+    for (size_t offset = 0; offset <= source.size(); offset++) {
+        assert(index.line(offset) == line);
+        if (offset < source.size() && source[offset] == '\n') line++;
+    }
+    assert(index.line(source.size() + 10) == line);
+
+    // LAZY scanning leaves lines at 0
+    Scanner s(source, ScanMode::BOUNDED, LineMode::LAZY);
+    for (Token t = s.scanToken(); ; t = s.scanToken()) {
+        assert(t.line == 0);
+        if (t.type == TokenType::END_OF_FILE) break;
+    }
+}
+
+static void writeFile(const char* path, const std::string& contents) {
+    FILE* file = fopen(path, "wb");
+    assert(file);
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+}
+
+void test_source_file() {
+    const char* path = "scanner_test_source.lox";
+    std::string contents = "print \"mapped\";\n1 + 2";
+    writeFile(path, contents);
+
+    SourceFile file;
+    assert(file.open(path));
+    assert(file.text() == contents);
+    assert(file.hasSentinel());
+    assert(file.text().data()[contents.size()] == '\0');
+
+    // Exactly one page: no sentinel byte may be read past the mapping
+    writeFile(path, std::string(4096, ' '));
+    assert(file.open(path));
+    assert(file.text().size() == 4096);
+    assert(file.hasSentinel() == !file.isMapped());
+
+    // Empty files cannot be mapped and are read instead
+    writeFile(path, "");
+    assert(file.open(path));
+    assert(file.text().empty() && !file.isMapped());
+
+    remove(path);
+    assert(!file.open(path));
+}
+
+// SENTINEL mode must produce exactly the tokens BOUNDED mode does,
+// including at every possible end of input.
+void test_sentinel_mode() {
+    std::string source = "var x = 12.5 >= y; // done\nprint \"a\\nb\" != 3. and _z1 <=";
+    for (size_t length = 0; length <= source.size(); length++) {
+        std::string prefix = source.substr(0, length);
+        Scanner bounded(std::string_view(source.data(), length));
+        Scanner sentinel(prefix, ScanMode::SENTINEL);
+        for (;;) {
+            Token want = bounded.scanToken();
+            Token t = sentinel.scanToken();
+            assert(t.type == want.type && t.lexeme == want.lexeme && t.line == want.line);
+            if (want.type == TokenType::END_OF_FILE) break;
+        }
+    }
+
+    // A NUL inside the source is an ordinary bad character, not the end
+    std::string withNul("1 \0 2", 5);
+    Scanner s(withNul, ScanMode::SENTINEL);
+    ASSERT_TOKEN(s, TokenType::NUMBER, "1");
+    ASSERT_TYPE(s, TokenType::ERROR);
+    ASSERT_TOKEN(s, TokenType::NUMBER, "2");
+    ASSERT_TYPE(s, TokenType::END_OF_FILE);
+}
+
+// Every kernel set must agree with the scalar one, including on runs that
+// straddle or end exactly at 16/32-byte boundaries.
+void test_scan_kernels_agree() {
+    std::string source;
+    for (int run = 0; run < 70; run++) {
+        source += "x";
+        for (int i = 0; i < run; i++) source += (i % 7 == 3) ? '\n' : (i % 5 == 1) ? '\t' : ' ';
+        source += "// " + std::string(run, '-') + "\n";
+    }
+    source += "1 //";   // Comment running into the end of the source
+
+    std::vector<Token> expected;
+    ScanKernel saved = activeScanKernel();
+    assert(selectScanKernel(ScanKernel::SCALAR));
+    Scanner reference(source);
+    for (Token t = reference.scanToken(); ; t = reference.scanToken()) {
+        expected.push_back(t);
+        if (t.type == TokenType::END_OF_FILE) break;
+    }
+    assert(expected.size() == 72);
+    int newlines = 0;
+    for (char c : source) newlines += c == '\n';
+    assert(expected[70].line == 1 + newlines);
+
+    for (ScanKernel kernel : {ScanKernel::SSE2, ScanKernel::AVX2}) {
+        if (!selectScanKernel(kernel)) continue;
+        Scanner s(source);
+        for (const Token& want : expected) {
+            Token t = s.scanToken();
+            assert(t.type == want.type && t.lexeme == want.lexeme && t.line == want.line);
+        }
+
+        // Kernels stop at `end` without reading past it
+        std::string blanks(100, ' ');
+        blanks[40] = '\n';
+        newlines = 0;
+        assert(skipBlanks(blanks.data(), blanks.data() + 37, newlines) == blanks.data() + 37);
+        assert(newlines == 0);
+        assert(findNewline(blanks.data(), blanks.data() + 40) == blanks.data() + 40);
+        assert(findNewline(blanks.data(), blanks.data() + 41) == blanks.data() + 40);
+        assert(countNewlines(source.data(), source.data() + source.size()) ==
+               static_cast<size_t>(std::count(source.begin(), source.end(), '\n')));
+    }
+    selectScanKernel(saved);
+}
+
 int main() {
     test_single_char_tokens();
     test_two_char_tokens();
     test_keywords();
+    test_keyword_type();
     test_identifiers();
     test_numbers();
     test_strings();
@@ -123,7 +384,15 @@ int main() {
     test_comments_ignored();
     test_line_tracking();
     test_unexpected_char();
+    test_parse_number();
+    test_scan_kernels_agree();
+    test_sentinel_mode();
+    test_tokenize();
+    test_tokenize_parallel();
+    test_retokenize();
+    test_line_index();
+    test_source_file();
 
-    std::cout << "All 10 tests passed.\n";
+    std::cout << "All 19 tests passed.\n";
     return 0;
 }
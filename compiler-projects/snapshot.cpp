@@ -0,0 +1,140 @@
+#include "snapshot.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static_assert(sizeof(SnapshotHeader) == 24, "SnapshotHeader layout changed");
+static_assert(sizeof(SnapshotEntry) == 32, "SnapshotEntry layout changed");
+
+// Images start 8-aligned so their sections are aligned in the mapping.
+static const size_t IMAGE_ALIGNMENT = 8;
+
+bool Snapshot::write(const ChunkCache& cache, const char* path) {
+    std::vector<SnapshotEntry> entries;
+    std::string sources;
+    std::vector<std::string> images;
+    cache.forEach([&](std::string_view source, int optLevel, LineMode lineMode,
+                      const CompiledChunk& chunk) {
+        SnapshotEntry entry = {};
+        entry.hash = hashSource(source);
+        entry.sourceOffset = static_cast<uint32_t>(sources.size());
+        entry.sourceLength = static_cast<uint32_t>(source.size());
+        entry.optLevel = optLevel;
+        entry.lineMode = static_cast<uint32_t>(lineMode);
+        entry.imageOffset = static_cast<uint32_t>(images.size());   // Fixed up below
+        sources.append(source);
+        images.push_back(encodeBytecode(chunk));
+        entries.push_back(entry);
+    });
+    std::sort(entries.begin(), entries.end(),
+              [](const SnapshotEntry& a, const SnapshotEntry& b) { return a.hash < b.hash; });
+
+    size_t offset = sizeof(SnapshotHeader) + entries.size() * sizeof(SnapshotEntry) +
+                    sources.size();
+    std::vector<size_t> order;  // Image index, in file order
+    for (SnapshotEntry& entry : entries) {
+        offset = (offset + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+        order.push_back(entry.imageOffset);
+        entry.imageLength = static_cast<uint32_t>(images[entry.imageOffset].size());
+        entry.imageOffset = static_cast<uint32_t>(offset);
+        offset += entry.imageLength;
+    }
+
+    std::string table(reinterpret_cast<const char*>(entries.data()),
+                      entries.size() * sizeof(SnapshotEntry));
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.checksum = hashSource(table);
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.sourceByteCount = static_cast<uint32_t>(sources.size());
+
+    std::string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+    contents += table;
+    contents += sources;
+    for (size_t i = 0; i < entries.size(); i++) {
+        contents.resize(entries[i].imageOffset, '\0');
+        contents += images[order[i]];
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) return false;
+    bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    return fclose(file) == 0 && written;
+}
+
+bool Snapshot::fail(const char* message) {
+    error_ = message;
+    entries_ = nullptr;
+    entryCount_ = 0;
+    sources_ = nullptr;
+    loaded_.clear();
+    return false;
+}
+
+bool Snapshot::open(const char* path) {
+    if (!file_.open(path)) return fail("cannot read file");
+    std::string_view contents = file_.text();
+
+    SnapshotHeader header;
+    if (contents.size() < sizeof(header) ||
+        memcmp(contents.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        return fail("not a snapshot file");
+    }
+    memcpy(&header, contents.data(), sizeof(header));
+    if (header.version != SNAPSHOT_VERSION) return fail("unsupported snapshot version");
+
+    uint64_t tableSize = uint64_t{header.entryCount} * sizeof(SnapshotEntry);
+    if (sizeof(header) + tableSize + header.sourceByteCount > contents.size()) {
+        return fail("truncated snapshot file");
+    }
+    if (hashSource(contents.substr(sizeof(header), tableSize)) != header.checksum) {
+        return fail("checksum mismatch");
+    }
+
+    const auto* entries = reinterpret_cast<const SnapshotEntry*>(contents.data() + sizeof(header));
+    for (uint32_t i = 0; i < header.entryCount; i++) {
+        const SnapshotEntry& entry = entries[i];
+        if (uint64_t{entry.sourceOffset} + entry.sourceLength > header.sourceByteCount ||
+            uint64_t{entry.imageOffset} + entry.imageLength > contents.size()) {
+            return fail("entry out of bounds");
+        }
+    }
+
+    error_ = nullptr;
+    entries_ = entries;
+    entryCount_ = header.entryCount;
+    sources_ = contents.data() + sizeof(header) + header.entryCount * sizeof(SnapshotEntry);
+    loaded_.clear();
+    loaded_.resize(entryCount_);
+    return true;
+}
+
+const CompiledChunk* Snapshot::find(std::string_view source, int optLevel, LineMode lineMode) {
+    if (entryCount_ == 0) return nullptr;
+
+    uint64_t hash = hashSource(source);
+    const SnapshotEntry* first = std::lower_bound(
+        entries_, entries_ + entryCount_, hash,
+        [](const SnapshotEntry& entry, uint64_t target) { return entry.hash < target; });
+    for (const SnapshotEntry* entry = first;
+         entry != entries_ + entryCount_ && entry->hash == hash; entry++) {
+        if (entry->optLevel != optLevel ||
+            entry->lineMode != static_cast<uint32_t>(lineMode) ||
+            std::string_view(sources_ + entry->sourceOffset, entry->sourceLength) != source) {
+            continue;
+        }
+
+        // First use: validate the image and build its constants.
+        std::unique_ptr<BytecodeFile>& loaded = loaded_[entry - entries_];
+        if (!loaded) {
+            loaded = std::make_unique<BytecodeFile>();
+            std::string_view image = file_.text().substr(entry->imageOffset, entry->imageLength);
+            if (!loaded->load(image)) return nullptr;
+        }
+        return loaded->error() == nullptr ? &loaded->chunk() : nullptr;
+    }
+    return nullptr;
+}
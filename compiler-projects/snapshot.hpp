@@ -0,0 +1,84 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "common.hpp"
+#include "bytecode_file.hpp"
+#include "chunk_cache.hpp"
+#include "source_file.hpp"
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Compiled chunks saved from a VM's chunk cache, so a new VM can start
+// without recompiling the expressions an earlier one already compiled
+// (see VM::saveSnapshot() and VM::loadSnapshot()).
+//
+// Layout, all integers in host (little-endian) byte order:
+//
+//   header   SnapshotHeader
+//   entries  entryCount x SnapshotEntry, sorted by hash
+//   sources  the source text of every entry (its full cache key)
+//   images   one .loxc image per entry (see bytecode_file.hpp), 8-aligned
+//
+// Everything is addressed by file offset, so the mapping needs no
+// relocation up front. The header checksum covers only the entry table,
+// so opening is cheap; a damaged source simply never matches a lookup,
+// and each image carries its own checksum and is validated and turned
+// into a runnable chunk only when its entry is first looked up.
+constexpr char SNAPSHOT_MAGIC[4] = {'L', 'O', 'X', 'S'};
+constexpr uint16_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;             // Reserved, 0
+    uint64_t checksum;          // hashSource() of the entry table
+    uint32_t entryCount;
+    uint32_t sourceByteCount;
+};
+
+struct SnapshotEntry {
+    uint64_t hash;              // hashSource() of the source
+    uint32_t sourceOffset;      // Into the sources section
+    uint32_t sourceLength;
+    uint32_t imageOffset;       // From the start of the file
+    uint32_t imageLength;
+    int32_t optLevel;
+    uint32_t lineMode;          // LineMode
+};
+
+class Snapshot {
+public:
+    Snapshot() = default;
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // Write every chunk in `cache` to `path`. Returns false if the file
+    // cannot be written.
+    static bool write(const ChunkCache& cache, const char* path);
+
+    // Map `path` and check its header and entry table. Returns false,
+    // with error() saying why, if it is unreadable or not a snapshot.
+    bool open(const char* path);
+
+    // The chunk compiled from `source` with these settings, or nullptr if
+    // the snapshot has none (or its image turns out to be corrupt).
+    const CompiledChunk* find(std::string_view source, int optLevel, LineMode lineMode);
+
+    bool isOpen() const { return error_ == nullptr; }
+    size_t size() const { return entryCount_; }
+    const char* error() const { return error_; }
+
+private:
+    bool fail(const char* message);
+
+    SourceFile file_;
+    const SnapshotEntry* entries_ = nullptr;   // In the mapping
+    size_t entryCount_ = 0;
+    const char* sources_ = nullptr;
+    std::vector<std::unique_ptr<BytecodeFile>> loaded_;    // Per entry, on first use
+    const char* error_ = "no snapshot loaded";
+};
+
+#endif // SNAPSHOT_HPP
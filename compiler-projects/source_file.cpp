@@ -0,0 +1,77 @@
+#include "source_file.hpp"
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SOURCE_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::~SourceFile() {
+    close();
+}
+
+void SourceFile::close() {
+#ifdef SOURCE_FILE_MMAP
+    if (mapping_) munmap(mapping_, mappedSize_);
+#endif
+    mapping_ = nullptr;
+    mappedSize_ = 0;
+    buffer_.clear();
+    text_ = std::string_view();
+    sentinel_ = false;
+}
+
+bool SourceFile::open(const char* path) {
+    close();
+    return map(path) || read(path);
+}
+
+bool SourceFile::map(const char* path) {
+#ifdef SOURCE_FILE_MMAP
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // The mapping keeps the file referenced
+    if (mapping == MAP_FAILED) return false;
+
+    // The scanner walks the file once, front to back.
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    madvise(mapping, size, MADV_WILLNEED);
+
+    mapping_ = mapping;
+    mappedSize_ = size;
+    text_ = std::string_view(static_cast<const char*>(mapping), size);
+
+    // The rest of the last page reads as zeros.
+    long pageSize = sysconf(_SC_PAGESIZE);
+    sentinel_ = pageSize > 0 && size % static_cast<size_t>(pageSize) != 0;
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+bool SourceFile::read(const char* path) {
+    std::ifstream file(path);
+    if (!file) return false;
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    buffer_ = contents.str();
+    text_ = buffer_;
+    sentinel_ = true;   // std::string keeps a NUL after its contents
+    return true;
+}
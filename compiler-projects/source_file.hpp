@@ -0,0 +1,45 @@
+#ifndef SOURCE_FILE_HPP
+#define SOURCE_FILE_HPP
+
+#include <string>
+#include <string_view>
+
+// Read-only contents of a source file.
+//
+// On POSIX systems the file is mapped with mmap() and text() views the
+// mapping directly, so nothing is copied before scanning; the pages are
+// advised for sequential access. Files that cannot be mapped (empty
+// files, pipes, special files) are read into memory instead.
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // Load `path`, replacing any previous contents. Returns false if the
+    // file cannot be opened or read.
+    bool open(const char* path);
+
+    std::string_view text() const { return text_; }
+    bool isMapped() const { return mapping_ != nullptr; }
+
+    // True if a NUL byte follows text(), so ScanMode::SENTINEL may be used.
+    // A mapping has one unless the file size is a multiple of the page
+    // size (the byte after it would then be past the mapping).
+    bool hasSentinel() const { return sentinel_; }
+
+private:
+    void close();
+    bool map(const char* path);
+    bool read(const char* path);
+
+    void* mapping_ = nullptr;
+    size_t mappedSize_ = 0;
+    std::string buffer_;        // Contents when not mapped
+    std::string_view text_;
+    bool sentinel_ = false;
+};
+
+#endif // SOURCE_FILE_HPP
@@ -0,0 +1,37 @@
+#include "static_compiler.hpp"
+#include <cstdlib>
+
+void staticCompileError(const char* message) {
+    // Only reachable at run time if compileStatic() was called outside a
+    // constant expression. The compiler cannot recover from an error (it
+    // would go on to pop types that were never pushed), so stop here.
+    fprintf(stderr, "Error in static expression: %s\n", message);
+    abort();
+}
+
+StaticProgram::StaticProgram(const StaticChunkView& image) {
+    // Reserve first: constants point into strings_.
+    strings_.reserve(image.constantCount);
+    constants_.reserve(image.constantCount);
+    for (size_t i = 0; i < image.constantCount; i++) {
+        const StaticConstant& stored = image.constants[i];
+        if (stored.type == ValueType::VAL_NUMBER) {
+            constants_.push_back(NUMBER_VAL(stored.number));
+            continue;
+        }
+        // The VM never writes to a constant's characters, so they can stay
+        // in the (read-only) image.
+        ObjString string;
+        string.obj.type = ObjType::OBJ_STRING;
+        string.obj.next = nullptr;
+        string.length = static_cast<int>(stored.stringLength);
+        string.chars = const_cast<char*>(image.strings + stored.stringOffset);
+        strings_.push_back(string);
+        constants_.push_back(OBJ_VAL(reinterpret_cast<Obj*>(&strings_.back())));
+    }
+
+    chunk_ = CompiledChunk::borrow(constants_.data(), constants_.size(),
+                                   image.code, image.count,
+                                   image.checkpoints, image.checkpointCount,
+                                   image.lineBytes, image.lineByteCount);
+}
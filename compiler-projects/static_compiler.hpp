@@ -0,0 +1,471 @@
+#ifndef STATIC_COMPILER_HPP
+#define STATIC_COMPILER_HPP
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include "ir.hpp"
+#include "object.hpp"
+#include "scanner.hpp"
+#include "value.hpp"
+#include <vector>
+
+// Lox expressions compiled while the C++ host is being compiled.
+//
+//   static constexpr auto kCheck = compileStatic("(1 + 2) * 3 == 9");
+//   vm.interpret(staticProgram<kCheck>());
+//
+// compileStatic() is a constexpr scanner and Pratt compiler that produces
+// exactly the bytecode, constants and line table compile() would at
+// optLevel 0 with LineMode::EAGER. Declaring the result constexpr forces
+// the work to happen at build time; a malformed expression then fails to
+// build, with staticCompileError() and the usual message ("Expect
+// expression." and so on) in the diagnostic. Called at run time instead,
+// a malformed expression aborts the process. staticProgram() wraps the
+// image as a CompiledChunk the first time it is used, so nothing is
+// scanned or compiled at run time.
+//
+// The tree is C++17, so this is constexpr rather than consteval. Number
+// literals must be exact for parseNumber()'s fast path (at most 2^53 as
+// digits, at most 22 fraction digits); others are rejected.
+
+struct StaticConstant {
+    ValueType type = ValueType::VAL_NIL;   // VAL_NUMBER or VAL_OBJ (string)
+    double number = 0;
+    uint32_t stringOffset = 0;             // Into the image's strings
+    uint32_t stringLength = 0;
+};
+
+// A compiled image, independent of its source length.
+struct StaticChunkView {
+    const uint8_t* code;
+    size_t count;
+    const StaticConstant* constants;
+    size_t constantCount;
+    const char* strings;                   // NUL-terminated string constants
+    const LineTable::Checkpoint* checkpoints;
+    size_t checkpointCount;
+    const uint8_t* lineBytes;
+    size_t lineByteCount;
+};
+
+// Not constexpr: reaching it during constant evaluation is what turns a
+// Lox compile error into a C++ one. Reached at run time, it prints the
+// message and aborts.
+[[noreturn]] void staticCompileError(const char* message);
+
+template <size_t N>
+struct StaticChunk {
+    // Each source character yields at most two bytes of code (a one-digit
+    // number is OP_CONSTANT and its operand), plus the OP_RETURN.
+    static constexpr size_t CODE_CAPACITY = 2 * N + 1;
+    static constexpr size_t CONSTANT_CAPACITY = N;
+    static constexpr size_t CHECKPOINT_CAPACITY =
+        CODE_CAPACITY / LineTable::LINE_TABLE_STRIDE + 1;
+    static constexpr size_t LINE_BYTE_CAPACITY = 10 * CODE_CAPACITY;   // Two 5-byte varints a run
+
+    uint8_t code[CODE_CAPACITY] = {};
+    size_t count = 0;
+    StaticConstant constants[CONSTANT_CAPACITY] = {};
+    size_t constantCount = 0;
+    char strings[N] = {};
+    size_t stringBytes = 0;
+    LineTable::Checkpoint checkpoints[CHECKPOINT_CAPACITY] = {};
+    size_t checkpointCount = 0;
+    uint8_t lineBytes[LINE_BYTE_CAPACITY] = {};
+    size_t lineByteCount = 0;
+
+    // LineTable::add() state
+    size_t runs = 0;
+    size_t runStart = 0;
+    int lastLine = 0;
+
+    StaticChunkView view() const {
+        return {code, count, constants, constantCount, strings,
+                checkpoints, checkpointCount, lineBytes, lineByteCount};
+    }
+
+    constexpr void write(uint8_t byte, int line) {
+        if (count == 0 || line != lastLine) {
+            writeVarint(static_cast<uint32_t>(count - runStart));
+            int delta = static_cast<int>(static_cast<uint32_t>(line) -
+                                         static_cast<uint32_t>(lastLine));
+            writeVarint((static_cast<uint32_t>(delta) << 1) ^
+                        static_cast<uint32_t>(delta >> 31));
+            if (runs % LineTable::LINE_TABLE_STRIDE == 0) {
+                checkpoints[checkpointCount++] = {static_cast<uint32_t>(count), line,
+                                                  static_cast<uint32_t>(lineByteCount)};
+            }
+            runStart = count;
+            lastLine = line;
+            runs++;
+        }
+        code[count++] = byte;
+    }
+
+    constexpr void writeVarint(uint32_t value) {
+        while (value >= 0x80) {
+            lineBytes[lineByteCount++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        lineBytes[lineByteCount++] = static_cast<uint8_t>(value);
+    }
+};
+
+// The constexpr front end. Mirrors Scanner and Compiler (RECURSIVE mode);
+// see compile() for the reference behavior.
+template <size_t N>
+class StaticCompiler {
+public:
+    constexpr explicit StaticCompiler(const char (&source)[N]) : source_(source) {}
+
+    constexpr StaticChunk<N> compile() {
+        advance();
+        parsePrecedence(Precedence::PREC_ASSIGNMENT);
+        if (current_.type != TokenType::END_OF_FILE) {
+            staticCompileError("Expect end of expression.");
+        }
+        previous_ = current_;
+        chunk_.write(static_cast<uint8_t>(OpCode::OP_RETURN), previous_.line);
+        return chunk_;
+    }
+
+private:
+    struct StaticToken {
+        TokenType type = TokenType::END_OF_FILE;
+        size_t start = 0;
+        size_t length = 0;
+        int line = 1;
+    };
+
+    // ---- Scanner ----
+
+    constexpr bool atEnd() const { return position_ >= N - 1; }
+    constexpr char peek() const { return atEnd() ? '\0' : source_[position_]; }
+    constexpr char peekNext() const {
+        return position_ + 1 >= N - 1 ? '\0' : source_[position_ + 1];
+    }
+
+    static constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    static constexpr bool isAlpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    constexpr bool matches(size_t start, size_t length, const char* word) const {
+        for (size_t i = 0; i < length; i++) {
+            if (word[i] != source_[start + i]) return false;
+        }
+        return word[length] == '\0';
+    }
+
+    constexpr void skipWhitespace() {
+        for (;;) {
+            char c = peek();
+            if (c == ' ' || c == '\r' || c == '\t') {
+                position_++;
+            } else if (c == '\n') {
+                line_++;
+                position_++;
+            } else if (c == '/' && peekNext() == '/') {
+                while (!atEnd() && peek() != '\n') position_++;
+            } else {
+                return;
+            }
+        }
+    }
+
+    constexpr StaticToken makeToken(TokenType type, size_t start) const {
+        return {type, start, position_ - start, line_};
+    }
+
+    constexpr StaticToken scanToken() {
+        skipWhitespace();
+        size_t start = position_;
+        if (atEnd()) return makeToken(TokenType::END_OF_FILE, start);
+
+        char c = source_[position_++];
+        if (isAlpha(c)) {
+            while (isAlpha(peek()) || isDigit(peek())) position_++;
+            // Only these keywords have parse rules; every other word
+            // behaves like an identifier here.
+            size_t length = position_ - start;
+            TokenType type = matches(start, length, "true")    ? TokenType::TRUE
+                             : matches(start, length, "false") ? TokenType::FALSE
+                             : matches(start, length, "nil")   ? TokenType::NIL
+                                                               : TokenType::IDENTIFIER;
+            return makeToken(type, start);
+        }
+        if (isDigit(c)) {
+            while (isDigit(peek())) position_++;
+            if (peek() == '.' && isDigit(peekNext())) {
+                position_++;
+                while (isDigit(peek())) position_++;
+            }
+            return makeToken(TokenType::NUMBER, start);
+        }
+
+        switch (c) {
+            case '(': return makeToken(TokenType::LEFT_PAREN, start);
+            case ')': return makeToken(TokenType::RIGHT_PAREN, start);
+            case '{': return makeToken(TokenType::LEFT_BRACE, start);
+            case '}': return makeToken(TokenType::RIGHT_BRACE, start);
+            case ';': return makeToken(TokenType::SEMICOLON, start);
+            case ',': return makeToken(TokenType::COMMA, start);
+            case '.': return makeToken(TokenType::DOT, start);
+            case '-': return makeToken(TokenType::MINUS, start);
+            case '+': return makeToken(TokenType::PLUS, start);
+            case '/': return makeToken(TokenType::SLASH, start);
+            case '*': return makeToken(TokenType::STAR, start);
+            case '!': return makeToken(match('=') ? TokenType::BANG_EQUAL : TokenType::BANG, start);
+            case '=': return makeToken(match('=') ? TokenType::EQUAL_EQUAL : TokenType::EQUAL, start);
+            case '<': return makeToken(match('=') ? TokenType::LESS_EQUAL : TokenType::LESS, start);
+            case '>':
+                return makeToken(match('=') ? TokenType::GREATER_EQUAL : TokenType::GREATER, start);
+            case '"':
+                while (!atEnd() && peek() != '"') {
+                    if (peek() == '\n') line_++;
+                    position_++;
+                }
+                if (atEnd()) staticCompileError("Unterminated string.");
+                position_++;
+                return makeToken(TokenType::STRING, start);
+        }
+        staticCompileError("Unexpected character.");
+        return makeToken(TokenType::ERROR, start);
+    }
+
+    constexpr bool match(char expected) {
+        if (peek() != expected) return false;
+        position_++;
+        return true;
+    }
+
+    // ---- Parser ----
+
+    constexpr void advance() {
+        previous_ = current_;
+        current_ = scanToken();
+    }
+
+    static constexpr Precedence infixPrecedence(TokenType type) {
+        switch (type) {
+            case TokenType::MINUS:
+            case TokenType::PLUS:          return Precedence::PREC_TERM;
+            case TokenType::SLASH:
+            case TokenType::STAR:          return Precedence::PREC_FACTOR;
+            case TokenType::BANG_EQUAL:
+            case TokenType::EQUAL_EQUAL:   return Precedence::PREC_EQUALITY;
+            case TokenType::GREATER:
+            case TokenType::GREATER_EQUAL:
+            case TokenType::LESS:
+            case TokenType::LESS_EQUAL:    return Precedence::PREC_COMPARISON;
+            default:                       return Precedence::PREC_NONE;
+        }
+    }
+
+    constexpr void parsePrecedence(Precedence precedence) {
+        advance();
+        prefix();
+        while (precedence <= infixPrecedence(current_.type)) {
+            advance();
+            binary();
+        }
+    }
+
+    constexpr void prefix() {
+        TokenType type = previous_.type;
+        switch (type) {
+            case TokenType::LEFT_PAREN:
+                parsePrecedence(Precedence::PREC_ASSIGNMENT);
+                if (current_.type != TokenType::RIGHT_PAREN) {
+                    staticCompileError("Expect ')' after expression.");
+                }
+                advance();
+                return;
+            case TokenType::MINUS:
+            case TokenType::BANG: {
+                parsePrecedence(Precedence::PREC_UNARY);
+                StaticType operand = popType();
+                if (type == TokenType::BANG) {
+                    emit(OpCode::OP_NOT);
+                    pushType(StaticType::BOOL);
+                } else {
+                    emitNumberOp(OpCode::OP_NEGATE, operand == StaticType::NUMBER);
+                    pushType(StaticType::NUMBER);
+                }
+                return;
+            }
+            case TokenType::NUMBER:
+                emitConstant({ValueType::VAL_NUMBER, number(previous_), 0, 0});
+                pushType(StaticType::NUMBER);
+                return;
+            case TokenType::STRING:
+                emitConstant(string(previous_));
+                pushType(StaticType::STRING);
+                return;
+            case TokenType::FALSE: emit(OpCode::OP_FALSE); pushType(StaticType::BOOL); return;
+            case TokenType::TRUE:  emit(OpCode::OP_TRUE);  pushType(StaticType::BOOL); return;
+            case TokenType::NIL:   emit(OpCode::OP_NIL);   pushType(StaticType::NIL);  return;
+            default:
+                staticCompileError("Expect expression.");
+        }
+    }
+
+    constexpr void binary() {
+        TokenType type = previous_.type;
+        parsePrecedence(static_cast<Precedence>(static_cast<int>(infixPrecedence(type)) + 1));
+
+        StaticType right = popType();
+        StaticType left = popType();
+        bool numbers = left == StaticType::NUMBER && right == StaticType::NUMBER;
+        StaticType result = StaticType::BOOL;
+        switch (type) {
+            case TokenType::BANG_EQUAL:    emit(OpCode::OP_EQUAL); emit(OpCode::OP_NOT); break;
+            case TokenType::EQUAL_EQUAL:   emit(OpCode::OP_EQUAL); break;
+            case TokenType::GREATER:       emitNumberOp(OpCode::OP_GREATER, numbers); break;
+            case TokenType::GREATER_EQUAL:
+                emitNumberOp(OpCode::OP_LESS, numbers);
+                emit(OpCode::OP_NOT);
+                break;
+            case TokenType::LESS:          emitNumberOp(OpCode::OP_LESS, numbers); break;
+            case TokenType::LESS_EQUAL:
+                emitNumberOp(OpCode::OP_GREATER, numbers);
+                emit(OpCode::OP_NOT);
+                break;
+            case TokenType::PLUS:
+                emitNumberOp(OpCode::OP_ADD, numbers);
+                result = numbers ? StaticType::NUMBER
+                         : left == StaticType::STRING && right == StaticType::STRING
+                             ? StaticType::STRING
+                             : StaticType::UNKNOWN;
+                break;
+            case TokenType::MINUS:
+                emitNumberOp(OpCode::OP_SUBTRACT, numbers);
+                result = StaticType::NUMBER;
+                break;
+            case TokenType::STAR:
+                emitNumberOp(OpCode::OP_MULTIPLY, numbers);
+                result = StaticType::NUMBER;
+                break;
+            case TokenType::SLASH:
+                emitNumberOp(OpCode::OP_DIVIDE, numbers);
+                result = StaticType::NUMBER;
+                break;
+            default:
+                break;
+        }
+        pushType(result);
+    }
+
+    // ---- Emitting ----
+
+    constexpr void emit(OpCode op) { chunk_.write(static_cast<uint8_t>(op), previous_.line); }
+
+    constexpr void emitNumberOp(OpCode op, bool provenNumbers) {
+        emit(provenNumbers ? uncheckedNumberOpStatic(op) : op);
+    }
+
+    // uncheckedNumberOp() is not constexpr; same mapping.
+    static constexpr OpCode uncheckedNumberOpStatic(OpCode op) {
+        switch (op) {
+            case OpCode::OP_GREATER:  return OpCode::OP_GREATER_NUMBER;
+            case OpCode::OP_LESS:     return OpCode::OP_LESS_NUMBER;
+            case OpCode::OP_ADD:      return OpCode::OP_ADD_NUMBER;
+            case OpCode::OP_SUBTRACT: return OpCode::OP_SUBTRACT_NUMBER;
+            case OpCode::OP_MULTIPLY: return OpCode::OP_MULTIPLY_NUMBER;
+            case OpCode::OP_DIVIDE:   return OpCode::OP_DIVIDE_NUMBER;
+            case OpCode::OP_NEGATE:   return OpCode::OP_NEGATE_NUMBER;
+            default:                  return op;
+        }
+    }
+
+    constexpr void emitConstant(StaticConstant constant) {
+        if (chunk_.constantCount > UINT8_MAX) {
+            staticCompileError("Too many constants in one chunk.");
+        }
+        uint8_t index = static_cast<uint8_t>(chunk_.constantCount);
+        chunk_.constants[chunk_.constantCount++] = constant;
+        emit(OpCode::OP_CONSTANT);
+        chunk_.write(index, previous_.line);
+    }
+
+    constexpr double number(const StaticToken& token) const {
+        constexpr double kPowersOfTen[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+            1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+            1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+        uint64_t mantissa = 0;
+        int fractionDigits = 0;
+        bool inFraction = false;
+        for (size_t i = token.start; i < token.start + token.length; i++) {
+            if (source_[i] == '.') {
+                inFraction = true;
+                continue;
+            }
+            mantissa = mantissa * 10 + static_cast<uint64_t>(source_[i] - '0');
+            if (inFraction) fractionDigits++;
+            if (mantissa > (uint64_t{1} << 53) || fractionDigits > 22) {
+                staticCompileError("Number literal is not exact at compile time.");
+            }
+        }
+        return static_cast<double>(mantissa) / kPowersOfTen[fractionDigits];
+    }
+
+    constexpr StaticConstant string(const StaticToken& token) {
+        StaticConstant constant = {ValueType::VAL_OBJ, 0,
+                                   static_cast<uint32_t>(chunk_.stringBytes),
+                                   static_cast<uint32_t>(token.length - 2)};
+        for (size_t i = token.start + 1; i < token.start + token.length - 1; i++) {
+            chunk_.strings[chunk_.stringBytes++] = source_[i];
+        }
+        chunk_.strings[chunk_.stringBytes++] = '\0';
+        return constant;
+    }
+
+    constexpr void pushType(StaticType type) { types_[typeCount_++] = type; }
+    constexpr StaticType popType() { return types_[--typeCount_]; }
+
+    const char (&source_)[N];
+    size_t position_ = 0;
+    int line_ = 1;
+    StaticToken current_ = {};
+    StaticToken previous_ = {};
+    StaticType types_[N] = {};
+    size_t typeCount_ = 0;
+    StaticChunk<N> chunk_ = {};
+};
+
+// Compile a string literal at build time (see the top of this file).
+template <size_t N>
+constexpr StaticChunk<N> compileStatic(const char (&source)[N]) {
+    return StaticCompiler<N>(source).compile();
+}
+
+// Values for a compiled image. String constants get ObjString headers
+// over the image's characters; like a Program's, they are on no object
+// list and are never freed.
+class StaticProgram {
+public:
+    explicit StaticProgram(const StaticChunkView& image);
+
+    StaticProgram(const StaticProgram&) = delete;
+    StaticProgram& operator=(const StaticProgram&) = delete;
+
+    const CompiledChunk& chunk() const { return chunk_; }
+
+private:
+    std::vector<ObjString> strings_;
+    std::vector<Value> constants_;
+    CompiledChunk chunk_;
+};
+
+// The runnable chunk for a constexpr image, built on first use (thread
+// safe) and shared by every later call and every VM.
+template <const auto& Image>
+const CompiledChunk& staticProgram() {
+    static const StaticProgram program(Image.view());
+    return program.chunk();
+}
+
+#endif // STATIC_COMPILER_HPP
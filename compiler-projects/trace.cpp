@@ -0,0 +1,134 @@
+#include "trace.hpp"
+#include "debug.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <cstring>
+
+static const char TRACE_MAGIC[4] = {'L', 'O', 'X', 'T'};
+static const uint32_t TRACE_VERSION = 1;
+
+struct TraceHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t recordCount;
+    char clock[8];          // PROFILE_CLOCK_UNIT of the writer
+};
+
+static_assert(sizeof(TraceHeader) == 24, "trace header is written as-is");
+
+TraceBuffer::TraceBuffer(size_t capacity) : head_(0), started_(0) {
+    size_t rounded = 1;
+    while (rounded < capacity) rounded <<= 1;
+    slots_.reset(new Slot[rounded]);
+    mask_ = rounded - 1;
+}
+
+std::vector<TraceRecord> TraceBuffer::snapshot() const {
+    uint64_t end = head_.load(std::memory_order_acquire);
+    uint64_t begin = end > capacity() ? end - capacity() : 0;
+
+    std::vector<TraceRecord> copy(static_cast<size_t>(end - begin));
+    for (uint64_t i = begin; i < end; i++) {
+        const Slot& slot = slots_[i & mask_];
+        uint64_t words[2] = {slot.words[0].load(std::memory_order_relaxed),
+                             slot.words[1].load(std::memory_order_relaxed)};
+        memcpy(&copy[static_cast<size_t>(i - begin)], words, sizeof(words));
+    }
+
+    // Pairs with the fence in record(): if a copied word came from the
+    // write of record k, `started` is past k, so every slot the writer has
+    // lapped (or is lapping) since `begin` is before `started - capacity()`.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t started = started_.load(std::memory_order_relaxed);
+    uint64_t overwritten = started > capacity() ? started - capacity() : 0;
+    if (overwritten > begin) {
+        size_t drop = static_cast<size_t>(std::min(overwritten - begin, end - begin));
+        copy.erase(copy.begin(), copy.begin() + static_cast<std::ptrdiff_t>(drop));
+    }
+    return copy;
+}
+
+bool writeTrace(const TraceBuffer& buffer, const char* path) {
+    std::vector<TraceRecord> records = buffer.snapshot();
+
+    TraceHeader header = {};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.recordCount = records.size();
+    strncpy(header.clock, PROFILE_CLOCK_UNIT, sizeof(header.clock) - 1);
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) return false;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(records.data(), sizeof(TraceRecord), records.size(), file) ==
+                       records.size();
+    return fclose(file) == 0 && written;
+}
+
+bool readTrace(const char* path, std::vector<TraceRecord>& records) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not open trace \"%s\".\n", path);
+        return false;
+    }
+
+    // The record count must match the file size before anything is sized
+    // by it.
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    rewind(file);
+
+    TraceHeader header;
+    bool valid = size >= static_cast<long>(sizeof(header)) &&
+                 fread(&header, sizeof(header), 1, file) == 1 &&
+                 memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0 &&
+                 header.version == TRACE_VERSION &&
+                 header.recordCount == (static_cast<uint64_t>(size) - sizeof(header)) /
+                                           sizeof(TraceRecord) &&
+                 (static_cast<uint64_t>(size) - sizeof(header)) % sizeof(TraceRecord) == 0;
+    if (valid) {
+        records.resize(static_cast<size_t>(header.recordCount));
+        valid = fread(records.data(), sizeof(TraceRecord), records.size(), file) ==
+                records.size();
+    }
+    fclose(file);
+
+    if (!valid) {
+        fprintf(stderr, "\"%s\" is not a valid trace.\n", path);
+        records.clear();
+        return false;
+    }
+    if (strncmp(header.clock, PROFILE_CLOCK_UNIT, sizeof(header.clock)) != 0) {
+        fprintf(stderr, "Note: trace timestamps are in %.8s.\n", header.clock);
+    }
+    return true;
+}
+
+void printTrace(const std::vector<TraceRecord>& records, const CompiledChunk& chunk) {
+    // Each line shows the time since the record before it, i.e. how long
+    // the previous instruction took, and the stack depth.
+    bool matches = false;
+    const TraceRecord* previous = nullptr;
+    for (const TraceRecord& record : records) {
+        uint64_t delta = previous == nullptr ? 0 : record.timestamp - previous->timestamp;
+        previous = &record;
+
+        if (record.opcode == TRACE_RUN_START) {
+            matches = record.offset == chunk.count();
+            printf("== run: %u bytes of code%s ==\n", record.offset,
+                   matches ? "" : " (not this chunk)");
+            continue;
+        }
+
+        printf("%10llu [%3u] ", static_cast<unsigned long long>(delta), record.stackDepth);
+        if (matches && record.offset < chunk.count() &&
+            chunk.code(record.offset) == record.opcode) {
+            disassembleInstruction(chunk, static_cast<int>(record.offset));
+        } else {
+            printf("%04u %s\n", record.offset,
+                   record.opcode < OPCODE_COUNT
+                       ? opCodeName(static_cast<OpCode>(record.opcode))
+                       : "UNKNOWN");
+        }
+    }
+}
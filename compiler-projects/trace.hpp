@@ -0,0 +1,101 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "common.hpp"
+#include "chunk.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Binary execution trace, cheap enough to leave on in production and dump
+// after a failure (the printf tracing of DEBUG_TRACE_EXECUTION is not).
+//
+// A VM given a TraceBuffer (VM::setTrace()) appends one 16-byte record
+// per executed instruction, overwriting the oldest once the ring is full.
+// writeTrace() saves the retained records; `clox --decode-trace` renders
+// them against the traced program with the disassembler.
+
+// Pseudo-opcode marking the start of a run. Its offset is the size of the
+// chunk's code, so the decoder can tell whether it has the right chunk.
+constexpr uint8_t TRACE_RUN_START = 0xff;
+
+struct TraceRecord {
+    uint64_t timestamp;     // profileClock() at dispatch
+    uint32_t offset;        // Instruction offset in the chunk's code
+    uint8_t opcode;         // OpCode, or TRACE_RUN_START
+    uint8_t reserved;
+    uint16_t stackDepth;    // Values on the stack before the instruction
+};
+
+static_assert(sizeof(TraceRecord) == 16, "trace records are written as-is");
+
+constexpr size_t TRACE_DEFAULT_CAPACITY = 1 << 16;
+
+// Ring of the most recent records. There is one writer, the VM that owns
+// the buffer; snapshot() may run on any thread while it writes, and no
+// locks are taken on either side. Slots are pairs of relaxed atomic words
+// (plain moves on x86), read seqlock-style against head_.
+class TraceBuffer {
+public:
+    // `capacity` is rounded up to a power of two.
+    explicit TraceBuffer(size_t capacity = TRACE_DEFAULT_CAPACITY);
+
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    void record(uint64_t timestamp, uint32_t offset, uint8_t opcode, uint16_t stackDepth) {
+        TraceRecord record = {timestamp, offset, opcode, 0, stackDepth};
+        uint64_t words[2];
+        memcpy(words, &record, sizeof(record));
+
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        // Announce the write before making it: a reader that copies any of
+        // this slot's new words then also sees started_ past it.
+        started_.store(head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot& slot = slots_[head & mask_];
+        slot.words[0].store(words[0], std::memory_order_relaxed);
+        slot.words[1].store(words[1], std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Records written since construction (or clear()), retained or not.
+    uint64_t recorded() const { return head_.load(std::memory_order_acquire); }
+
+    // The retained records, oldest first. Records the writer overwrote
+    // while they were being copied are left out.
+    std::vector<TraceRecord> snapshot() const;
+
+    void clear() {
+        head_.store(0, std::memory_order_release);
+        started_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> words[2];     // A TraceRecord's bytes
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::atomic<uint64_t> head_;        // Records completely written
+    std::atomic<uint64_t> started_;     // Records begun: head_, or one more
+};
+
+// Save the buffer's retained records ("LOXT" file). Returns false if the
+// file could not be written.
+bool writeTrace(const TraceBuffer& buffer, const char* path);
+
+// Load a file written by writeTrace(). Returns false (with a message on
+// stderr) if it cannot be read or is not a trace.
+bool readTrace(const char* path, std::vector<TraceRecord>& records);
+
+// Print records, one per line, disassembling those from runs of `chunk`.
+// Runs of a chunk with a different code size are printed raw.
+void printTrace(const std::vector<TraceRecord>& records, const CompiledChunk& chunk);
+
+#endif // TRACE_HPP
@@ -1,17 +1,28 @@
 #include "vm.hpp"
 #include "compiler.hpp"
 #include "debug.hpp"
+#include "line_index.hpp"
 #include "object.hpp"
+#include "profiler.hpp"
+#include "sampler.hpp"
+#include "trace.hpp"
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <memory>
+#include <optional>
 
-VM::VM() : chunk_(nullptr), ip_(nullptr), stackTop_(nullptr), objects_(nullptr) {
+VM::VM()
+    : chunk_(nullptr), ip_(nullptr), stackTop_(nullptr), objects_(nullptr),
+      concatenations_(0), concatenatedBytes_(0),
+      result_(NIL_VAL()), printResult_(true),
+      optLevel_(0), parseMode_(ParseMode::RECURSIVE), lineMode_(LineMode::EAGER),
+      profile_(nullptr), trace_(nullptr), sampling_(false), timing_(false) {
     resetStack();
 }
 
 VM::~VM() {
-    freeObjects(objects_);
+    freeObjects(objects_, &heap_);
     objects_ = nullptr;
     setObjectList(nullptr);
 }
@@ -37,8 +48,9 @@ void VM::runtimeError(const char* format, ...) {
     va_end(args);
     fputs("\n", stderr);
 
-    size_t instruction = ip_ - chunk_->code().data() - 1;
+    size_t instruction = ip_ - chunk_->code() - 1;
     int line = chunk_->line(instruction);
+    if (!source_.empty()) line = LineIndex(source_).line(static_cast<size_t>(line));
     fprintf(stderr, "[line %d] in script\n", line);
     resetStack();
 }
@@ -52,6 +64,8 @@ void VM::concatenate() {
     ObjString* a = AS_STRING(pop());
 
     int length = a->length + b->length;
+    concatenations_++;
+    concatenatedBytes_ += static_cast<uint64_t>(length);
     char* chars = new char[length + 1];
     memcpy(chars, a->chars, a->length);
     memcpy(chars + a->length, b->chars, b->length);
@@ -61,31 +75,237 @@ void VM::concatenate() {
     push(OBJ_VAL(reinterpret_cast<Obj*>(result)));
 }
 
+VMStats VM::stats() const {
+    VMStats stats;
+    stats.heap = heap_;
+    stats.cacheHeap = cache_.heapStats();
+    stats.concatenations = concatenations_;
+    stats.concatenatedBytes = concatenatedBytes_;
+    stats.chunk = lastChunk_;
+    stats.builder = builder_.memory();
+    cache_.forEach([&stats](std::string_view, int, LineMode, const CompiledChunk& chunk) {
+        ChunkMemory memory = chunk.memory();
+        stats.cachedChunks.code += memory.code;
+        stats.cachedChunks.lines += memory.lines;
+        stats.cachedChunks.constants += memory.constants;
+        stats.cachedChunkCount++;
+    });
+    return stats;
+}
+
 InterpretResult VM::interpret(std::string_view source) {
-    Chunk chunk;
+    if (snapshot_.isOpen()) {
+        const CompiledChunk* saved = snapshot_.find(source, optLevel_, lineMode_);
+        if (saved != nullptr) {
+            setObjectList(&objects_, &heap_);
+            chunk_ = saved;
+            source_ = lineMode_ == LineMode::LAZY ? source : std::string_view();
+            ip_ = chunk_->code();
+            return run();
+        }
+    }
+
+    if (cache_.capacity() > 0) {
+        const CompiledChunk* cached = cache_.get(source, optLevel_, parseMode_, lineMode_,
+                                                 timing_ ? &timings_ : nullptr);
+
+        // The cache restores whatever list was set; the run allocates into ours.
+        setObjectList(&objects_, &heap_);
+
+        if (cached == nullptr) {
+            return InterpretResult::INTERPRET_COMPILE_ERROR;
+        }
+
+        chunk_ = cached;
+        source_ = lineMode_ == LineMode::LAZY ? source : std::string_view();
+        ip_ = chunk_->code();
+        return run();
+    }
+
+    builder_.clear();
 
     // Register our object list so allocations during compilation are tracked
-    setObjectList(&objects_);
+    setObjectList(&objects_, &heap_);
 
-    if (!compile(source, chunk)) {
+    if (!compile(source, builder_, optLevel_, parseMode_, lineMode_,
+                 timing_ ? &timings_ : nullptr)) {
         return InterpretResult::INTERPRET_COMPILE_ERROR;
     }
 
-    chunk_ = &chunk;
-    ip_ = const_cast<uint8_t*>(chunk_->code().data());
+    builder_.freeze(frozen_);
+    chunk_ = &frozen_;
+    source_ = lineMode_ == LineMode::LAZY ? source : std::string_view();
+    ip_ = chunk_->code();
     return run();
 }
 
-InterpretResult VM::interpret(Chunk* chunk) {
+InterpretResult VM::interpret(const Chunk* chunk) {
+    chunk->freeze(frozen_);
+    return interpret(frozen_);
+}
+
+InterpretResult VM::interpret(const Program& program) {
+    return interpret(program.chunk());
+}
+
+InterpretResult VM::interpret(const CompiledChunk& chunk) {
     // Register our object list for any allocations during execution
-    setObjectList(&objects_);
+    setObjectList(&objects_, &heap_);
 
-    chunk_ = chunk;
-    ip_ = const_cast<uint8_t*>(chunk_->code().data());
+    chunk_ = &chunk;
+    source_ = std::string_view();
+    ip_ = chunk_->code();
     return run();
 }
 
+// ---- Run loop hooks ----
+
+// Hooks for the plain loop: every call compiles away.
+struct NoHooks {
+    // Called before the instruction at `offset` executes.
+    void instruction(size_t /*offset*/, uint8_t /*op*/, int /*stackDepth*/) {}
+    // Called once the loop has returned.
+    void finish() {}
+};
+
+// Counts each opcode and adjacent pair, and charges the time until the
+// next dispatch to the opcode that was running.
+struct ProfileHooks {
+    explicit ProfileHooks(OpcodeProfile& profile) : profile(profile) {}
+
+    void instruction(size_t /*offset*/, uint8_t op, int /*stackDepth*/) {
+        uint64_t now = profileClock();
+        if (op >= OPCODE_COUNT) return;
+        profile.count(op);
+        if (previous >= 0) {
+            profile.addTicks(static_cast<uint8_t>(previous), now - started);
+            profile.countPair(static_cast<uint8_t>(previous), op);
+        }
+        previous = op;
+        started = now;
+    }
+
+    void finish() {
+        if (previous >= 0) {
+            profile.addTicks(static_cast<uint8_t>(previous), profileClock() - started);
+        }
+    }
+
+    OpcodeProfile& profile;
+    int previous = -1;
+    uint64_t started = 0;
+};
+
+// Appends a record per instruction to the VM's trace ring.
+struct TraceHooks {
+    TraceHooks(TraceBuffer& trace, size_t codeSize) : trace(trace) {
+        trace.record(profileClock(), static_cast<uint32_t>(codeSize), TRACE_RUN_START, 0);
+    }
+
+    void instruction(size_t offset, uint8_t op, int stackDepth) {
+        trace.record(profileClock(), static_cast<uint32_t>(offset), op,
+                     static_cast<uint16_t>(stackDepth));
+    }
+
+    void finish() {}
+
+    TraceBuffer& trace;
+};
+
+// Publishes the executing instruction for the SIGPROF handler of a
+// SamplingProfiler: one relaxed store per instruction.
+struct SampleHooks {
+    SampleHooks(const CompiledChunk& chunk, std::string_view source) {
+        // Line entries are source offsets: build the index now, since the
+        // handler cannot.
+        if (!source.empty()) {
+            lines.reset(new LineIndex(source));
+            lines->line(0);
+        }
+        SamplingProfiler::enter(chunk, lines.get());
+    }
+
+    // Unpublished on every way out of the loop, exceptions included: a
+    // later SIGPROF must not find a chunk that may have been freed.
+    ~SampleHooks() { SamplingProfiler::leave(); }
+
+    SampleHooks(const SampleHooks&) = delete;
+    SampleHooks& operator=(const SampleHooks&) = delete;
+
+    void instruction(size_t offset, uint8_t /*op*/, int /*stackDepth*/) {
+        SamplingProfiler::at(offset);
+    }
+
+    void finish() {}
+
+    std::unique_ptr<LineIndex> lines;
+};
+
+// More than one kind of hook at once. Each is checked per instruction, so
+// the loops with a single kind stay lean.
+struct MultiHooks {
+    void instruction(size_t offset, uint8_t op, int stackDepth) {
+        if (profile) profile->instruction(offset, op, stackDepth);
+        if (trace) trace->instruction(offset, op, stackDepth);
+        if (sample) sample->instruction(offset, op, stackDepth);
+    }
+
+    void finish() {
+        if (profile) profile->finish();
+        if (trace) trace->finish();
+        if (sample) sample->finish();
+    }
+
+    std::optional<ProfileHooks> profile;
+    std::optional<TraceHooks> trace;
+    std::optional<SampleHooks> sample;
+};
+
 InterpretResult VM::run() {
+    // Kept by value: the chunk (a Program's, say) may be gone by stats().
+    lastChunk_ = chunk_->memory();
+
+    if (!timing_) return dispatch();
+    uint64_t start = phaseClock();
+    InterpretResult result = dispatch();
+    timings_.record(Phase::EXECUTE, phaseClock() - start);
+    return result;
+}
+
+// Pick the loop instantiation for the enabled hooks.
+InterpretResult VM::dispatch() {
+    int enabled = (profile_ != nullptr) + (trace_ != nullptr) + sampling_;
+    if (enabled == 0) {
+        NoHooks hooks;
+        return execute(hooks);
+    }
+
+    auto runWith = [this](auto& hooks) {
+        InterpretResult result = execute(hooks);
+        hooks.finish();
+        return result;
+    };
+    if (enabled > 1) {
+        MultiHooks hooks;
+        if (profile_ != nullptr) hooks.profile.emplace(*profile_);
+        if (trace_ != nullptr) hooks.trace.emplace(*trace_, chunk_->count());
+        if (sampling_) hooks.sample.emplace(*chunk_, source_);
+        return runWith(hooks);
+    }
+    if (profile_ != nullptr) {
+        ProfileHooks hooks(*profile_);
+        return runWith(hooks);
+    }
+    if (trace_ != nullptr) {
+        TraceHooks hooks(*trace_, chunk_->count());
+        return runWith(hooks);
+    }
+    SampleHooks hooks(*chunk_, source_);
+    return runWith(hooks);
+}
+
+template <typename Hooks>
+InterpretResult VM::execute(Hooks& hooks) {
 #define READ_BYTE() (*ip_++)
 #define READ_CONSTANT() (chunk_->constant(READ_BYTE()))
 #define BINARY_OP(valueType, op) \
@@ -98,6 +318,14 @@ InterpretResult VM::run() {
         double a = AS_NUMBER(pop()); \
         push(valueType(a op b)); \
     } while (false)
+// Operands already proven to be numbers by the compiler: work in place.
+#define NUMBER_OP(valueType, op) \
+    do { \
+        double b = AS_NUMBER(stackTop_[-1]); \
+        double a = AS_NUMBER(stackTop_[-2]); \
+        stackTop_[-2] = valueType(a op b); \
+        stackTop_--; \
+    } while (false)
 
     for (;;) {
 #ifdef DEBUG_TRACE_EXECUTION
@@ -110,11 +338,13 @@ InterpretResult VM::run() {
         }
         printf("\n");
         disassembleInstruction(*chunk_,
-            static_cast<int>(ip_ - chunk_->code().data()));
+            static_cast<int>(ip_ - chunk_->code()));
 #endif
 
-        uint8_t instruction;
-        switch (instruction = READ_BYTE()) {
+        uint8_t instruction = READ_BYTE();
+        hooks.instruction(static_cast<size_t>(ip_ - chunk_->code() - 1), instruction,
+                          static_cast<int>(stackTop_ - stack_));
+        switch (instruction) {
             case static_cast<uint8_t>(OpCode::OP_CONSTANT): {
                 Value constant = READ_CONSTANT();
                 push(constant);
@@ -160,14 +390,27 @@ InterpretResult VM::run() {
                 break;
             }
             case static_cast<uint8_t>(OpCode::OP_RETURN): {
-                printValue(pop());
-                printf("\n");
+                result_ = pop();
+                if (printResult_) {
+                    printValue(result_);
+                    printf("\n");
+                }
                 return InterpretResult::INTERPRET_OK;
             }
+            case static_cast<uint8_t>(OpCode::OP_GREATER_NUMBER):  NUMBER_OP(BOOL_VAL, >); break;
+            case static_cast<uint8_t>(OpCode::OP_LESS_NUMBER):     NUMBER_OP(BOOL_VAL, <); break;
+            case static_cast<uint8_t>(OpCode::OP_ADD_NUMBER):      NUMBER_OP(NUMBER_VAL, +); break;
+            case static_cast<uint8_t>(OpCode::OP_SUBTRACT_NUMBER): NUMBER_OP(NUMBER_VAL, -); break;
+            case static_cast<uint8_t>(OpCode::OP_MULTIPLY_NUMBER): NUMBER_OP(NUMBER_VAL, *); break;
+            case static_cast<uint8_t>(OpCode::OP_DIVIDE_NUMBER):   NUMBER_OP(NUMBER_VAL, /); break;
+            case static_cast<uint8_t>(OpCode::OP_NEGATE_NUMBER):
+                stackTop_[-1] = NUMBER_VAL(-AS_NUMBER(stackTop_[-1]));
+                break;
         }
     }
 
 #undef READ_BYTE
 #undef READ_CONSTANT
 #undef BINARY_OP
+#undef NUMBER_OP
 }
@@ -2,11 +2,17 @@
 #define VM_HPP
 
 #include "chunk.hpp"
+#include "chunk_cache.hpp"
+#include "phase_timing.hpp"
+#include "program.hpp"
+#include "snapshot.hpp"
 #include "value.hpp"
 #include <string_view>
 
-// Forward declaration
+// Forward declarations
 struct Obj;
+class OpcodeProfile;
+class TraceBuffer;
 
 constexpr int STACK_MAX = 256;
 
@@ -16,6 +22,18 @@ enum class InterpretResult {
     INTERPRET_RUNTIME_ERROR,
 };
 
+// Memory held by a VM (see VM::stats()).
+struct VMStats {
+    HeapStats heap;             // Objects the VM owns: constants, results
+    HeapStats cacheHeap;        // String constants of cached chunks
+    uint64_t concatenations = 0;
+    uint64_t concatenatedBytes = 0;     // Characters copied by OP_ADD on strings
+    ChunkMemory chunk;          // Chunk of the most recent run
+    ChunkMemory builder;        // Scratch chunk reused by uncached compiles
+    ChunkMemory cachedChunks;   // All resident cache entries
+    size_t cachedChunkCount = 0;
+};
+
 class VM {
 public:
     VM();
@@ -25,7 +43,73 @@ public:
     InterpretResult interpret(std::string_view source);
 
     // Interpret a pre-built chunk of bytecode (for direct bytecode tests)
-    InterpretResult interpret(Chunk* chunk);
+    InterpretResult interpret(const Chunk* chunk);
+
+    // Run a frozen chunk (see Chunk::freeze()) without copying it.
+    InterpretResult interpret(const CompiledChunk& chunk);
+
+    // Run a shared program. Many VMs may run the same program at once.
+    InterpretResult interpret(const Program& program);
+
+    // Value of the last successful run. Strings stay valid as long as the
+    // VM does.
+    Value result() const { return result_; }
+
+    // Print each result to stdout (the default). Embedders and benchmarks
+    // that only want result() turn it off, which also keeps runs on
+    // different threads off the shared stdout lock.
+    void setPrintResult(bool enabled) { printResult_ = enabled; }
+
+    // Optimization level passed to compile() by interpret(source).
+    void setOptLevel(int level) { optLevel_ = level; }
+    int optLevel() const { return optLevel_; }
+
+    // Parser nesting strategy used by interpret(source). Use
+    // ParseMode::EXPLICIT_STACK for deeply nested generated input.
+    void setParseMode(ParseMode mode) { parseMode_ = mode; }
+
+    // Line bookkeeping used by interpret(source). With LineMode::LAZY the
+    // compiler records source offsets and runtimeError() turns them into a
+    // line only when an error is reported.
+    void setLineMode(LineMode mode) { lineMode_ = mode; }
+
+    // Compiled-chunk cache used by interpret(source). Disabled (capacity 0)
+    // by default.
+    void setCacheCapacity(size_t capacity) { cache_.setCapacity(capacity); }
+    const ChunkCacheStats& cacheStats() const { return cache_.stats(); }
+
+    // Current memory use and allocation counters.
+    VMStats stats() const;
+
+    // Time the phases of every evaluation (off by default; when off the
+    // cost is a branch per compile and per run). Times accumulate into
+    // phaseTimings() until it is cleared.
+    void setPhaseTiming(bool enabled) { timing_ = enabled; }
+    const PhaseTimings& phaseTimings() const { return timings_; }
+    PhaseTimings& phaseTimings() { return timings_; }
+
+    // Write every chunk in the cache to a snapshot file (see Snapshot).
+    bool saveSnapshot(const char* path) const { return Snapshot::write(cache_, path); }
+
+    // Map a snapshot. interpret(source) then runs a chunk from it, when it
+    // has one for the source and current settings, instead of compiling.
+    // Returns false (and keeps running without one) if it cannot be used.
+    bool loadSnapshot(const char* path) { return snapshot_.open(path); }
+
+    // Count and time every instruction run() executes into `profile`
+    // (nullptr, the default, stops). Profiling runs a separately
+    // instantiated loop, so VMs without a profile pay nothing for it.
+    void setProfile(OpcodeProfile* profile) { profile_ = profile; }
+
+    // Record every instruction run() executes in `trace` (see TraceBuffer;
+    // nullptr, the default, stops). Like profiling, this runs its own
+    // instantiation of the loop.
+    void setTrace(TraceBuffer* trace) { trace_ = trace; }
+
+    // Publish the instruction run() is executing, so a running
+    // SamplingProfiler can attribute its samples to source lines (off by
+    // default; also a loop instantiation of its own).
+    void setSampling(bool enabled) { sampling_ = enabled; }
 
     // Stack operations (public for testing)
     void push(Value value);
@@ -40,16 +124,42 @@ public:
 
 private:
     InterpretResult run();
+    InterpretResult dispatch();
+
+    // The dispatch loop, with `hooks` told about every instruction (see
+    // NoHooks in vm.cpp for the interface).
+    template <typename Hooks>
+    InterpretResult execute(Hooks& hooks);
+
     void resetStack();
     void runtimeError(const char* format, ...);
     bool isFalsey(Value value);
     void concatenate();
 
-    Chunk* chunk_;
-    uint8_t* ip_;           // Instruction pointer
+    const CompiledChunk* chunk_;
+    std::string_view source_;   // Source of chunk_ if its lines are offsets
+    const uint8_t* ip_;     // Instruction pointer
     Value stack_[STACK_MAX];
     Value* stackTop_;       // Points just past the top element
     Obj* objects_;          // Head of linked list of all heap objects
+    HeapStats heap_;        // Counters for objects_
+    uint64_t concatenations_;
+    uint64_t concatenatedBytes_;
+    ChunkMemory lastChunk_; // Memory of the chunk run last
+    Value result_;          // Value returned by the last run
+    bool printResult_;      // Print results on OP_RETURN?
+    int optLevel_;          // Compiler optimization level (0 = none)
+    ParseMode parseMode_;   // Compiler nesting strategy
+    LineMode lineMode_;     // Compiler line bookkeeping
+    ChunkCache cache_;      // Compiled chunks keyed by source
+    Snapshot snapshot_;     // Chunks compiled by an earlier VM, if loaded
+    Chunk builder_;         // Reused by uncached interpret(source) calls
+    CompiledChunk frozen_;  // Execution copy of builder_, block reused
+    OpcodeProfile* profile_;    // Per-opcode profile, if profiling
+    TraceBuffer* trace_;        // Instruction trace ring, if tracing
+    bool sampling_;             // Publish the current instruction?
+    bool timing_;               // Record phases into timings_?
+    PhaseTimings timings_;
 };
 
 #endif // VM_HPP
@@ -1,11 +1,21 @@
 #include "vm.hpp"
+#include "bytecode_file.hpp"
 #include "chunk.hpp"
+#include "compiler.hpp"
 #include "debug.hpp"
 #include "object.hpp"
+#include "profiler.hpp"
+#include "sampler.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <chrono>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
+#include <initializer_list>
 #include <string>
+#include <thread>
+#include <vector>
 
 // Simple test framework
 static int tests_run = 0;
@@ -309,6 +319,28 @@ TEST(test_vm_negate_non_number_error) {
     assert(result == InterpretResult::INTERPRET_RUNTIME_ERROR);
 }
 
+TEST(test_vm_frozen_chunk) {
+    // A frozen chunk runs as often as needed, and keeps its line table.
+    Chunk chunk;
+    emitConstant(chunk, 2.0, 1);
+    emitOp(chunk, OpCode::OP_NEGATE, 1);
+    emitOp(chunk, OpCode::OP_RETURN, 1);
+    CompiledChunk frozen = chunk.freeze();
+
+    VM vm;
+    printf("\n");
+    assert(vm.interpret(frozen) == InterpretResult::INTERPRET_OK);
+    assert(vm.interpret(frozen) == InterpretResult::INTERPRET_OK);
+
+    Chunk failing;
+    emitOp(failing, OpCode::OP_TRUE, 1);
+    emitOp(failing, OpCode::OP_NEGATE, 3);
+    emitOp(failing, OpCode::OP_RETURN, 3);
+    CompiledChunk frozenFailing = failing.freeze();
+    assert(frozenFailing.line(1) == 3);
+    assert(vm.interpret(frozenFailing) == InterpretResult::INTERPRET_RUNTIME_ERROR);
+}
+
 TEST(test_vm_add_type_error) {
     // OP_TRUE, push 1.0, OP_ADD should produce a runtime error
     Chunk chunk;
@@ -427,6 +459,616 @@ TEST(test_vm_string_number_add_error) {
     setObjectList(nullptr);
 }
 
+// ---- Unchecked numeric opcodes ----
+
+TEST(test_vm_unchecked_number_ops) {
+    // -(8 / 2 - 1 * 3 + 4) < 0 == true, built from unchecked opcodes
+    Chunk chunk;
+    emitConstant(chunk, 8.0, 1);
+    emitConstant(chunk, 2.0, 1);
+    emitOp(chunk, OpCode::OP_DIVIDE_NUMBER, 1);
+    emitConstant(chunk, 1.0, 1);
+    emitConstant(chunk, 3.0, 1);
+    emitOp(chunk, OpCode::OP_MULTIPLY_NUMBER, 1);
+    emitOp(chunk, OpCode::OP_SUBTRACT_NUMBER, 1);
+    emitConstant(chunk, 4.0, 1);
+    emitOp(chunk, OpCode::OP_ADD_NUMBER, 1);
+    emitOp(chunk, OpCode::OP_NEGATE_NUMBER, 1);
+    emitConstant(chunk, 0.0, 1);
+    emitOp(chunk, OpCode::OP_LESS_NUMBER, 1);
+    emitOp(chunk, OpCode::OP_RETURN, 1);
+
+    VM vm;
+    printf("\n");
+    assert(vm.interpret(&chunk) == InterpretResult::INTERPRET_OK);
+    assert(vm.stackSize() == 0);
+}
+
+TEST(test_vm_unchecked_greater) {
+    Chunk chunk;
+    emitConstant(chunk, 3.0, 1);
+    emitConstant(chunk, 2.0, 1);
+    emitOp(chunk, OpCode::OP_GREATER_NUMBER, 1);
+    emitOp(chunk, OpCode::OP_RETURN, 1);
+
+    VM vm;
+    printf("\n");
+    assert(vm.interpret(&chunk) == InterpretResult::INTERPRET_OK);
+}
+
+// ---- Compiled-chunk cache ----
+
+TEST(test_vm_cache_disabled_by_default) {
+    VM vm;
+    printf("\n");
+    assert(vm.interpret("1 + 2") == InterpretResult::INTERPRET_OK);
+    assert(vm.interpret("1 + 2") == InterpretResult::INTERPRET_OK);
+    assert(vm.cacheStats().hits == 0);
+    assert(vm.cacheStats().misses == 0);
+}
+
+TEST(test_vm_cache_hits) {
+    VM vm;
+    vm.setCacheCapacity(4);
+    printf("\n");
+    for (int i = 0; i < 3; i++) {
+        assert(vm.interpret("(1 + 2) * 3") == InterpretResult::INTERPRET_OK);
+    }
+    assert(vm.cacheStats().misses == 1);
+    assert(vm.cacheStats().hits == 2);
+    assert(vm.cacheStats().evictions == 0);
+}
+
+TEST(test_vm_cache_lru_eviction) {
+    VM vm;
+    vm.setCacheCapacity(2);
+    printf("\n");
+    vm.interpret("1");
+    vm.interpret("2");
+    vm.interpret("3");                  // evicts "1"
+    assert(vm.cacheStats().evictions == 1);
+    vm.interpret("1");                  // miss, evicts "2"
+    vm.interpret("3");                  // hit
+    assert(vm.cacheStats().misses == 4);
+    assert(vm.cacheStats().hits == 1);
+    assert(vm.cacheStats().evictions == 2);
+}
+
+TEST(test_vm_cache_string_constants) {
+    // Cached string constants must survive across interpret() calls.
+    VM vm;
+    vm.setCacheCapacity(4);
+    printf("\n");
+    for (int i = 0; i < 3; i++) {
+        assert(vm.interpret("\"foo\" + \"bar\" == \"foobar\"") ==
+               InterpretResult::INTERPRET_OK);
+    }
+    assert(vm.cacheStats().hits == 2);
+}
+
+TEST(test_vm_cache_keyed_by_opt_level) {
+    VM vm;
+    vm.setCacheCapacity(4);
+    printf("\n");
+    vm.interpret("1 * 1");
+    vm.setOptLevel(2);
+    vm.interpret("1 * 1");
+    assert(vm.cacheStats().misses == 2);
+    assert(vm.cacheStats().hits == 0);
+}
+
+TEST(test_vm_cache_skips_compile_errors) {
+    VM vm;
+    vm.setCacheCapacity(4);
+    printf("\n");
+    assert(vm.interpret("(1 +") == InterpretResult::INTERPRET_COMPILE_ERROR);
+    assert(vm.interpret("(1 +") == InterpretResult::INTERPRET_COMPILE_ERROR);
+    assert(vm.cacheStats().misses == 2);
+    assert(vm.cacheStats().hits == 0);
+}
+
+TEST(test_chunk_cache_shrink) {
+    ChunkCache cache(3);
+    assert(cache.get("1", 0) != nullptr);
+    assert(cache.get("2", 0) != nullptr);
+    assert(cache.get("3", 0) != nullptr);
+    assert(cache.size() == 3);
+    cache.setCapacity(1);
+    assert(cache.size() == 1);
+    assert(cache.stats().evictions == 2);
+    assert(cache.get("3", 0) != nullptr);   // most recent entry survives
+    assert(cache.stats().hits == 1);
+}
+
+TEST(test_chunk_cache_restores_object_list) {
+    Obj* objects = nullptr;
+    HeapStats heap;
+    setObjectList(&objects, &heap);
+    ChunkCache cache(2);
+    assert(cache.get("\"a\" + \"b\"", 0) != nullptr);   // Miss: entry's own list
+    assert(objects == nullptr && cache.heapStats().allocations == 2);
+
+    // Still ours afterwards.
+    copyString("c", 1);
+    assert(objects != nullptr && heap.allocations == 1);
+    freeObjects(objects, &heap);
+    setObjectList(nullptr);
+}
+
+TEST(test_vm_result) {
+    VM vm;
+    vm.setPrintResult(false);
+    assert(IS_NIL(vm.result()));
+    assert(vm.interpret("1 + 2") == InterpretResult::INTERPRET_OK);
+    assert(AS_NUMBER(vm.result()) == 3);
+    assert(vm.interpret("\"a\" + \"b\"") == InterpretResult::INTERPRET_OK);
+    assert(strcmp(AS_CSTRING(vm.result()), "ab") == 0);
+}
+
+TEST(test_vm_shared_program) {
+    // One program, run concurrently by a VM per thread. The constants
+    // outlive every VM; the concatenated results belong to each VM.
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    ProgramHandle program = Program::compile("\"shared\" + \" program\" == \"shared program\"");
+    assert(program != nullptr);
+    assert(Program::compile("(1 +") == nullptr);
+    copyString("c", 1);             // Still goes to the caller's list
+    assert(objects != nullptr && objects->next == nullptr);
+    freeObjects(objects);
+    setObjectList(nullptr);
+
+    const int kThreads = 4;
+    const int kRuns = 50;
+    std::atomic<int> ok{0};
+
+    FILE* savedStdout = stdout;
+    FILE* devnull = fopen("/dev/null", "w");
+    stdout = devnull;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([program, &ok]() {
+            VM vm;
+            for (int i = 0; i < kRuns; i++) {
+                if (vm.interpret(*program) == InterpretResult::INTERPRET_OK) ok++;
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    stdout = savedStdout;
+    fclose(devnull);
+
+    assert(ok == kThreads * kRuns);
+    assert(program.use_count() == 1);
+    assert(strcmp(AS_CSTRING(program->chunk().constant(0)), "shared") == 0);
+}
+
+TEST(test_bytecode_file) {
+    const char* path = "vm_test_bytecode.loxc";
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    Chunk chunk;
+    assert(compile("(\"a\" + \"bc\" == \"abc\") ==\n!(1.5 < 2)", chunk));
+    setObjectList(nullptr);
+    assert(writeBytecode(chunk, path));
+    freeObjects(objects);
+
+    BytecodeFile bytecode;
+    assert(bytecode.open(path));
+    const CompiledChunk& loaded = bytecode.chunk();
+    assert(loaded.count() == chunk.count());
+    assert(loaded.constantCount() == chunk.constants().size());
+    for (size_t i = 0; i < chunk.count(); i++) {
+        assert(loaded.code(i) == chunk.code(i));
+        assert(loaded.line(i) == chunk.line(i));
+    }
+    assert(loaded.code(chunk.count() - 1) == static_cast<uint8_t>(OpCode::OP_RETURN));
+    assert(strcmp(AS_CSTRING(loaded.constant(1)), "bc") == 0);
+    assert(AS_NUMBER(loaded.constant(3)) == 1.5);
+
+    VM vm;
+    printf("\n");
+    assert(vm.interpret(loaded) == InterpretResult::INTERPRET_OK);
+
+    // Any flipped byte fails the checksum; a short file fails the size check.
+    std::string contents;
+    FILE* file = fopen(path, "rb");
+    for (int c; (c = fgetc(file)) != EOF;) contents.push_back(static_cast<char>(c));
+    fclose(file);
+    assert(bytecode.load(contents));
+    std::string corrupt = contents;
+    corrupt[corrupt.size() - 3] ^= 1;
+    assert(!bytecode.load(corrupt));
+    assert(strcmp(bytecode.error(), "checksum mismatch") == 0);
+    assert(!bytecode.load(std::string_view(contents).substr(0, contents.size() - 1)));
+    assert(!bytecode.load("1 + 2"));
+    assert(!isBytecode("1 + 2"));
+
+    remove(path);
+    assert(!bytecode.open(path));
+}
+
+// Recompute an edited image's checksum, so only the verifier can catch it.
+static void resealBytecode(std::string& image) {
+    BytecodeHeader header;
+    memcpy(&header, image.data(), sizeof(header));
+    header.checksum = hashSource(std::string_view(image).substr(sizeof(header)));
+    memcpy(&image[0], &header, sizeof(header));
+}
+
+// Constant 0 is the number 1, constant 1 the string "s".
+static bool loadsCode(std::initializer_list<uint8_t> code) {
+    Obj* objects = nullptr;
+    setObjectList(&objects);
+    Chunk chunk;
+    chunk.addConstant(NUMBER_VAL(1));
+    chunk.addConstant(OBJ_VAL(reinterpret_cast<Obj*>(copyString("s", 1))));
+    setObjectList(nullptr);
+    for (uint8_t byte : code) chunk.write(byte, 1);
+    BytecodeFile bytecode;
+    bool loaded = bytecode.load(encodeBytecode(chunk.freeze()));
+    assert(loaded || strcmp(bytecode.error(), "invalid bytecode") == 0);
+    freeObjects(objects);
+    return loaded;
+}
+
+TEST(test_bytecode_file_verifier) {
+    const uint8_t constant = static_cast<uint8_t>(OpCode::OP_CONSTANT);
+    const uint8_t add = static_cast<uint8_t>(OpCode::OP_ADD);
+    const uint8_t ret = static_cast<uint8_t>(OpCode::OP_RETURN);
+    assert(loadsCode({constant, 0, constant, 0, add, ret}));
+    assert(!loadsCode({constant, 0, 0xfe, ret}));              // Unknown opcode
+    assert(!loadsCode({constant, 2, ret}));                     // Constant past the pool
+    assert(!loadsCode({constant, 0}));                          // Operand missing
+    assert(!loadsCode({constant, 0, add, ret}));                // Stack underflow
+    assert(!loadsCode({ret}));                                  // Nothing to return
+    assert(!loadsCode({constant, 0, constant, 0}));             // No OP_RETURN
+
+    // Unchecked opcodes need operands proven to be numbers.
+    const uint8_t addNumber = static_cast<uint8_t>(OpCode::OP_ADD_NUMBER);
+    const uint8_t negateNumber = static_cast<uint8_t>(OpCode::OP_NEGATE_NUMBER);
+    const uint8_t negate = static_cast<uint8_t>(OpCode::OP_NEGATE);
+    const uint8_t lessNumber = static_cast<uint8_t>(OpCode::OP_LESS_NUMBER);
+    const uint8_t truth = static_cast<uint8_t>(OpCode::OP_TRUE);
+    assert(!loadsCode({constant, 1, constant, 0, addNumber, ret}));
+    assert(!loadsCode({constant, 0, truth, addNumber, ret}));
+    assert(!loadsCode({constant, 1, negateNumber, ret}));
+    assert(!loadsCode({constant, 0, constant, 0, lessNumber, negateNumber, ret}));
+    assert(!loadsCode({constant, 0, constant, 1, add, constant, 0, addNumber, ret}));
+    assert(loadsCode({constant, 0, constant, 0, addNumber, negateNumber, ret}));
+    assert(loadsCode({constant, 1, negate, constant, 0, addNumber, ret}));  // Or an error
+
+    // Line tables: no strings, so the encoding is the end of the image.
+    Chunk chunk;
+    chunk.addConstant(NUMBER_VAL(1));
+    for (int line = 1; line <= 40; line++) {    // 40 runs: three checkpoints
+        chunk.write(constant, line);
+        chunk.write(0, line);
+        if (line > 1) chunk.write(add, line);
+    }
+    chunk.write(ret, 40);
+    std::string image = encodeBytecode(chunk.freeze());
+    BytecodeFile bytecode;
+    assert(bytecode.load(image));
+
+    BytecodeHeader header;
+    memcpy(&header, image.data(), sizeof(header));
+    size_t checkpointsAt = sizeof(header) + header.constantCount * sizeof(StoredConstant);
+    size_t linesAt = image.size() - header.lineByteCount;
+    auto rejects = [&](std::string edited) {
+        resealBytecode(edited);
+        BytecodeFile file;
+        return !file.load(edited) && strcmp(file.error(), "corrupt line table") == 0;
+    };
+    auto checkpointField = [&](size_t index, size_t field) {
+        return checkpointsAt + index * sizeof(LineTable::Checkpoint) + field * 4;
+    };
+
+    // Ends after a run's distance, without its line change.
+    std::string truncated = image.substr(0, image.size() - 1);
+    header.lineByteCount--;
+    memcpy(&truncated[0], &header, sizeof(header));
+    header.lineByteCount++;
+    assert(rejects(truncated));
+
+    std::string edited = image;
+    edited[image.size() - 1] |= 0x80;           // Last varint runs off the end
+    assert(rejects(edited));
+    edited = image;
+    edited[linesAt + 2] = 0x7f;                 // Second run starts past the code
+    assert(rejects(edited));
+    edited = image;
+    edited[checkpointField(1, 2)]--;            // Position mid-entry
+    assert(rejects(edited));
+    edited = image;
+    edited[checkpointField(1, 0)]++;            // Offset disagrees with the runs
+    assert(rejects(edited));
+    edited = image;
+    edited[checkpointField(2, 1)]++;            // Line disagrees with the runs
+    assert(rejects(edited));
+    edited = image;                             // Out of order
+    std::swap_ranges(edited.begin() + checkpointField(1, 0), edited.begin() + checkpointField(2, 0),
+                     edited.begin() + checkpointField(2, 0));
+    assert(rejects(edited));
+}
+
+TEST(test_vm_snapshot) {
+    const char* path = "vm_test_snapshot.loxs";
+    const char* prelude[] = {"\"pre\" + \"lude\"", "1 + 2 * 3", "!nil == true"};
+
+    {
+        VM vm;
+        vm.setCacheCapacity(8);
+        printf("\n");
+        for (const char* source : prelude) vm.interpret(source);
+        vm.setLineMode(LineMode::LAZY);
+        vm.interpret("true +\n1");     // Runtime error, but compiled and cached
+        assert(vm.saveSnapshot(path));
+    }
+
+    VM vm;
+    vm.setCacheCapacity(8);
+    assert(vm.loadSnapshot(path));
+    for (const char* source : prelude) {
+        assert(vm.interpret(source) == InterpretResult::INTERPRET_OK);
+    }
+    assert(vm.cacheStats().misses == 0);
+
+    // Settings are part of the key.
+    vm.setOptLevel(2);
+    vm.interpret("1 + 2 * 3");
+    assert(vm.cacheStats().misses == 1);
+    vm.setOptLevel(0);
+
+    // Lines of a LAZY chunk still resolve against the source.
+    vm.setLineMode(LineMode::LAZY);
+    FILE* savedStderr = stderr;
+    FILE* errors = tmpfile();
+    stderr = errors;
+    InterpretResult result = vm.interpret("true +\n1");
+    stderr = savedStderr;
+    assert(result == InterpretResult::INTERPRET_RUNTIME_ERROR);
+    assert(vm.cacheStats().misses == 1);
+    char message[128] = {};
+    rewind(errors);
+    fread(message, 1, sizeof(message) - 1, errors);
+    fclose(errors);
+    assert(strstr(message, "[line 2]") != nullptr);
+
+    VM other;
+    FILE* garbage = fopen(path, "wb");
+    fputs("not a snapshot", garbage);
+    fclose(garbage);
+    assert(!other.loadSnapshot(path));
+    assert(other.interpret("1") == InterpretResult::INTERPRET_OK);
+    remove(path);
+}
+
+TEST(test_hash_source) {
+    assert(hashSource("1 + 2") == hashSource(std::string("1 + 2")));
+    assert(hashSource("1 + 2") != hashSource("1 + 3"));
+    assert(hashSource("12345678a") != hashSource("12345678b"));
+}
+
+TEST(test_vm_profile) {
+    OpcodeProfile profile;
+    VM vm;
+    FILE* savedStdout = stdout;
+    FILE* savedStderr = stderr;
+    stdout = stderr = fopen("/dev/null", "w");
+    vm.interpret("1 + 2 * 3");      // Not profiled
+    vm.setProfile(&profile);
+    vm.interpret("1 + 2 * 3");      // CONSTANT x3, MULTIPLY_NUMBER, ADD_NUMBER, RETURN
+    vm.interpret("-true");          // TRUE, NEGATE (fails)
+    vm.setProfile(nullptr);
+    vm.interpret("1 + 2 * 3");
+    fclose(stdout);
+    stdout = savedStdout;
+    stderr = savedStderr;
+
+    assert(profile.instructions() == 8);
+    assert(profile.count(OpCode::OP_CONSTANT) == 3);
+    assert(profile.count(OpCode::OP_MULTIPLY_NUMBER) == 1);
+    assert(profile.count(OpCode::OP_NEGATE) == 1);
+    assert(profile.count(OpCode::OP_RETURN) == 1);
+    assert(profile.pairCount(OpCode::OP_CONSTANT, OpCode::OP_CONSTANT) == 2);
+    assert(profile.pairCount(OpCode::OP_MULTIPLY_NUMBER, OpCode::OP_ADD_NUMBER) == 1);
+    assert(profile.pairCount(OpCode::OP_TRUE, OpCode::OP_NEGATE) == 1);
+    // Runs are profiled separately: no pair across them.
+    assert(profile.pairCount(OpCode::OP_RETURN, OpCode::OP_TRUE) == 0);
+    assert(profile.ticks(OpCode::OP_RETURN) > 0);
+
+    FILE* report = tmpfile();
+    profile.printJson(report);
+    rewind(report);
+    char json[4096] = {};
+    fread(json, 1, sizeof(json) - 1, report);
+    fclose(report);
+    assert(strstr(json, "\"instructions\": 8") != nullptr);
+    assert(strstr(json, "{\"name\": \"OP_CONSTANT\", \"count\": 3,") != nullptr);
+    assert(strstr(json, "\"first\": \"OP_CONSTANT\", \"second\": \"OP_CONSTANT\", \"count\": 2}") != nullptr);
+}
+
+TEST(test_vm_trace) {
+    TraceBuffer trace(6);           // Rounded up to 8
+    assert(trace.capacity() == 8);
+
+    VM vm;
+    vm.setTrace(&trace);
+    FILE* savedStdout = stdout;
+    stdout = fopen("/dev/null", "w");
+    vm.interpret("1 + 2");          // CONSTANT, CONSTANT, ADD_NUMBER, RETURN
+    fclose(stdout);
+    stdout = savedStdout;
+
+    std::vector<TraceRecord> records = trace.snapshot();
+    assert(records.size() == 5);
+    assert(records[0].opcode == TRACE_RUN_START && records[0].offset == 6);
+    const uint8_t ops[] = {static_cast<uint8_t>(OpCode::OP_CONSTANT),
+                           static_cast<uint8_t>(OpCode::OP_CONSTANT),
+                           static_cast<uint8_t>(OpCode::OP_ADD_NUMBER),
+                           static_cast<uint8_t>(OpCode::OP_RETURN)};
+    const uint32_t offsets[] = {0, 2, 4, 5};
+    const uint16_t depths[] = {0, 1, 2, 1};
+    for (int i = 0; i < 4; i++) {
+        assert(records[i + 1].opcode == ops[i]);
+        assert(records[i + 1].offset == offsets[i]);
+        assert(records[i + 1].stackDepth == depths[i]);
+        assert(records[i + 1].timestamp >= records[i].timestamp);
+    }
+
+    // A second run wraps the ring: only the newest 8 records remain.
+    stdout = fopen("/dev/null", "w");
+    vm.interpret("1 + 2");
+    fclose(stdout);
+    stdout = savedStdout;
+    records = trace.snapshot();
+    assert(trace.recorded() == 10);
+    assert(records.size() == 8);
+    assert(records[0].offset == 2 && records[3].opcode == TRACE_RUN_START);
+
+    const char* path = "vm_test_trace.bin";
+    assert(writeTrace(trace, path));
+    std::vector<TraceRecord> loaded;
+    assert(readTrace(path, loaded));
+    assert(loaded.size() == 8);
+    assert(memcmp(loaded.data(), records.data(), 8 * sizeof(TraceRecord)) == 0);
+
+    // A record count that disagrees with the file size is rejected before
+    // anything is allocated for it.
+    FILE* file = fopen(path, "r+b");
+    uint64_t huge = uint64_t{1} << 60;
+    fseek(file, 8, SEEK_SET);                   // TraceHeader::recordCount
+    fwrite(&huge, sizeof(huge), 1, file);
+    fclose(file);
+    FILE* savedStderr = stderr;
+    stderr = fopen("/dev/null", "w");
+    assert(!readTrace(path, loaded) && loaded.empty());
+    fclose(stderr);
+    stderr = savedStderr;
+    remove(path);
+}
+
+TEST(test_vm_stats) {
+    const size_t header = sizeof(ObjString) + 1;    // Plus the length
+    FILE* savedStdout = stdout;
+    stdout = fopen("/dev/null", "w");
+
+    VM vm;
+    vm.interpret("\"ab\" + \"cde\"");
+    VMStats stats = vm.stats();
+    assert(stats.heap.liveObjects[static_cast<int>(ObjType::OBJ_STRING)] == 3);
+    assert(stats.heap.liveByteCount() == 3 * header + 2 + 3 + 5);
+    assert(stats.heap.peakBytes == stats.heap.liveByteCount());
+    assert(stats.heap.allocations == 3);
+    assert(stats.concatenations == 1 && stats.concatenatedBytes == 5);
+    assert(stats.chunk.code == 6 && stats.chunk.constants == 2 * sizeof(Value));
+    assert(stats.chunk.lines > 0 && stats.builder.code >= 6);
+    assert(stats.cachedChunkCount == 0);
+
+    // Cached constants are owned, and counted, by the cache.
+    VM cached;
+    cached.setCacheCapacity(4);
+    cached.interpret("\"ab\" + \"cde\"");
+    cached.interpret("\"ab\" + \"cde\"");
+    stats = cached.stats();
+    assert(stats.heap.liveObjectCount() == 2);
+    assert(stats.cacheHeap.liveObjectCount() == 2);
+    assert(stats.cachedChunkCount == 1 && stats.cachedChunks.code == 6);
+    cached.setCacheCapacity(0);
+    assert(cached.stats().cacheHeap.liveObjectCount() == 0);
+    assert(cached.stats().cacheHeap.peakBytes == 2 * header + 2 + 3);
+
+    fclose(stdout);
+    stdout = savedStdout;
+}
+
+TEST(test_vm_phase_timing) {
+    PhaseHistogram histogram;
+    for (uint64_t ns : {0, 1, 2, 3, 900, 1000, 5000}) histogram.add(ns);
+    assert(histogram.count() == 7 && histogram.total() == 6906);
+    assert(histogram.min() == 0 && histogram.max() == 5000);
+    assert(histogram.bucket(0) == 2 && histogram.bucket(1) == 2 && histogram.bucket(9) == 2);
+    assert(histogram.quantile(0.5) == 3);           // [2, 4)
+    assert(histogram.quantile(1.0) == 5000);        // Clamped to max()
+
+    FILE* savedStdout = stdout;
+    stdout = fopen("/dev/null", "w");
+    VM vm;
+    vm.interpret("1 + 2");                          // Not timed
+    vm.setPhaseTiming(true);
+    vm.interpret("1 + 2");
+    vm.interpret("(1 +");                           // Compile error: no run
+    vm.setOptLevel(2);
+    vm.setCacheCapacity(4);
+    vm.interpret("3 * 4");
+    vm.interpret("3 * 4");                          // Cache hit: run only
+    fclose(stdout);
+    stdout = savedStdout;
+
+    const PhaseTimings& timings = vm.phaseTimings();
+    assert(timings.phase(Phase::SCAN).count() == 3);
+    assert(timings.phase(Phase::COMPILE).count() == 3);
+    assert(timings.phase(Phase::OPTIMIZE).count() == 1);
+    assert(timings.phase(Phase::EXECUTE).count() == 3);
+    assert(timings.phase(Phase::EXECUTE).total() > 0);
+    assert(timings.phase(Phase::VERIFY).count() == 0);
+}
+
+TEST(test_vm_sampling) {
+    // Line 2 does nearly all the work.
+    std::string source = "1 +\n(1";
+    for (int i = 0; i < 200; i++) source += " * 1";
+    source += ")\n+ 1";
+
+    VM eager;
+    eager.setSampling(true);
+    VM lazy;                        // Line entries are source offsets
+    lazy.setLineMode(LineMode::LAZY);
+    lazy.setSampling(true);
+
+    SamplingProfiler sampler(4096);
+    assert(sampler.start(500));
+    SamplingProfiler second;
+    assert(!second.start());        // One at a time
+
+    FILE* savedStdout = stdout;
+    stdout = fopen("/dev/null", "w");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (sampler.sampleCount() < 200 && std::chrono::steady_clock::now() < deadline) {
+        eager.interpret(source);
+        lazy.interpret(source);
+    }
+    fclose(stdout);
+    stdout = savedStdout;
+    sampler.stop();
+
+    size_t inVM = 0, onLine2 = 0;
+    for (size_t i = 0; i < sampler.sampleCount(); i++) {
+        const Sample& sample = sampler.sample(i);
+        if (!sample.inVM) continue;
+        assert(sample.line >= 1 && sample.line <= 3);
+        assert(sample.opcode < OPCODE_COUNT);
+        inVM++;
+        if (sample.line == 2) onLine2++;
+    }
+    assert(inVM > 0 && onLine2 * 2 > inVM);
+    assert(sampler.dropped() == 0);
+
+    const char* path = "vm_test_samples.folded";
+    assert(sampler.writeFolded(path, "test"));
+    FILE* file = fopen(path, "r");
+    char line[128];
+    assert(fgets(line, sizeof(line), file) != nullptr);
+    assert(strncmp(line, "test;line ", 10) == 0);
+    fclose(file);
+    remove(path);
+
+    // Stopped: the slot is free again.
+    assert(second.start());
+    second.stop();
+}
+
 int main() {
     printf("=== VM Unit Tests (Chapter 19 - Strings) ===\n\n");
 
@@ -451,6 +1093,7 @@ int main() {
     RUN_TEST(test_vm_greater);
     RUN_TEST(test_vm_less);
     RUN_TEST(test_vm_negate_non_number_error);
+    RUN_TEST(test_vm_frozen_chunk);
     RUN_TEST(test_vm_add_type_error);
 
     // Chapter 19 tests
@@ -461,6 +1104,31 @@ int main() {
     RUN_TEST(test_vm_string_not_equal_bytecode);
     RUN_TEST(test_vm_string_number_add_error);
 
+    printf("\n--- Unchecked numeric opcodes ---\n");
+    RUN_TEST(test_vm_unchecked_number_ops);
+    RUN_TEST(test_vm_unchecked_greater);
+
+    printf("\n--- Compiled-chunk cache ---\n");
+    RUN_TEST(test_vm_cache_disabled_by_default);
+    RUN_TEST(test_vm_cache_hits);
+    RUN_TEST(test_vm_cache_lru_eviction);
+    RUN_TEST(test_vm_cache_string_constants);
+    RUN_TEST(test_vm_cache_keyed_by_opt_level);
+    RUN_TEST(test_vm_cache_skips_compile_errors);
+    RUN_TEST(test_chunk_cache_shrink);
+    RUN_TEST(test_chunk_cache_restores_object_list);
+    RUN_TEST(test_vm_result);
+    RUN_TEST(test_vm_shared_program);
+    RUN_TEST(test_bytecode_file);
+    RUN_TEST(test_bytecode_file_verifier);
+    RUN_TEST(test_vm_snapshot);
+    RUN_TEST(test_hash_source);
+    RUN_TEST(test_vm_profile);
+    RUN_TEST(test_vm_trace);
+    RUN_TEST(test_vm_stats);
+    RUN_TEST(test_vm_phase_timing);
+    RUN_TEST(test_vm_sampling);
+
     printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
 
     return tests_passed == tests_run ? 0 : 1;